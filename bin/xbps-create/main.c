@@ -101,6 +101,8 @@ usage(bool fail)
 	"                      'vi:/usr/bin/vi:/usr/bin/vim foo:/usr/bin/foo:/usr/bin/blah'\n"
 	" --build-options      A string with the used build options\n"
 	" --compression        Compression format: none, gzip, bzip2, lz4, xz, zstd (default)\n"
+	" --frame-size         Split zstd compressed data into independent frames of\n"
+	"                      at most this size in bytes\n"
 	" --shlib-provides     List of provided shared libraries (blank separated list,\n"
 	"                      e.g 'libfoo.so.1 libblah.so.2')\n"
 	" --shlib-requires     List of required shared libraries (blank separated list,\n"
@@ -734,9 +736,8 @@ process_entry_file(struct archive *ar,
 }
 
 static void
-process_archive(struct archive *ar,
-		struct archive_entry_linkresolver *resolver,
-		const char *pkgver, bool quiet)
+process_metadata(struct archive *ar,
+		struct archive_entry_linkresolver *resolver)
 {
 	struct xentry *xe;
 	char *xml;
@@ -765,6 +766,14 @@ process_archive(struct archive *ar,
 	xbps_archive_append_buf(ar, xml, strlen(xml), "./files.plist",
 	    0644, "root", "root");
 	free(xml);
+}
+
+static void
+process_archive(struct archive *ar,
+		struct archive_entry_linkresolver *resolver,
+		const char *pkgver, bool quiet)
+{
+	struct xentry *xe;
 
 	/* Add all package data files and release resources */
 	while ((xe = TAILQ_FIRST(&xentry_list)) != NULL) {
@@ -781,6 +790,123 @@ process_archive(struct archive *ar,
 	}
 }
 
+static struct archive *
+archive_new(const char *compression, const char *framesize)
+{
+	struct archive *ar;
+
+	ar = archive_write_new();
+	if (ar == NULL)
+		die("cannot create new archive");
+	/*
+	 * Set compression format, zstd by default.
+	 */
+	if (compression == NULL || strcmp(compression, "zstd") == 0) {
+		archive_write_add_filter_zstd(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "xz") == 0) {
+		archive_write_add_filter_xz(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "gzip") == 0) {
+		archive_write_add_filter_gzip(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "bzip2") == 0) {
+		archive_write_add_filter_bzip2(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "lz4") == 0) {
+		archive_write_add_filter_lz4(ar);
+		archive_write_set_options(ar, "compression-level=9");
+	} else if (strcmp(compression, "none") == 0) {
+		/* empty */
+	} else {
+		die("unknown compression format %s", compression);
+	}
+	/*
+	 * Independent zstd frames can be decompressed in parallel.
+	 */
+	if (framesize) {
+		if (compression && strcmp(compression, "zstd"))
+			die("--frame-size is only supported with zstd compression");
+		if (archive_write_set_filter_option(ar, "zstd",
+		    "max-frame-size", framesize) != ARCHIVE_OK)
+			die("invalid frame size %s", framesize);
+	}
+	return ar;
+}
+
+struct membuf {
+	char *buf;
+	size_t len, size;
+};
+
+static ssize_t
+membuf_write(struct archive *ar UNUSED, void *arg, const void *buf, size_t len)
+{
+	struct membuf *mb = arg;
+
+	if (mb->len + len > mb->size) {
+		mb->size = (mb->len + len) * 2;
+		if ((mb->buf = realloc(mb->buf, mb->size)) == NULL)
+			die("cannot allocate metadata buffer");
+	}
+	memcpy(mb->buf + mb->len, buf, len);
+	mb->len += len;
+	return len;
+}
+
+/*
+ * Writes the metadata entries as the first compressed frame of the
+ * package, so that they can be read without decompressing the payload.
+ * The tar end of archive blocks are stripped, the tar stream continues
+ * in the next frame.
+ */
+static void
+write_metadata(int fd, struct archive_entry_linkresolver *resolver,
+		uint64_t *metasize, uint64_t *metausize)
+{
+	struct archive *ar;
+	struct archive_entry *entry;
+	struct membuf mb = { NULL, 0, 0 };
+	off_t off;
+
+	if ((ar = archive_write_new()) == NULL)
+		die("cannot create new archive");
+	archive_write_set_format_pax_restricted(ar);
+	archive_write_set_bytes_per_block(ar, 0);
+	if (archive_write_open(ar, &mb, NULL, membuf_write, NULL) != ARCHIVE_OK)
+		die_archive(ar, "cannot open metadata archive:");
+	process_metadata(ar, resolver);
+	if (archive_write_close(ar) != ARCHIVE_OK)
+		die_archive(ar, "cannot write metadata archive:");
+	archive_write_free(ar);
+
+	/* two zero blocks mark the end of archive */
+	if (mb.len < 1024)
+		die("invalid metadata archive");
+	mb.len -= 1024;
+
+	ar = archive_new(NULL, NULL);
+	archive_write_set_format_raw(ar);
+	if (archive_write_open_fd(ar, fd) != ARCHIVE_OK)
+		die_archive(ar, "cannot open metadata frame:");
+	if ((entry = archive_entry_new()) == NULL)
+		die("cannot create metadata entry");
+	archive_entry_set_filetype(entry, AE_IFREG);
+	archive_entry_set_size(entry, mb.len);
+	if (archive_write_header(ar, entry) != ARCHIVE_OK ||
+	    archive_write_data(ar, mb.buf, mb.len) != (ssize_t)mb.len ||
+	    archive_write_close(ar) != ARCHIVE_OK)
+		die_archive(ar, "cannot write metadata frame:");
+	archive_entry_free(entry);
+	archive_write_free(ar);
+	free(mb.buf);
+
+	if ((off = lseek(fd, 0, SEEK_CUR)) == -1)
+		die("cannot get metadata frame size:");
+	*metasize = (uint64_t)off;
+	*metausize = mb.len;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -812,6 +938,7 @@ main(int argc, char **argv)
 		{ "build-options", required_argument, NULL, '2' },
 		{ "compression", required_argument, NULL, '3' },
 		{ "alternatives", required_argument, NULL, '4' },
+		{ "frame-size", required_argument, NULL, '5' },
 		{ "changelog", required_argument, NULL, 'c'},
 		{ NULL, 0, NULL, 0 }
 	};
@@ -824,8 +951,10 @@ main(int argc, char **argv)
 	const char *arch, *config_files, *mutable_files, *version, *changelog;
 	const char *buildopts, *shlib_provides, *shlib_requires, *alternatives;
 	const char *compression, *tags = NULL, *srcrevs = NULL;
+	const char *framesize = NULL;
 	char pkgname[XBPS_NAME_SIZE], *binpkg, *tname, *p, cwd[PATH_MAX-1];
-	bool quiet = false, preserve = false;
+	uint64_t metasize = 0, metausize = 0;
+	bool quiet = false, preserve = false, seekable;
 	int c, pkg_fd;
 	mode_t myumask;
 
@@ -920,6 +1049,9 @@ main(int argc, char **argv)
 		case '4':
 			alternatives = optarg;
 			break;
+		case '5':
+			framesize = optarg;
+			break;
 		case '?':
 		default:
 			usage(true);
@@ -1042,44 +1174,28 @@ main(int argc, char **argv)
 	assert(pkg_fd != -1);
 	umask(myumask);
 	/*
-	 * Process the binary package's archive (ustar compressed with xz).
+	 * Process the binary package's archive (ustar compressed with zstd).
 	 */
-	ar = archive_write_new();
-	if (ar == NULL)
-		die("cannot create new archive");
+	if ((resolver = archive_entry_linkresolver_new()) == NULL)
+		die("cannot create link resolver");
+	archive_entry_linkresolver_set_strategy(resolver,
+	    ARCHIVE_FORMAT_TAR_PAX_RESTRICTED);
 	/*
-	 * Set compression format, zstd by default.
+	 * zstd packages have a seekable layout: the metadata frame first,
+	 * then the payload, and an index at the end.
 	 */
-	if (compression == NULL || strcmp(compression, "zstd") == 0) {
-		archive_write_add_filter_zstd(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "xz") == 0) {
-		archive_write_add_filter_xz(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "gzip") == 0) {
-		archive_write_add_filter_gzip(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "bzip2") == 0) {
-		archive_write_add_filter_bzip2(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "lz4") == 0) {
-		archive_write_add_filter_lz4(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "none") == 0) {
-		/* empty */
-	} else {
-		die("unknown compression format %s", compression);
-	}
+	seekable = compression == NULL || strcmp(compression, "zstd") == 0;
+	if (seekable)
+		write_metadata(pkg_fd, resolver, &metasize, &metausize);
 
+	ar = archive_new(compression, framesize);
 	archive_write_set_format_pax_restricted(ar);
-	if ((resolver = archive_entry_linkresolver_new()) == NULL)
-		die("cannot create link resolver");
-	archive_entry_linkresolver_set_strategy(resolver,
-	    archive_format(ar));
 
 	if (archive_write_open_fd(ar, pkg_fd) != ARCHIVE_OK)
 		die("Failed to open %s fd for writing:", tname);
 
+	if (!seekable)
+		process_metadata(ar, resolver);
 	process_archive(ar, resolver, pkgver, quiet);
 	/* Process hardlinks */
 	entry = NULL;
@@ -1096,6 +1212,10 @@ main(int argc, char **argv)
 	if (archive_write_free(ar) != ARCHIVE_OK)
 		die_archive(ar, "Failed to close archive");
 
+	if (seekable && (errno = xbps_archive_write_index(pkg_fd, metasize,
+	    metausize)) != 0)
+		die("Failed to write index to %s:", tname);
+
 	/*
 	 * Archive was created successfully; flush data to storage,
 	 * set permissions and rename to dest file; from the caller's
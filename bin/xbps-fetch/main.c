@@ -42,6 +42,7 @@ usage(bool fail)
 	fprintf(stdout,
 	"Usage: xbps-fetch [options] <url> <url+N>\n\n"
 	"OPTIONS\n"
+	" -C, --config <dir> Path to confdir (xbps.d)\n"
 	" -d, --debug       Enable debug messages to stderr\n"
 	" -h, --help        Show usage\n"
 	" -o, --out <file>  Rename downloaded file to <file>\n"
@@ -90,8 +91,9 @@ main(int argc, char **argv)
 	bool shasum = false;
 	struct xbps_handle xh = { 0 };
 	struct xferstat xfer = { 0 };
-	const char *filename = NULL, *progname = argv[0];
+	const char *filename = NULL, *confdir = NULL, *progname = argv[0];
 	const struct option longopts[] = {
+		{ "config", required_argument, NULL, 'C' },
 		{ "out", required_argument, NULL, 'o' },
 		{ "debug", no_argument, NULL, 'd' },
 		{ "help", no_argument, NULL, 'h' },
@@ -101,11 +103,14 @@ main(int argc, char **argv)
 		{ NULL, 0, NULL, 0 }
 	};
 
-	while ((c = getopt_long(argc, argv, "o:dhsVv", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "C:o:dhsVv", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'h':
 			usage(false);
 			/* NOTREACHED */
+		case 'C':
+			confdir = optarg;
+			break;
 		case 'o':
 			filename = optarg;
 			break;
@@ -140,6 +145,8 @@ main(int argc, char **argv)
 	* Initialize libxbps.
 	*/
 	xh.flags = flags;
+	if (confdir)
+		xbps_strlcpy(xh.confdir, confdir, sizeof(xh.confdir));
 	xh.fetch_cb = fetch_file_progress_cb;
 	xh.fetch_cb_data = &xfer;
 	if ((rv = xbps_init(&xh)) != 0) {
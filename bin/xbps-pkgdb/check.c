@@ -35,6 +35,9 @@
 #include <xbps.h>
 #include "defs.h"
 
+/* max threads to hash the files of a package, 0 for all CPUs */
+unsigned int check_hash_threads;
+
 static int
 pkgdb_cb(struct xbps_handle *xhp UNUSED,
 		xbps_object_t obj,
@@ -62,8 +65,21 @@ pkgdb_cb(struct xbps_handle *xhp UNUSED,
 int
 check_pkg_integrity_all(struct xbps_handle *xhp)
 {
+	struct xbps_hash_stats stats;
 	int errors = 0;
+
+	/* packages are already checked in parallel */
+	check_hash_threads = 1;
+	xbps_file_hash_stats(NULL, true);
 	xbps_pkgdb_foreach_cb_multi(xhp, pkgdb_cb, &errors);
+	if (xhp->flags & XBPS_FLAG_VERBOSE) {
+		xbps_file_hash_stats(&stats, false);
+		printf("Hashed %"PRIu64" files (%"PRIu64" mmapped, %"PRIu64" cached), "
+		    "%"PRIu64" KiB in %"PRIu64" ms (added up for all "
+		    "threads).\n", stats.files,
+		    stats.mmap_files, stats.cached_files, stats.bytes / 1024,
+		    stats.usecs / 1000);
+	}
 	return errors ? -1 : 0;
 }
 
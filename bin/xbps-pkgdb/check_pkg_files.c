@@ -78,41 +78,62 @@ check_file_mtime(xbps_dictionary_t d, const char *pkg, const char *path)
 int
 check_pkg_files(struct xbps_handle *xhp, const char *pkgname, void *arg)
 {
+	struct xbps_sha256_item *items;
 	xbps_array_t array;
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
 	xbps_dictionary_t pkg_filesd = arg;
-	const char *file = NULL, *sha256 = NULL;
-	char *path;
+	const char *file = NULL;
+	char **paths, *path;
 	bool mutable, test_broken = false;
+	unsigned int i, nitems = 0;
 	int rv = 0, errors = 0;
 
 	array = xbps_dictionary_get(pkg_filesd, "files");
 	if (array != NULL && xbps_array_count(array) > 0) {
-		iter = xbps_array_iter_from_dict(pkg_filesd, "files");
-		if (iter == NULL)
+		items = calloc(xbps_array_count(array), sizeof(*items));
+		paths = calloc(xbps_array_count(array), sizeof(*paths));
+		if (items == NULL || paths == NULL) {
+			free(items);
+			free(paths);
 			return -1;
-
-		while ((obj = xbps_object_iterator_next(iter))) {
+		}
+		/*
+		 * Collect all files to hash them at once.
+		 */
+		for (i = 0; i < xbps_array_count(array); i++) {
+			obj = xbps_array_get(array, i);
 			xbps_dictionary_get_cstring_nocopy(obj, "file", &file);
 			/* skip noextract files */
-			if (xhp->noextract && xbps_patterns_match(xhp->noextract, file))
+			if (xbps_noextract_match(xhp, file))
 				continue;
-			path = xbps_xasprintf("%s/%s", xhp->rootdir, file);
+			paths[nitems] = xbps_xasprintf("%s/%s",
+			    xhp->rootdir, file);
+			items[nitems].file = paths[nitems];
 			xbps_dictionary_get_cstring_nocopy(obj,
-				"sha256", &sha256);
-			rv = xbps_file_sha256_check(path, sha256);
+				"sha256", &items[nitems].sha256);
+			items[nitems].cache = (xhp->flags & XBPS_FLAG_HASH_CACHE);
+			nitems++;
+		}
+		(void)xbps_file_sha256_batch(items, nitems, check_hash_threads);
+
+		for (i = 0, nitems = 0; i < xbps_array_count(array); i++) {
+			obj = xbps_array_get(array, i);
+			xbps_dictionary_get_cstring_nocopy(obj, "file", &file);
+			if (xbps_noextract_match(xhp, file))
+				continue;
+			path = paths[nitems];
+			rv = items[nitems].rv;
+			nitems++;
 			switch (rv) {
 			case 0:
 				if (check_file_mtime(obj, pkgname, path)) {
 					test_broken = true;
 				}
-				free(path);
 				break;
 			case ENOENT:
 				xbps_error_printf("%s: unexistent file %s.\n",
 				    pkgname, file);
-				free(path);
 				test_broken = true;
 				break;
 			case ERANGE:
@@ -124,17 +145,18 @@ check_pkg_files(struct xbps_handle *xhp, const char *pkgname, void *arg)
 					    "for %s.\n", pkgname, file);
 					test_broken = true;
 				}
-				free(path);
 				break;
 			default:
 				xbps_error_printf(
 				    "%s: can't check `%s' (%s)\n",
 				    pkgname, file, strerror(rv));
-				free(path);
 				break;
 			}
-                }
-                xbps_object_iterator_release(iter);
+		}
+		for (i = 0; i < nitems; i++)
+			free(paths[i]);
+		free(paths);
+		free(items);
 	}
 	if (test_broken) {
 		xbps_error_printf("%s: files check FAILED.\n", pkgname);
@@ -154,7 +176,7 @@ check_pkg_files(struct xbps_handle *xhp, const char *pkgname, void *arg)
 		while ((obj = xbps_object_iterator_next(iter))) {
 			xbps_dictionary_get_cstring_nocopy(obj, "file", &file);
 			/* skip noextract files */
-			if (xhp->noextract && xbps_patterns_match(xhp->noextract, file))
+			if (xbps_noextract_match(xhp, file))
 				continue;
 			path = xbps_xasprintf("%s/%s", xhp->rootdir, file);
 			if (access(path, R_OK) == -1) {
@@ -67,7 +67,7 @@ check_pkg_symlinks(struct xbps_handle *xhp, const char *pkgname, void *arg)
 			continue;
 
 		/* skip noextract files */
-		if (xhp->noextract && xbps_patterns_match(xhp->noextract, file))
+		if (xbps_noextract_match(xhp, file))
 			continue;
 
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "target", &tgt)) {
@@ -32,6 +32,7 @@
 /* from check.c */
 int	check_pkg_integrity(struct xbps_handle *, xbps_dictionary_t, const char *);
 int	check_pkg_integrity_all(struct xbps_handle *);
+extern unsigned int check_hash_threads;
 
 #define CHECK_PKG_DECL(type)			\
 int check_pkg_##type (struct xbps_handle *, const char *, void *)
@@ -36,35 +36,29 @@
 #include <xbps.h>
 #include "defs.h"
 
-static int
-cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj,
-		const char *key UNUSED, void *arg,
-		bool *done UNUSED)
+/*
+ * Returns the SHA256 hash of the binary package \a binpkg registered
+ * in the repository pool, or NULL if it must be ignored (\a ignore set)
+ * or it's not registered in any repository.
+ */
+static const char *
+binpkg_sha256(struct xbps_handle *xhp, const char *binpkg, bool *ignore)
 {
 	xbps_dictionary_t repo_pkgd;
-	const char *binpkg, *rsha256;
-	char *binpkgsig, *pkgver, *arch;
-	bool drun = false;
-
-	/* Extract drun (dry-run) flag from arg*/
-	if (arg != NULL)
-		drun = *(bool*)arg;
+	const char *rsha256 = NULL;
+	char *pkgver, *arch;
 
-	/* Internalize props.plist dictionary from binary pkg */
-	binpkg = xbps_string_cstring_nocopy(obj);
 	arch = xbps_binpkg_arch(binpkg);
 	assert(arch);
 
 	if (!xbps_pkg_arch_match(xhp, arch, NULL)) {
 		xbps_dbg_printf(xhp, "%s: ignoring binpkg with unmatched arch (%s)\n", binpkg, arch);
 		free(arch);
-		return 0;
+		*ignore = true;
+		return NULL;
 	}
 	free(arch);
-	/*
-	 * Remove binary pkg if it's not registered in any repository
-	 * or if hash doesn't match.
-	 */
+
 	pkgver = xbps_binpkg_pkgver(binpkg);
 	assert(pkgver);
 	repo_pkgd = xbps_rpool_get_pkg(xhp, pkgver);
@@ -72,11 +66,15 @@ cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj,
 	if (repo_pkgd) {
 		xbps_dictionary_get_cstring_nocopy(repo_pkgd,
 		    "filename-sha256", &rsha256);
-		if (xbps_file_sha256_check(binpkg, rsha256) == 0) {
-			/* hash matched */
-			return 0;
-		}
 	}
+	return rsha256;
+}
+
+static void
+remove_binpkg(const char *binpkg, bool drun)
+{
+	char *binpkgsig;
+
 	binpkgsig = xbps_xasprintf("%s.sig", binpkg);
 	if (!drun && unlink(binpkg) == -1) {
 		fprintf(stderr, "Failed to remove `%s': %s\n",
@@ -91,18 +89,19 @@ cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj,
 		}
 	}
 	free(binpkgsig);
-
-	return 0;
 }
 
 int
 clean_cachedir(struct xbps_handle *xhp, bool drun)
 {
+	struct xbps_sha256_item *items;
 	xbps_array_t array = NULL;
 	DIR *dirp;
 	struct dirent *dp;
+	const char *binpkg;
 	char *ext;
-	int rv = 0;
+	unsigned int i, nitems = 0;
+	bool ignore;
 
 	if (chdir(xhp->cachedir) == -1)
 		return -1;
@@ -127,9 +126,66 @@ clean_cachedir(struct xbps_handle *xhp, bool drun)
 	}
 	(void)closedir(dirp);
 
-	if (xbps_array_count(array)) {
-		rv = xbps_array_foreach_cb_multi(xhp, array, NULL, cleaner_cb, (void*)&drun);
+	if (xbps_array_count(array) == 0) {
+		xbps_object_release(array);
+		return 0;
+	}
+	if ((items = calloc(xbps_array_count(array), sizeof(*items))) == NULL) {
 		xbps_object_release(array);
+		return -1;
 	}
-	return rv;
+	/*
+	 * Remove binary pkg if it's not registered in any repository
+	 * or if hash doesn't match, the hashes of all registered
+	 * packages are computed at once.
+	 */
+	for (i = 0; i < xbps_array_count(array); i++) {
+		xbps_array_get_cstring_nocopy(array, i, &binpkg);
+		ignore = false;
+		items[nitems].sha256 = binpkg_sha256(xhp, binpkg, &ignore);
+		if (ignore)
+			continue;
+		if (items[nitems].sha256 == NULL) {
+			remove_binpkg(binpkg, drun);
+			continue;
+		}
+		items[nitems++].file = binpkg;
+	}
+	xbps_file_hash_stats(NULL, true);
+	(void)xbps_file_sha256_batch(items, nitems, 0);
+	if (xhp->flags & XBPS_FLAG_VERBOSE) {
+		struct xbps_hash_stats stats;
+
+		xbps_file_hash_stats(&stats, false);
+		printf("Hashed %"PRIu64" packages (%"PRIu64" mmapped), "
+		    "%"PRIu64" KiB in %"PRIu64" ms (added up for all "
+		    "threads).\n", stats.files,
+		    stats.mmap_files, stats.bytes / 1024, stats.usecs / 1000);
+	}
+
+	for (i = 0; i < nitems; i++) {
+		if (items[i].rv != 0)
+			remove_binpkg(items[i].file, drun);
+	}
+	free(items);
+	xbps_object_release(array);
+
+	return 0;
+}
+
+int
+clean_filestore(struct xbps_handle *xhp, bool drun)
+{
+	size_t nfiles = 0;
+	int rv;
+
+	if ((rv = xbps_filestore_clean(xhp, drun, &nfiles)) != 0) {
+		fprintf(stderr, "Failed to clean file store: %s\n",
+		    strerror(rv));
+		return rv;
+	}
+	if (nfiles > 0)
+		printf("Removed %zu unused files from the file store\n", nfiles);
+
+	return 0;
 }
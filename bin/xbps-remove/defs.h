@@ -28,5 +28,6 @@
 
 /* From clean-cache.c */
 int	clean_cachedir(struct xbps_handle *, bool drun);
+int	clean_filestore(struct xbps_handle *, bool drun);
 
 #endif /* !_XBPS_REMOVE_DEFS_H_ */
@@ -265,6 +265,8 @@ main(int argc, char **argv)
 
 	if (clean_cache) {
 		rv = clean_cachedir(&xh, drun);
+		if (rv == 0)
+			rv = clean_filestore(&xh, drun);
 		if (!orphans || rv)
 			exit(rv);;
 	}
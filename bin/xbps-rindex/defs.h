@@ -63,10 +63,14 @@
 #define _XBPS_RINDEX		"xbps-rindex"
 
 /* From index-add.c */
-int	index_add(struct xbps_handle *, int, int, char **, bool, const char *);
+int	index_add(struct xbps_handle *, int, int, char **, bool, const char *,
+		unsigned int, bool);
 
 /* From index-clean.c */
-int	index_clean(struct xbps_handle *, const char *, bool, const char *);
+int	index_clean(struct xbps_handle *, const char *, bool, const char *, bool);
+
+/* From index-compact.c */
+int	index_compact(struct xbps_handle *, const char *, const char *);
 
 /* From remove-obsoletes.c */
 int	remove_obsoletes(struct xbps_handle *, const char *);
@@ -77,7 +81,11 @@ int	sign_repo(struct xbps_handle *, const char *, const char *,
 int	sign_pkgs(struct xbps_handle *, int, int, char **, const char *, bool);
 
 /* From repoflush.c */
+void	repodata_set_compression(int, int);
 bool	repodata_flush(struct xbps_handle *, const char *, const char *,
 		xbps_dictionary_t, xbps_dictionary_t, const char *);
+bool	repodata_append(struct xbps_handle *, const char *, const char *,
+		xbps_dictionary_t, xbps_dictionary_t, xbps_dictionary_t,
+		const char *);
 
 #endif /* !_XBPS_RINDEX_DEFS_H_ */
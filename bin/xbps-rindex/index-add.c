@@ -33,14 +33,17 @@
 #include <libgen.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <xbps.h>
 #include "defs.h"
 
 static bool
 repodata_commit(struct xbps_handle *xhp, const char *repodir,
-	xbps_dictionary_t idx, xbps_dictionary_t meta, xbps_dictionary_t stage,
-	const char *compression)
+	xbps_dictionary_t oldidx, xbps_dictionary_t idx, xbps_dictionary_t meta,
+	xbps_dictionary_t stage, const char *compression, bool append)
 {
 	xbps_object_iterator_t iter;
 	xbps_object_t keysym;
@@ -190,19 +193,233 @@ repodata_commit(struct xbps_handle *xhp, const char *repodir,
 		stagefile = xbps_repo_path_with_name(xhp, repodir, "stagedata");
 		unlink(stagefile);
 		free(stagefile);
-		rv = repodata_flush(xhp, repodir, "repodata", idx, meta, compression);
+		if (append)
+			rv = repodata_append(xhp, repodir, "repodata", oldidx,
+			    idx, meta, compression);
+		else
+			rv = repodata_flush(xhp, repodir, "repodata", idx,
+			    meta, compression);
 	}
 	xbps_object_release(usedshlibs);
 	xbps_object_release(oldshlibs);
 	return rv;
 }
 
+static int
+cmp_pkgver_desc(const void *a, const void *b)
+{
+	return xbps_cmpver(*(const char * const *)b, *(const char * const *)a);
+}
+
+/*
+ * Creates the binary deltas of the package \a pkg from up to \a ndeltas
+ * previous versions still in the repository: the package being replaced
+ * in the index and the bases of its deltas. Deltas are registered in the
+ * "deltas" dictionary of \a binpkgd, keyed by the base pkgver; deltas that
+ * don't save at least half of the binary package size are discarded.
+ */
+static int
+add_deltas(const char *repodir, const char *pkg, xbps_dictionary_t binpkgd,
+	xbps_dictionary_t curpkgd, unsigned int ndeltas)
+{
+	xbps_dictionary_t basearchs, deltas = NULL, deltad, d;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	struct stat st, dst;
+	const char **bases = NULL, *pkgver = NULL, *arch = NULL;
+	const char *curpkgver = NULL, *str = NULL;
+	char *basefile, *deltafile, *name;
+	char sha256[XBPS_SHA256_SIZE];
+	unsigned int i, nbases = 0;
+	int rv = 0;
+
+	xbps_dictionary_get_cstring_nocopy(binpkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(binpkgd, "architecture", &arch);
+	if (stat(pkg, &st) == -1)
+		return errno;
+
+	/* candidate bases and their architecture */
+	if ((basearchs = xbps_dictionary_create()) == NULL)
+		return ENOMEM;
+	xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &curpkgver);
+	xbps_dictionary_get_cstring_nocopy(curpkgd, "architecture", &str);
+	xbps_dictionary_set_cstring(basearchs, curpkgver, str);
+	if ((d = xbps_dictionary_get(curpkgd, "deltas")) != NULL) {
+		iter = xbps_dictionary_iterator(d);
+		while ((keysym = xbps_object_iterator_next(iter))) {
+			deltad = xbps_dictionary_get_keysym(d, keysym);
+			if (xbps_dictionary_get_cstring_nocopy(deltad,
+			    "architecture", &str)) {
+				xbps_dictionary_set_cstring(basearchs,
+				    xbps_dictionary_keysym_cstring_nocopy(keysym), str);
+			}
+		}
+		xbps_object_iterator_release(iter);
+	}
+	xbps_dictionary_remove(basearchs, pkgver);
+
+	if ((bases = calloc(xbps_dictionary_count(basearchs) + 1, sizeof(*bases))) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	iter = xbps_dictionary_iterator(basearchs);
+	while ((keysym = xbps_object_iterator_next(iter)))
+		bases[nbases++] = xbps_dictionary_keysym_cstring_nocopy(keysym);
+	xbps_object_iterator_release(iter);
+	qsort(bases, nbases, sizeof(*bases), cmp_pkgver_desc);
+
+	for (i = 0; i < nbases && ndeltas > 0; i++) {
+		const char *basearch = NULL;
+
+		xbps_dictionary_get_cstring_nocopy(basearchs, bases[i], &basearch);
+		basefile = xbps_xasprintf("%s/%s.%s.xbps", repodir, bases[i], basearch);
+		if (access(basefile, R_OK) == -1) {
+			free(basefile);
+			continue;
+		}
+		ndeltas--;
+		if ((name = xbps_binpkg_delta_name(pkgver, arch, bases[i])) == NULL) {
+			rv = errno;
+			free(basefile);
+			break;
+		}
+		deltafile = xbps_xasprintf("%s/%s", repodir, name);
+		rv = xbps_delta_create(basefile, pkg, deltafile);
+		free(basefile);
+		if (rv != 0) {
+			fprintf(stderr, "index: failed to create delta `%s': %s\n",
+			    name, strerror(rv));
+			free(deltafile);
+			free(name);
+			if (rv == ENOTSUP)
+				break;
+			rv = 0;
+			continue;
+		}
+		if (stat(deltafile, &dst) == -1 || dst.st_size >= st.st_size / 2 ||
+		    !xbps_file_sha256(sha256, sizeof(sha256), deltafile)) {
+			printf("index: discarded delta `%s'.\n", name);
+			(void)unlink(deltafile);
+			free(deltafile);
+			free(name);
+			continue;
+		}
+		if (deltas == NULL && (deltas = xbps_dictionary_create()) == NULL) {
+			rv = ENOMEM;
+			free(deltafile);
+			free(name);
+			break;
+		}
+		deltad = xbps_dictionary_create();
+		xbps_dictionary_set_cstring(deltad, "architecture", basearch);
+		xbps_dictionary_set_cstring(deltad, "filename-sha256", sha256);
+		xbps_dictionary_set_uint64(deltad, "filename-size", (uint64_t)dst.st_size);
+		xbps_dictionary_set(deltas, bases[i], deltad);
+		xbps_object_release(deltad);
+		printf("index: added delta `%s' (%jd bytes).\n", name,
+		    (intmax_t)dst.st_size);
+		free(deltafile);
+		free(name);
+	}
+	if (deltas != NULL) {
+		xbps_dictionary_set(binpkgd, "deltas", deltas);
+		xbps_object_release(deltas);
+	}
+out:
+	free(bases);
+	xbps_object_release(basearchs);
+	return rv;
+}
+
+/*
+ * Reading the metadata of the binary packages and hashing them is done
+ * by as many threads as online CPUs; the index is updated afterwards
+ * in the order of argv, as if they were processed serially.
+ */
+struct add_job {
+	const char *pkg;
+	xbps_dictionary_t binpkgd;
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	off_t size;
+	int rv;
+};
+
+struct add_pool {
+	struct add_job *jobs;
+	pthread_mutex_t lock;
+	unsigned int njobs;
+	unsigned int next;
+};
+
+static void *
+add_thread(void *arg)
+{
+	struct add_pool *pool = arg;
+	struct add_job *job;
+	struct stat st;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		if (pool->next == pool->njobs) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		job->binpkgd = xbps_archive_fetch_plist(job->pkg, "/props.plist");
+		if (job->binpkgd == NULL)
+			continue;
+		if (!xbps_file_sha256_raw(job->digest, sizeof(job->digest), job->pkg))
+			job->rv = errno ? errno : EIO;
+		else if (stat(job->pkg, &st) == -1)
+			job->rv = errno;
+		else
+			job->size = st.st_size;
+	}
+	return NULL;
+}
+
+static void
+add_read_pkgs(struct add_job *jobs, unsigned int njobs)
+{
+	struct add_pool pool;
+	pthread_t *thds = NULL;
+	unsigned int i, nthreads, n = 0;
+	long ncpus;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = ncpus > 0 ? (unsigned int)ncpus : 1;
+	if (nthreads > njobs)
+		nthreads = njobs;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.jobs = jobs;
+	pool.njobs = njobs;
+	pthread_mutex_init(&pool.lock, NULL);
+
+	if (nthreads > 1 && (thds = calloc(nthreads, sizeof(*thds))) != NULL) {
+		for (i = 0; i < nthreads - 1; i++) {
+			if (pthread_create(&thds[i], NULL, add_thread, &pool) != 0)
+				break;
+			n++;
+		}
+	}
+	/* this thread reads the remaining packages, if any */
+	add_thread(&pool);
+	for (i = 0; i < n; i++)
+		pthread_join(thds[i], NULL);
+	free(thds);
+	pthread_mutex_destroy(&pool.lock);
+}
+
 int
-index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force, const char *compression)
+index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force,
+	const char *compression, unsigned int ndeltas, bool append)
 {
 	xbps_dictionary_t idx, idxmeta, idxstage, binpkgd, curpkgd;
 	struct xbps_repo *repo = NULL, *stage = NULL;
-	struct stat st;
+	struct add_job *jobs = NULL;
 	char *tmprepodir = NULL, *repodir = NULL, *rlockfname = NULL;
 	int rv = 0, ret = 0, rlockfd = -1;
 
@@ -247,10 +464,21 @@ index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force
 	else {
 		idxstage = xbps_dictionary_create();
 	}
+	/*
+	 * Read and hash all packages specified in argv at once.
+	 */
+	if ((jobs = calloc(argmax - args, sizeof(*jobs))) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	for (int i = args; i < argmax; i++)
+		jobs[i - args].pkg = argv[i];
+	add_read_pkgs(jobs, argmax - args);
 	/*
 	 * Process all packages specified in argv.
 	 */
 	for (int i = args; i < argmax; i++) {
+		struct add_job *job = &jobs[i - args];
 		const char *arch = NULL, *pkg = argv[i];
 		char *pkgver = NULL;
 		char sha256[XBPS_SHA256_SIZE];
@@ -258,9 +486,10 @@ index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force
 
 		assert(pkg);
 		/*
-		 * Read metadata props plist dictionary from binary package.
+		 * Metadata props plist dictionary from binary package.
 		 */
-		binpkgd = xbps_archive_fetch_plist(pkg, "/props.plist");
+		binpkgd = job->binpkgd;
+		job->binpkgd = NULL;
 		if (binpkgd == NULL) {
 			fprintf(stderr, "index: failed to read %s metadata for "
 			    "`%s', skipping!\n", XBPS_PKGPROPS, pkg);
@@ -332,28 +561,30 @@ index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force
 		 * 	- filename-size
 		 * 	- filename-sha256
 		 */
-		if (!xbps_file_sha256(sha256, sizeof sha256, pkg)) {
+		if (job->rv != 0) {
 			xbps_object_release(binpkgd);
 			free(pkgver);
 			rv = EINVAL;
 			goto out;
 		}
+		for (int j = 0; j < XBPS_SHA256_DIGEST_SIZE; j++)
+			snprintf(sha256 + j * 2, 3, "%02x", job->digest[j]);
 		if (!xbps_dictionary_set_cstring(binpkgd, "filename-sha256", sha256)) {
 			xbps_object_release(binpkgd);
 			free(pkgver);
 			rv = EINVAL;
 			goto out;
 		}
-		if (stat(pkg, &st) == -1) {
+		if (!xbps_dictionary_set_uint64(binpkgd, "filename-size", (uint64_t)job->size)) {
 			xbps_object_release(binpkgd);
 			free(pkgver);
 			rv = EINVAL;
 			goto out;
 		}
-		if (!xbps_dictionary_set_uint64(binpkgd, "filename-size", (uint64_t)st.st_size)) {
+		if (ndeltas > 0 && curpkgd != NULL &&
+		    (rv = add_deltas(repodir, pkg, binpkgd, curpkgd, ndeltas)) != 0) {
 			xbps_object_release(binpkgd);
 			free(pkgver);
-			rv = EINVAL;
 			goto out;
 		}
 		/* Remove unneeded objects */
@@ -376,14 +607,23 @@ index_add(struct xbps_handle *xhp, int args, int argmax, char **argv, bool force
 	/*
 	 * Generate repository data files.
 	 */
-	if (!repodata_commit(xhp, repodir, idx, idxmeta, idxstage, compression)) {
+	if (!repodata_commit(xhp, repodir, repo ? repo->idx : NULL, idx,
+	    idxmeta, idxstage, compression, append)) {
+		rv = errno;
 		fprintf(stderr, "%s: failed to write repodata: %s\n",
-				_XBPS_RINDEX, strerror(errno));
+				_XBPS_RINDEX, strerror(rv));
 		goto out;
 	}
 	printf("index: %u packages registered.\n", xbps_dictionary_count(idx));
 
 out:
+	if (jobs != NULL) {
+		for (int i = 0; i < argmax - args; i++) {
+			if (jobs[i].binpkgd != NULL)
+				xbps_object_release(jobs[i].binpkgd);
+		}
+		free(jobs);
+	}
 	xbps_object_release(idx);
 	xbps_object_release(idxstage);
 	if (idxmeta)
@@ -34,12 +34,93 @@
 #include <assert.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <xbps.h>
 #include "defs.h"
 
 static xbps_dictionary_t dest;
 
+/*
+ * Stat cache of the binary packages hashed with --hashcheck, stored
+ * next to the repodata: the SHA256 of a package is trusted while it
+ * has the same mtime, size and inode number it had when it was hashed.
+ */
+static xbps_dictionary_t statcache, newstatcache;
+static time_t cleanstart;
+
+static bool
+statcache_match(xbps_dictionary_t d, const struct stat *st)
+{
+	uint64_t mtime_sec, mtime_nsec, size, ino;
+
+	return xbps_dictionary_get_uint64(d, "mtime-sec", &mtime_sec) &&
+	    xbps_dictionary_get_uint64(d, "mtime-nsec", &mtime_nsec) &&
+	    xbps_dictionary_get_uint64(d, "size", &size) &&
+	    xbps_dictionary_get_uint64(d, "inode", &ino) &&
+	    mtime_sec == (uint64_t)st->st_mtim.tv_sec &&
+	    mtime_nsec == (uint64_t)st->st_mtim.tv_nsec &&
+	    size == (uint64_t)st->st_size &&
+	    ino == (uint64_t)st->st_ino;
+}
+
+static void
+statcache_set(const char *fname, const struct stat *st, const char *sha256)
+{
+	xbps_dictionary_t d;
+
+	if ((d = xbps_dictionary_create()) == NULL)
+		return;
+	xbps_dictionary_set_uint64(d, "mtime-sec", (uint64_t)st->st_mtim.tv_sec);
+	xbps_dictionary_set_uint64(d, "mtime-nsec", (uint64_t)st->st_mtim.tv_nsec);
+	xbps_dictionary_set_uint64(d, "size", (uint64_t)st->st_size);
+	xbps_dictionary_set_uint64(d, "inode", (uint64_t)st->st_ino);
+	xbps_dictionary_set_cstring(d, "sha256", sha256);
+	xbps_dictionary_set(newstatcache, fname, d);
+	xbps_object_release(d);
+}
+
+/*
+ * Checks the SHA256 of the binary package \a filen, hashing it only
+ * if it changed since it was cached.
+ * Returns 0 if it matches \a sha256, an errno value otherwise.
+ */
+static int
+statcache_sha256_check(struct xbps_handle *xhp, const char *filen,
+		const char *sha256)
+{
+	xbps_dictionary_t d;
+	struct stat st, nst;
+	const char *fname, *csha256 = NULL;
+	char buf[XBPS_SHA256_SIZE];
+
+	if (stat(filen, &st) == -1)
+		return errno;
+	fname = strrchr(filen, '/') + 1;
+	d = xbps_dictionary_get(statcache, fname);
+	if (d && statcache_match(d, &st) &&
+	    xbps_dictionary_get_cstring_nocopy(d, "sha256", &csha256)) {
+		xbps_dbg_printf(xhp, "%s: unchanged since last check\n", fname);
+		xbps_dictionary_set(newstatcache, fname, d);
+	} else {
+		if (!xbps_file_sha256(buf, sizeof(buf), filen))
+			return errno;
+		csha256 = buf;
+		/*
+		 * Do not cache packages modified while being hashed, or
+		 * in the second the clean started: on filesystems with
+		 * coarse timestamps a later change could keep the mtime.
+		 */
+		if (stat(filen, &nst) == 0 &&
+		    nst.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+		    nst.st_mtim.tv_nsec == st.st_mtim.tv_nsec &&
+		    nst.st_size == st.st_size && nst.st_ino == st.st_ino &&
+		    st.st_mtime < cleanstart)
+			statcache_set(fname, &st, buf);
+	}
+	return (sha256 && strcmp(csha256, sha256) == 0) ? 0 : ERANGE;
+}
+
 struct CleanerCbInfo {
 	const char *repourl;
 	bool hashcheck;
@@ -77,7 +158,7 @@ idx_cleaner_cb(struct xbps_handle *xhp,
 		 */
 		xbps_dictionary_get_cstring_nocopy(obj,
 				"filename-sha256", &sha256);
-		if (xbps_file_sha256_check(filen, sha256) != 0) {
+		if (statcache_sha256_check(xhp, filen, sha256) != 0) {
 			if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
 				goto out;
 			xbps_dictionary_remove(dest, pkgname);
@@ -91,8 +172,9 @@ out:
 
 static int
 cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *repo,
-	const char *reponame, bool hashcheck, const char *compression)
+	const char *reponame, bool hashcheck, const char *compression, bool append)
 {
+	bool flushed;
 	int rv = 0;
 	xbps_array_t allkeys;
 	struct CleanerCbInfo info = {
@@ -113,7 +195,14 @@ cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *rep
 		free(stagefile);
 	}
 	if (!xbps_dictionary_equals(dest, repo->idx)) {
-		if (!repodata_flush(xhp, repodir, reponame, dest, repo->idxmeta, compression)) {
+		/* the stage index is always written as a whole */
+		if (append && strcmp("repodata", reponame) == 0)
+			flushed = repodata_append(xhp, repodir, reponame,
+			    repo->idx, dest, repo->idxmeta, compression);
+		else
+			flushed = repodata_flush(xhp, repodir, reponame, dest,
+			    repo->idxmeta, compression);
+		if (!flushed) {
 			rv = errno;
 			fprintf(stderr, "failed to write repodata: %s\n",
 			    strerror(errno));
@@ -132,10 +221,11 @@ cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *rep
  * binary package cannot be read (unavailable, not enough perms, etc).
  */
 int
-index_clean(struct xbps_handle *xhp, const char *repodir, const bool hashcheck, const char *compression)
+index_clean(struct xbps_handle *xhp, const char *repodir, const bool hashcheck,
+	const char *compression, bool append)
 {
 	struct xbps_repo *repo, *stage;
-	char *rlockfname = NULL;
+	char *rlockfname = NULL, *statcachefile = NULL;
 	int rv = 0, rlockfd = -1;
 
 	if (!xbps_repo_lock(xhp, repodir, &rlockfd, &rlockfname)) {
@@ -164,14 +254,38 @@ index_clean(struct xbps_handle *xhp, const char *repodir, const bool hashcheck,
 	}
 	printf("Cleaning `%s' index, please wait...\n", repodir);
 
-	if ((rv = cleanup_repo(xhp, repodir, repo, "repodata", hashcheck, compression))) {
+	if (hashcheck) {
+		char *repofile = xbps_repo_path(xhp, repodir);
+
+		statcachefile = xbps_xasprintf("%s.statcache", repofile);
+		free(repofile);
+		statcache = xbps_dictionary_internalize_from_file(statcachefile);
+		newstatcache = xbps_dictionary_create();
+		cleanstart = time(NULL);
+	}
+
+	if ((rv = cleanup_repo(xhp, repodir, repo, "repodata", hashcheck,
+	    compression, append))) {
 		goto out;
 	}
 	if (stage) {
-		cleanup_repo(xhp, repodir, stage, "stagedata", hashcheck, compression);
+		cleanup_repo(xhp, repodir, stage, "stagedata", hashcheck,
+		    compression, append);
+	}
+	/* an unchanged repository leaves the stat cache untouched */
+	if (hashcheck && !xbps_dictionary_equals(statcache, newstatcache) &&
+	    !xbps_dictionary_externalize_to_file(newstatcache, statcachefile)) {
+		fprintf(stderr, "%s: failed to write stat cache: %s\n",
+		    _XBPS_RINDEX, strerror(errno));
 	}
 
 out:
+	if (statcache)
+		xbps_object_release(statcache);
+	if (newstatcache)
+		xbps_object_release(newstatcache);
+	statcache = newstatcache = NULL;
+	free(statcachefile);
 	xbps_repo_release(repo);
 	if(stage)
 		xbps_repo_release(stage);
@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <xbps.h>
+#include "defs.h"
+
+/*
+ * Writes the repository index again as a whole, folding the index
+ * segments appended by the add and clean modes with --append.
+ */
+int
+index_compact(struct xbps_handle *xhp, const char *repodir, const char *compression)
+{
+	struct xbps_repo *repo;
+	char *rlockfname = NULL;
+	int rv = 0, rlockfd = -1;
+
+	if (!xbps_repo_lock(xhp, repodir, &rlockfd, &rlockfname)) {
+		rv = errno;
+		fprintf(stderr, "%s: cannot lock repository: %s\n",
+		    _XBPS_RINDEX, strerror(rv));
+		return rv;
+	}
+	repo = xbps_repo_public_open(xhp, repodir);
+	if (repo == NULL) {
+		rv = errno;
+		if (rv == ENOENT) {
+			xbps_repo_unlock(rlockfd, rlockfname);
+			return 0;
+		}
+		fprintf(stderr, "%s: cannot read repository data: %s\n",
+		    _XBPS_RINDEX, strerror(errno));
+		xbps_repo_unlock(rlockfd, rlockfname);
+		return rv;
+	}
+	if (!repodata_flush(xhp, repodir, "repodata", repo->idx,
+	    repo->idxmeta, compression)) {
+		rv = errno;
+		fprintf(stderr, "%s: failed to write repodata: %s\n",
+		    _XBPS_RINDEX, strerror(errno));
+	} else {
+		printf("index: %u packages registered.\n",
+		    xbps_dictionary_count(repo->idx));
+	}
+	xbps_repo_release(repo);
+	xbps_repo_unlock(rlockfd, rlockfname);
+
+	return rv;
+}
@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 
 #include "defs.h"
@@ -43,12 +44,17 @@ usage(bool fail)
 	    " -v, --verbose                      Verbose messages\n"
 	    " -V, --version                      Show XBPS version\n"
 	    " -C, --hashcheck                    Consider file hashes for cleaning up packages\n"
+	    "     --append                       Append index changes in add and clean modes\n"
 	    "     --compression <fmt>            Compression format: none, gzip, bzip2, lz4, xz, zstd (default)\n"
+	    "     --compression-level <N>        Compression level (default 9)\n"
+	    "     --compression-threads <N>      Compression threads for xz and zstd, 0 for all CPUs\n"
+	    "     --deltas <N>                   Create binary deltas from N previous versions in add mode\n"
 	    "     --privkey <key>                Path to the private key for signing\n"
 	    "     --signedby <string>            Signature details, i.e \"name <email>\"\n\n"
 	    "MODE\n"
 	    " -a, --add <repodir/file.xbps> ...  Add package(s) to repository index\n"
 	    " -c, --clean <repodir>              Clean repository index\n"
+	    "     --compact <repodir>            Fold appended index changes\n"
 	    " -r, --remove-obsoletes <repodir>   Removes obsolete packages from repository\n"
 	    " -s, --sign <repodir>               Initialize repository metadata signature\n"
 	    " -S, --sign-pkg <file.xbps> ...     Sign binary package archive\n");
@@ -74,17 +80,25 @@ main(int argc, char **argv)
 		{ "sign-pkg", no_argument, NULL, 'S'},
 		{ "hashcheck", no_argument, NULL, 'C' },
 		{ "compression", required_argument, NULL, 2},
+		{ "deltas", required_argument, NULL, 3},
+		{ "append", no_argument, NULL, 4},
+		{ "compact", no_argument, NULL, 5},
+		{ "compression-level", required_argument, NULL, 6},
+		{ "compression-threads", required_argument, NULL, 7},
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
 	const char *compression = NULL;
 	const char *privkey = NULL, *signedby = NULL;
+	unsigned int ndeltas = 0;
+	int complevel = 9, compthreads = -1;
+	char *end;
 	int rv, c, flags = 0;
-	bool add_mode, clean_mode, rm_mode, sign_mode, sign_pkg_mode, force,
-			 hashcheck;
+	bool add_mode, clean_mode, compact_mode, rm_mode, sign_mode,
+	     sign_pkg_mode, force, hashcheck, append;
 
-	add_mode = clean_mode = rm_mode = sign_mode = sign_pkg_mode = force =
-		hashcheck = false;
+	add_mode = clean_mode = compact_mode = rm_mode = sign_mode =
+		sign_pkg_mode = force = hashcheck = append = false;
 
 	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
 		switch (c) {
@@ -97,6 +111,37 @@ main(int argc, char **argv)
 		case 2:
 			compression = optarg;
 			break;
+		case 3:
+			errno = 0;
+			ndeltas = (unsigned int)strtoul(optarg, &end, 10);
+			if (errno != 0 || *optarg == '\0' || *end != '\0') {
+				fprintf(stderr, "Invalid number of deltas: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 4:
+			append = true;
+			break;
+		case 5:
+			compact_mode = true;
+			break;
+		case 6:
+			errno = 0;
+			complevel = (int)strtol(optarg, &end, 10);
+			if (errno != 0 || *optarg == '\0' || *end != '\0') {
+				fprintf(stderr, "Invalid compression level: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 7:
+			errno = 0;
+			compthreads = (int)strtol(optarg, &end, 10);
+			if (errno != 0 || *optarg == '\0' || *end != '\0' ||
+			    compthreads < 0) {
+				fprintf(stderr, "Invalid number of compression threads: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'a':
 			add_mode = true;
 			break;
@@ -137,19 +182,19 @@ main(int argc, char **argv)
 		}
 	}
 	if ((argc == optind) ||
-	    (!add_mode && !clean_mode && !rm_mode && !sign_mode && !sign_pkg_mode)) {
+	    (!add_mode && !clean_mode && !compact_mode && !rm_mode &&
+	     !sign_mode && !sign_pkg_mode)) {
 		usage(true);
 		/* NOTREACHED */
-	} else if ((add_mode && (clean_mode || rm_mode || sign_mode || sign_pkg_mode)) ||
-		   (clean_mode && (add_mode || rm_mode || sign_mode || sign_pkg_mode)) ||
-		   (rm_mode && (add_mode || clean_mode || sign_mode || sign_pkg_mode)) ||
-		   (sign_mode && (add_mode || clean_mode || rm_mode || sign_pkg_mode)) ||
-		   (sign_pkg_mode && (add_mode || clean_mode || rm_mode || sign_mode))) {
+	} else if (add_mode + clean_mode + compact_mode + rm_mode +
+		   sign_mode + sign_pkg_mode > 1) {
 		fprintf(stderr, "Only one mode can be specified: add, clean, "
-		    "remove-obsoletes, sign or sign-pkg.\n");
+		    "compact, remove-obsoletes, sign or sign-pkg.\n");
 		exit(EXIT_FAILURE);
 	}
 
+	repodata_set_compression(complevel, compthreads);
+
 	/* initialize libxbps */
 	memset(&xh, 0, sizeof(xh));
 	xh.flags = flags;
@@ -160,9 +205,13 @@ main(int argc, char **argv)
 	}
 
 	if (add_mode)
-		rv = index_add(&xh, optind, argc, argv, force, compression);
+		rv = index_add(&xh, optind, argc, argv, force, compression,
+		    ndeltas, append);
 	else if (clean_mode)
-		rv = index_clean(&xh, argv[optind], hashcheck, compression);
+		rv = index_clean(&xh, argv[optind], hashcheck, compression,
+		    append);
+	else if (compact_mode)
+		rv = index_compact(&xh, argv[optind], compression);
 	else if (rm_mode)
 		rv = remove_obsoletes(&xh, argv[optind]);
 	else if (sign_mode)
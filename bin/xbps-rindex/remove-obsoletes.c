@@ -108,10 +108,68 @@ cleaner_cb(struct xbps_handle *xhp, xbps_object_t obj, const char *key UNUSED, v
 	return 0;
 }
 
+/*
+ * Adds the file names of the binary deltas registered in \a idx
+ * to \a names.
+ */
+static void
+delta_names(xbps_dictionary_t idx, xbps_dictionary_t names)
+{
+	xbps_object_iterator_t iter, diter;
+	xbps_object_t keysym, dkeysym;
+	xbps_dictionary_t pkgd, deltas;
+	const char *pkgver, *arch;
+	char *name;
+
+	if ((iter = xbps_dictionary_iterator(idx)) == NULL)
+		return;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgd = xbps_dictionary_get_keysym(idx, keysym);
+		if ((deltas = xbps_dictionary_get(pkgd, "deltas")) == NULL)
+			continue;
+		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		xbps_dictionary_get_cstring_nocopy(pkgd, "architecture", &arch);
+		diter = xbps_dictionary_iterator(deltas);
+		while ((dkeysym = xbps_object_iterator_next(diter))) {
+			name = xbps_binpkg_delta_name(pkgver, arch,
+			    xbps_dictionary_keysym_cstring_nocopy(dkeysym));
+			if (name != NULL)
+				xbps_dictionary_set_bool(names, name, true);
+			free(name);
+		}
+		xbps_object_iterator_release(diter);
+	}
+	xbps_object_iterator_release(iter);
+}
+
+static int
+remove_deltas(struct xbps_repo *repo, struct xbps_repo *stage, xbps_array_t deltas)
+{
+	xbps_dictionary_t names;
+	const char *delta;
+	int rv;
+
+	if ((names = xbps_dictionary_create()) == NULL)
+		return ENOMEM;
+	delta_names(repo->idx, names);
+	if (stage)
+		delta_names(stage->idx, names);
+	for (unsigned int i = 0; i < xbps_array_count(deltas); i++) {
+		xbps_array_get_cstring_nocopy(deltas, i, &delta);
+		if (xbps_dictionary_get(names, delta))
+			continue;
+		if ((rv = remove_pkg(repo->uri, delta)) != 0)
+			continue;
+		printf("Removed obsolete delta `%s'.\n", delta);
+	}
+	xbps_object_release(names);
+	return 0;
+}
+
 int
 remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 {
-	xbps_array_t array = NULL;
+	xbps_array_t array = NULL, deltas = NULL;
 	struct xbps_repo *repos[2], *repo, *stage;
 	DIR *dirp;
 	struct dirent *dp;
@@ -145,6 +203,12 @@ remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 			continue;
 		if ((ext = strrchr(dp->d_name, '.')) == NULL)
 			continue;
+		if (strcmp(ext, ".xbpsd") == 0) {
+			if (deltas == NULL)
+				deltas = xbps_array_create();
+			xbps_array_add_cstring(deltas, dp->d_name);
+			continue;
+		}
 		if (strcmp(ext, ".xbps"))
 			continue;
 		if (array == NULL)
@@ -157,10 +221,14 @@ remove_obsoletes(struct xbps_handle *xhp, const char *repodir)
 	repos[0] = repo;
 	repos[1] = stage;
 	rv = xbps_array_foreach_cb_multi(xhp, array, NULL, cleaner_cb, repos);
+	if (rv == 0 && deltas != NULL)
+		rv = remove_deltas(repo, stage, deltas);
 out:
 	xbps_repo_release(repo);
 	xbps_repo_release(stage);
 	xbps_object_release(array);
+	if (deltas != NULL)
+		xbps_object_release(deltas);
 
 	return rv;
 }
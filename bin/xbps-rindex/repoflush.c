@@ -23,6 +23,10 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef HAVE_COPY_FILE_RANGE
+# define _GNU_SOURCE	/* for copy_file_range(2) */
+#endif
+
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -33,113 +37,408 @@
 #include <libgen.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 
 #include <xbps.h>
 #include "defs.h"
 
-bool
-repodata_flush(struct xbps_handle *xhp, const char *repodir,
-	const char *reponame, xbps_dictionary_t idx, xbps_dictionary_t meta,
-	const char *compression)
+static int
+repodata_mkstemp(const char *repofile, char **tname)
 {
-	struct archive *ar;
-	char *repofile, *tname, *buf;
-	int rv, repofd = -1;
 	mode_t mask;
-	bool result;
+	int fd;
 
-	/* Create a tempfile for our repository archive */
-	repofile = xbps_repo_path_with_name(xhp, repodir, reponame);
-	assert(repofile);
-	tname = xbps_xasprintf("%s.XXXXXXXXXX", repofile);
-	assert(tname);
+	*tname = xbps_xasprintf("%s.XXXXXXXXXX", repofile);
+	assert(*tname);
 	mask = umask(S_IXUSR|S_IRWXG|S_IRWXO);
-	if ((repofd = mkstemp(tname)) == -1)
-		return false;
-
+	fd = mkstemp(*tname);
 	umask(mask);
+	return fd;
+}
+
+/*
+ * Compression level and number of compression threads (-1 if unset).
+ */
+static int complevel = 9;
+static int compthreads = -1;
+
+void
+repodata_set_compression(int level, int threads)
+{
+	complevel = level;
+	compthreads = threads;
+}
+
+static struct archive *
+repodata_archive(int repofd, const char *compression)
+{
+	struct archive *ar;
+	char buf[16];
+	bool threads = false;
+
 	/* Create and write our repository archive */
 	ar = archive_write_new();
 	if (ar == NULL)
-		return false;
+		return NULL;
 
 	/*
 	 * Set compression format, zstd by default.
 	 */
 	if (compression == NULL || strcmp(compression, "zstd") == 0) {
+		compression = "zstd";
 		archive_write_add_filter_zstd(ar);
-		archive_write_set_options(ar, "compression-level=9");
+		threads = true;
 	} else if (strcmp(compression, "gzip") == 0) {
 		archive_write_add_filter_gzip(ar);
-		archive_write_set_options(ar, "compression-level=9");
 	} else if (strcmp(compression, "bzip2") == 0) {
 		archive_write_add_filter_bzip2(ar);
-		archive_write_set_options(ar, "compression-level=9");
 	} else if (strcmp(compression, "lz4") == 0) {
 		archive_write_add_filter_lz4(ar);
-		archive_write_set_options(ar, "compression-level=9");
 	} else if (strcmp(compression, "xz") == 0) {
 		archive_write_add_filter_xz(ar);
-		archive_write_set_options(ar, "compression-level=9");
-	} else if (strcmp(compression, "none") == 0) {
-		/* empty */
-	} else {
-		return false;
+		threads = true;
+	} else if (strcmp(compression, "none") != 0) {
+		archive_write_free(ar);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (strcmp(compression, "none") != 0) {
+		snprintf(buf, sizeof(buf), "%d", complevel);
+		if (archive_write_set_filter_option(ar, NULL,
+		    "compression-level", buf) != ARCHIVE_OK) {
+			fprintf(stderr, "xbps-rindex: invalid %s compression "
+			    "level %s\n", compression, buf);
+			archive_write_free(ar);
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+	/*
+	 * Only zstd and xz can compress with multiple threads,
+	 * 0 uses as many threads as online CPUs.
+	 */
+	if (threads && compthreads != -1) {
+		snprintf(buf, sizeof(buf), "%d", compthreads);
+		if (archive_write_set_filter_option(ar, NULL,
+		    "threads", buf) != ARCHIVE_OK) {
+			fprintf(stderr, "xbps-rindex: cannot use %s threads "
+			    "for %s compression: %s\n", buf, compression,
+			    archive_error_string(ar));
+			archive_write_free(ar);
+			errno = EINVAL;
+			return NULL;
+		}
 	}
 
 	archive_write_set_format_pax_restricted(ar);
-	if (archive_write_open_fd(ar, repofd) != ARCHIVE_OK)
-		return false;
+	if (archive_write_open_fd(ar, repofd) != ARCHIVE_OK) {
+		archive_write_free(ar);
+		return NULL;
+	}
+	return ar;
+}
 
-	/* XBPS_REPOIDX */
-	buf = xbps_dictionary_externalize(idx);
-	if (buf == NULL)
-		return false;
-	rv = xbps_archive_append_buf(ar, buf, strlen(buf),
-	    XBPS_REPOIDX, 0644, "root", "root");
-	free(buf);
-	if (rv != 0)
-		return false;
+static bool
+repodata_append_dict(struct archive *ar, xbps_dictionary_t d, const char *fname)
+{
+	char *buf;
+	int rv;
 
-	/* XBPS_REPOIDX_META */
-	if (meta == NULL) {
+	if (d == NULL) {
 		/* fake entry */
 		buf = strdup("DEADBEEF");
-		if (buf == NULL)
-			return false;
 	} else {
-		buf = xbps_dictionary_externalize(meta);
+		buf = xbps_dictionary_externalize(d);
 	}
+	if (buf == NULL)
+		return false;
 	rv = xbps_archive_append_buf(ar, buf, strlen(buf),
-	    XBPS_REPOIDX_META, 0644, "root", "root");
+	    fname, 0644, "root", "root");
 	free(buf);
-	if (rv != 0)
+	if (rv != 0) {
+		errno = rv;
 		return false;
+	}
+	return true;
+}
 
+/*
+ * Closes the archive written to the temporary file and renames it
+ * to the repository archive.
+ */
+static bool
+repodata_close(struct xbps_handle *xhp, const char *repodir,
+	struct archive *ar, int repofd, const char *tname, const char *repofile)
+{
 	/* Write data to tempfile and rename */
-	if (archive_write_close(ar) != ARCHIVE_OK)
-		return false;
+	if (archive_write_close(ar) != ARCHIVE_OK) {
+		archive_write_free(ar);
+		goto fail;
+	}
 	if (archive_write_free(ar) != ARCHIVE_OK)
-		return false;
+		goto fail;
+	if (!(xhp->flags & XBPS_FLAG_DURABILITY_NONE)) {
 #ifdef HAVE_FDATASYNC
-	fdatasync(repofd);
+		fdatasync(repofd);
 #else
-	fsync(repofd);
+		fsync(repofd);
 #endif
-	if (fchmod(repofd, 0664) == -1) {
+	}
+	if (fchmod(repofd, 0664) == -1)
+		goto fail;
+	close(repofd);
+	if (rename(tname, repofile) == -1) {
+		unlink(tname);
+		return false;
+	}
+	if (xhp->flags & XBPS_FLAG_DURABILITY_STRICT) {
+		int dirfd;
+
+		if ((dirfd = open(repodir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) != -1) {
+			(void)fsync(dirfd);
+			(void)close(dirfd);
+		}
+	}
+	return true;
+fail:
+	close(repofd);
+	unlink(tname);
+	return false;
+}
+
+bool
+repodata_flush(struct xbps_handle *xhp, const char *repodir,
+	const char *reponame, xbps_dictionary_t idx, xbps_dictionary_t meta,
+	const char *compression)
+{
+	struct archive *ar;
+	char *repofile, *tname = NULL;
+	int repofd;
+	bool result = false;
+
+	/* Create a tempfile for our repository archive */
+	repofile = xbps_repo_path_with_name(xhp, repodir, reponame);
+	assert(repofile);
+	if ((repofd = repodata_mkstemp(repofile, &tname)) == -1)
+		goto out;
+
+	if ((ar = repodata_archive(repofd, compression)) == NULL) {
 		close(repofd);
 		unlink(tname);
-		result = false;
 		goto out;
 	}
-	close(repofd);
-	if (rename(tname, repofile) == -1) {
+	/* XBPS_REPOIDX and XBPS_REPOIDX_META */
+	if (!repodata_append_dict(ar, idx, XBPS_REPOIDX) ||
+	    !repodata_append_dict(ar, meta, XBPS_REPOIDX_META)) {
+		archive_write_free(ar);
+		close(repofd);
+		unlink(tname);
+		goto out;
+	}
+	result = repodata_close(xhp, repodir, ar, repofd, tname, repofile);
+out:
+	free(repofile);
+	free(tname);
+
+	return result;
+}
+
+/*
+ * Returns the compression format of the repository archive in fd,
+ * or NULL if unknown.
+ */
+static const char *
+repodata_compression(int fd)
+{
+	struct archive *ar;
+	struct archive_entry *entry;
+	const char *compression = NULL;
+
+	if ((ar = archive_read_new()) == NULL)
+		return NULL;
+	archive_read_support_filter_gzip(ar);
+	archive_read_support_filter_bzip2(ar);
+	archive_read_support_filter_xz(ar);
+	archive_read_support_filter_lz4(ar);
+	archive_read_support_filter_zstd(ar);
+	archive_read_support_format_tar(ar);
+	if (archive_read_open_fd(ar, fd, 4096) == ARCHIVE_OK &&
+	    archive_read_next_header(ar, &entry) == ARCHIVE_OK) {
+		switch (archive_filter_code(ar, 0)) {
+		case ARCHIVE_FILTER_NONE:
+			compression = "none";
+			break;
+		case ARCHIVE_FILTER_GZIP:
+			compression = "gzip";
+			break;
+		case ARCHIVE_FILTER_BZIP2:
+			compression = "bzip2";
+			break;
+		case ARCHIVE_FILTER_XZ:
+			compression = "xz";
+			break;
+		case ARCHIVE_FILTER_LZ4:
+			compression = "lz4";
+			break;
+		case ARCHIVE_FILTER_ZSTD:
+			compression = "zstd";
+			break;
+		}
+	}
+	archive_read_free(ar);
+	return compression;
+}
+
+static bool
+repodata_copy(int srcfd, int fd)
+{
+	char buf[65536];
+	ssize_t rd, wr;
+
+	if (lseek(srcfd, 0, SEEK_SET) == -1)
+		return false;
+#ifdef HAVE_COPY_FILE_RANGE
+	/* done by the kernel, or shares the data blocks if supported */
+	while ((rd = copy_file_range(srcfd, NULL, fd, NULL, SSIZE_MAX, 0)) > 0)
+		;
+	if (rd == 0)
+		return true;
+	if (errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP &&
+	    errno != EINVAL)
+		return false;
+	/* not supported, copy the rest */
+#endif
+	while ((rd = read(srcfd, buf, sizeof(buf))) != 0) {
+		if (rd == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		for (ssize_t off = 0; off < rd; off += wr) {
+			if ((wr = write(fd, buf + off, rd - off)) == -1) {
+				if (errno == EINTR) {
+					wr = 0;
+					continue;
+				}
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Returns the index segment with the changes from oldidx to idx,
+ * or NULL if there are no changes.
+ */
+static xbps_dictionary_t
+repodata_segment(xbps_dictionary_t oldidx, xbps_dictionary_t idx)
+{
+	xbps_dictionary_t seg, pkgs;
+	xbps_array_t removed;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym, obj;
+	const char *pkgname;
+
+	seg = xbps_dictionary_create();
+	pkgs = xbps_dictionary_create();
+	removed = xbps_array_create();
+	assert(seg && pkgs && removed);
+
+	iter = xbps_dictionary_iterator(idx);
+	assert(iter);
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		obj = xbps_dictionary_get_keysym(idx, keysym);
+		if (!xbps_dictionary_equals(xbps_dictionary_get(oldidx, pkgname), obj))
+			xbps_dictionary_set(pkgs, pkgname, obj);
+	}
+	xbps_object_iterator_release(iter);
+
+	iter = xbps_dictionary_iterator(oldidx);
+	assert(iter);
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		if (xbps_dictionary_get(idx, pkgname) == NULL)
+			xbps_array_add_cstring(removed, pkgname);
+	}
+	xbps_object_iterator_release(iter);
+
+	if (xbps_dictionary_count(pkgs) == 0 && xbps_array_count(removed) == 0) {
+		xbps_object_release(seg);
+		seg = NULL;
+	} else {
+		xbps_dictionary_set(seg, "packages", pkgs);
+		xbps_dictionary_set(seg, "removed", removed);
+	}
+	xbps_object_release(pkgs);
+	xbps_object_release(removed);
+	return seg;
+}
+
+/*
+ * Appends the changes from oldidx (the index in the repository archive)
+ * to idx as an index segment, compressed as the archive, rather than
+ * writing the whole index again. The archive is still replaced by a
+ * copy, to be atomic for readers.
+ *
+ * The whole archive is written if there's none or its compression
+ * format is unknown.
+ */
+bool
+repodata_append(struct xbps_handle *xhp, const char *repodir,
+	const char *reponame, xbps_dictionary_t oldidx, xbps_dictionary_t idx,
+	xbps_dictionary_t meta, const char *compression)
+{
+	struct archive *ar;
+	xbps_dictionary_t seg;
+	const char *segcompression;
+	char *repofile, *tname = NULL;
+	int srcfd, repofd = -1;
+	bool result = false;
+
+	if (oldidx == NULL)
+		return repodata_flush(xhp, repodir, reponame, idx, meta, compression);
+
+	repofile = xbps_repo_path_with_name(xhp, repodir, reponame);
+	assert(repofile);
+	if ((srcfd = open(repofile, O_RDONLY|O_CLOEXEC)) == -1) {
+		free(repofile);
+		if (errno != ENOENT)
+			return false;
+		return repodata_flush(xhp, repodir, reponame, idx, meta, compression);
+	}
+	if ((segcompression = repodata_compression(srcfd)) == NULL) {
+		close(srcfd);
+		free(repofile);
+		return repodata_flush(xhp, repodir, reponame, idx, meta, compression);
+	}
+	if ((seg = repodata_segment(oldidx, idx)) == NULL) {
+		/* nothing changed */
+		result = true;
+		goto out;
+	}
+	if ((repofd = repodata_mkstemp(repofile, &tname)) == -1)
+		goto out;
+	if (!repodata_copy(srcfd, repofd) ||
+	    (ar = repodata_archive(repofd, segcompression)) == NULL) {
+		close(repofd);
+		unlink(tname);
+		goto out;
+	}
+	if (!repodata_append_dict(ar, seg, XBPS_REPOIDX_SEGMENT)) {
+		archive_write_free(ar);
+		close(repofd);
 		unlink(tname);
-		result = false;
 		goto out;
 	}
-	result = true;
+	result = repodata_close(xhp, repodir, ar, repofd, tname, repofile);
 out:
+	if (seg != NULL)
+		xbps_object_release(seg);
+	close(srcfd);
 	free(repofile);
 	free(tname);
 
@@ -230,7 +230,8 @@ sign_repo(struct xbps_handle *xhp, const char *repodir,
 	flush_failed = repodata_flush(xhp, repodir, "repodata", repo->idx, meta, compression);
 	xbps_repo_unlock(rlockfd, rlockfname);
 	if (!flush_failed) {
-		fprintf(stderr, "failed to write repodata: %s\n", strerror(errno));
+		rv = errno;
+		fprintf(stderr, "failed to write repodata: %s\n", strerror(rv));
 		goto out;
 	}
 	printf("Initialized signed repository (%u package%s)\n",
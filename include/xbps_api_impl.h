@@ -51,6 +51,8 @@
 			ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM | \
 			ARCHIVE_EXTRACT_UNLINK
 #define FEXTRACT_FLAGS	ARCHIVE_EXTRACT_OWNER | EXTRACT_FLAGS
+/* the process umask while packages are unpacked */
+#define UNPACK_UMASK	022
 
 #ifndef __UNCONST
 #define __UNCONST(a)	((void *)(uintptr_t)(const void *)(a))
@@ -111,8 +113,9 @@ bool HIDDEN xbps_remove_pkg_from_array_by_pattern(xbps_array_t, const char *);
 bool HIDDEN xbps_remove_pkg_from_array_by_pkgver(xbps_array_t, const char *);
 void HIDDEN xbps_fetch_set_cache_connection(int, int);
 void HIDDEN xbps_fetch_unset_cache_connection(void);
+void HIDDEN xbps_fetch_prewarm_wait(struct xbps_handle *);
+void HIDDEN xbps_fetch_end(struct xbps_handle *);
 int HIDDEN xbps_cb_message(struct xbps_handle *, xbps_dictionary_t, const char *);
-int HIDDEN xbps_entry_is_a_conf_file(xbps_dictionary_t, const char *);
 int HIDDEN xbps_entry_install_conf_file(struct xbps_handle *, xbps_dictionary_t,
 		xbps_dictionary_t, struct archive_entry *, const char *,
 		const char *, bool);
@@ -141,24 +144,94 @@ int HIDDEN xbps_transaction_pkg_deps(struct xbps_handle *, xbps_array_t, xbps_di
 
 char HIDDEN *xbps_get_remote_repo_string(const char *);
 int HIDDEN xbps_repo_sync(struct xbps_handle *, const char *);
-int HIDDEN xbps_file_hash_check_dictionary(struct xbps_handle *,
-		xbps_dictionary_t, const char *, const char *);
+bool HIDDEN xbps_repo_merge_segment(xbps_dictionary_t, xbps_dictionary_t);
+xbps_array_t HIDDEN xbps_repo_mirrors(struct xbps_handle *, const char *);
+void HIDDEN xbps_repo_mirror_failed(struct xbps_handle *, const char *);
+void HIDDEN xbps_repo_mirror_update(struct xbps_handle *, const char *,
+		uint64_t, uint64_t);
+void HIDDEN xbps_repo_mirrors_save(struct xbps_handle *);
+int HIDDEN xbps_repo_mirrors_init(struct xbps_handle *);
+void HIDDEN xbps_repo_mirrors_release(struct xbps_handle *);
+uint64_t HIDDEN xbps_usecs_since(const struct timespec *);
+int HIDDEN xbps_file_hash_check(struct xbps_handle *, const char *,
+		const char *);
+bool HIDDEN xbps_sha256_digest_compare(const char *, size_t,
+		const unsigned char *, size_t);
+int HIDDEN xbps_file_hash_cache_set(const char *, const unsigned char *);
 int HIDDEN xbps_file_exec(struct xbps_handle *, const char *, ...);
 void HIDDEN xbps_set_cb_fetch(struct xbps_handle *, off_t, off_t, off_t,
 		const char *, bool, bool, bool);
+void HIDDEN xbps_set_cb_unpack(struct xbps_handle *,
+		struct xbps_unpack_cb_data *);
 int HIDDEN xbps_set_cb_state(struct xbps_handle *, xbps_state_t, int,
 		const char *, const char *, ...);
 int HIDDEN xbps_unpack_binary_pkg(struct xbps_handle *, xbps_dictionary_t);
+int HIDDEN xbps_unpack_alternatives(struct xbps_handle *, xbps_dictionary_t);
 int HIDDEN xbps_remove_pkg(struct xbps_handle *, const char *, bool);
 int HIDDEN xbps_register_pkg(struct xbps_handle *, xbps_dictionary_t);
 char HIDDEN *xbps_archive_get_file(struct archive *, struct archive_entry *);
 xbps_dictionary_t HIDDEN xbps_archive_get_dictionary(struct archive *,
 		struct archive_entry *);
+int HIDDEN xbps_archive_read_open_fd(struct xbps_handle *, struct archive *,
+		int, const struct stat *);
+int HIDDEN xbps_archive_read_index(int, off_t, uint64_t *);
+struct xbps_matcher HIDDEN *xbps_matcher_new(xbps_array_t, bool);
+bool HIDDEN xbps_matcher_match(const struct xbps_matcher *, const char *);
+void HIDDEN xbps_matcher_free(struct xbps_matcher *);
+int HIDDEN xbps_archive_read_open_metadata(struct archive *, int, bool);
 const char HIDDEN *vpkg_user_conf(struct xbps_handle *, const char *, bool);
 xbps_array_t HIDDEN xbps_get_pkg_fulldeptree(struct xbps_handle *,
 		const char *, bool);
 struct xbps_repo HIDDEN *xbps_regget_repo(struct xbps_handle *,
 		const char *);
 int HIDDEN xbps_conf_init(struct xbps_handle *);
+bool HIDDEN xbps_durability_sync(struct xbps_handle *, bool);
+int HIDDEN xbps_fsync_dir(const char *);
+int HIDDEN xbps_fsync_file(const char *);
+int HIDDEN xbps_syncfs(struct xbps_handle *);
+bool HIDDEN xbps_dictionary_externalize_sync(struct xbps_handle *,
+		xbps_dictionary_t, const char *, bool);
+
+/* transaction_unpack.c */
+struct xbps_unpack_job;
+
+int HIDDEN xbps_transaction_unpack(struct xbps_handle *, xbps_array_t);
+int HIDDEN xbps_transaction_configure(struct xbps_handle *, xbps_array_t);
+int HIDDEN xbps_unpack_job_wait(struct xbps_unpack_job *, bool);
+void HIDDEN xbps_unpack_job_ready(struct xbps_unpack_job *);
+int HIDDEN xbps_unpack_binary_pkg_job(struct xbps_handle *, xbps_dictionary_t,
+		struct xbps_unpack_job *);
+
+/* filestore.c */
+int HIDDEN xbps_filestore_get(struct xbps_handle *, struct archive *,
+		struct archive_entry *, const char *, unsigned char *);
+int HIDDEN xbps_filestore_put(struct xbps_handle *, const char *,
+		const char *);
+
+#ifdef HAVE_IO_URING
+/* uring.c */
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct xbps_uring {
+	int fd;
+	unsigned sq_entries;
+	unsigned sqe_tail;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_sz, cq_sz, sqes_sz;
+};
+
+int HIDDEN xbps_uring_init(struct xbps_uring *, unsigned, const uint8_t *,
+		size_t);
+void HIDDEN xbps_uring_fini(struct xbps_uring *);
+void HIDDEN xbps_uring_set_max_workers(struct xbps_uring *, unsigned);
+struct io_uring_sqe HIDDEN *xbps_uring_get_sqe(struct xbps_uring *);
+int HIDDEN xbps_uring_submit(struct xbps_uring *);
+int HIDDEN xbps_uring_wait_cqe(struct xbps_uring *, struct io_uring_cqe *);
+#endif
 
 #endif /* !_XBPS_API_IMPL_H_ */
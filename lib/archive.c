@@ -23,11 +23,14 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "xbps_api_impl.h"
 
@@ -109,3 +112,167 @@ xbps_archive_append_buf(struct archive *ar, const void *buf, const size_t buflen
 
 	return 0;
 }
+
+/*
+ * Binary packages with a seekable layout start with a compressed frame
+ * that only contains the metadata entries, and end with a zstd skippable
+ * frame (ignored by decompressors) that records its size:
+ *
+ *	uint32_t	skippable frame magic
+ *	uint32_t	skippable frame size
+ *	char[8]		"XBPSIDX1"
+ *	uint64_t	compressed size of the metadata frame
+ *	uint64_t	uncompressed size of the metadata frame
+ *
+ * All integers are little endian.
+ */
+#define PKGINDEX_MAGIC		0x184D2A5BU
+#define PKGINDEX_ID		"XBPSIDX1"
+#define PKGINDEX_SIZE		32
+
+static void
+le32enc(unsigned char *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void
+le64enc(unsigned char *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint32_t
+le32dec(const unsigned char *p)
+{
+	uint32_t v = 0;
+
+	for (int i = 3; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static uint64_t
+le64dec(const unsigned char *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+int
+xbps_archive_write_index(int fd, uint64_t metasize, uint64_t metausize)
+{
+	unsigned char buf[PKGINDEX_SIZE];
+
+	le32enc(buf, PKGINDEX_MAGIC);
+	le32enc(buf + 4, PKGINDEX_SIZE - 8);
+	memcpy(buf + 8, PKGINDEX_ID, 8);
+	le64enc(buf + 16, metasize);
+	le64enc(buf + 24, metausize);
+
+	if (write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+		return errno ? errno : EIO;
+
+	return 0;
+}
+
+int HIDDEN
+xbps_archive_read_index(int fd, off_t size, uint64_t *metasize)
+{
+	unsigned char buf[PKGINDEX_SIZE];
+	ssize_t rd;
+
+	if (size < PKGINDEX_SIZE)
+		return ENOENT;
+
+	rd = pread(fd, buf, sizeof(buf), size - PKGINDEX_SIZE);
+	if (rd == -1)
+		return errno;
+	if (rd != (ssize_t)sizeof(buf) ||
+	    le32dec(buf) != PKGINDEX_MAGIC ||
+	    le32dec(buf + 4) != PKGINDEX_SIZE - 8 ||
+	    memcmp(buf + 8, PKGINDEX_ID, 8))
+		return ENOENT;
+
+	*metasize = le64dec(buf + 16);
+	if (*metasize == 0 || *metasize > (uint64_t)(size - PKGINDEX_SIZE))
+		return ENOENT;
+
+	return 0;
+}
+
+struct metadata_reader {
+	int fd;
+	bool closefd;
+	off_t off, end;
+	char buf[32768];
+};
+
+static ssize_t
+metadata_read_cb(struct archive *ar, void *arg, const void **buf)
+{
+	struct metadata_reader *r = arg;
+	size_t len = sizeof(r->buf);
+	ssize_t rd;
+
+	if (r->off >= r->end)
+		return 0;
+	if ((off_t)len > r->end - r->off)
+		len = r->end - r->off;
+
+	if ((rd = pread(r->fd, r->buf, len, r->off)) == -1) {
+		archive_set_error(ar, errno, "%s", strerror(errno));
+		return -1;
+	}
+	r->off += rd;
+	*buf = r->buf;
+
+	return rd;
+}
+
+static int
+metadata_close_cb(struct archive *ar UNUSED, void *arg)
+{
+	struct metadata_reader *r = arg;
+
+	if (r->closefd)
+		close(r->fd);
+	free(r);
+
+	return ARCHIVE_OK;
+}
+
+int HIDDEN
+xbps_archive_read_open_metadata(struct archive *ar, int fd, bool closefd)
+{
+	struct metadata_reader *r;
+	struct stat st;
+	uint64_t metasize;
+
+	if (fstat(fd, &st) == -1 || (r = malloc(sizeof(*r))) == NULL) {
+		archive_set_error(ar, errno, "%s", strerror(errno));
+		if (closefd)
+			close(fd);
+		return ARCHIVE_FATAL;
+	}
+	r->fd = fd;
+	r->closefd = closefd;
+	r->off = 0;
+	/*
+	 * Packages without an index are read until the caller
+	 * finds the metadata entries.
+	 */
+	if (xbps_archive_read_index(fd, st.st_size, &metasize) == 0)
+		r->end = (off_t)metasize;
+	else
+		r->end = st.st_size;
+
+	/* the close callback is called by libarchive even on failure */
+	return archive_read_open(ar, r, NULL, metadata_read_cb,
+	    metadata_close_cb);
+}
@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Decompression of large binary packages in a separate thread.
+ *
+ * The decompressor reads the package with the "raw" format and fills
+ * a ring of buffers with the tar stream, the caller's archive parses
+ * it from the ring, so decompression overlaps with tar parsing and
+ * file extraction.
+ */
+#define PIPE_SLOTS	4
+#define PIPE_SLOTSIZE	(1024 * 1024)
+#define PIPE_MINSIZE	(8 * 1024 * 1024)
+
+struct archive_pipe {
+	struct xbps_handle *xhp;
+	struct archive *dec;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *buf[PIPE_SLOTS];
+	ssize_t len[PIPE_SLOTS];
+	/* filled and released slots, counters */
+	unsigned int head, tail;
+	bool current, eof, stop;
+	int error;
+	char *errstr;
+};
+
+static ssize_t
+pipe_fill(struct archive_pipe *p, char *buf)
+{
+	ssize_t rd, len = 0;
+
+	while (len < PIPE_SLOTSIZE) {
+		rd = archive_read_data(p->dec, buf + len, PIPE_SLOTSIZE - len);
+		if (rd < 0)
+			return -1;
+		if (rd == 0)
+			break;
+		len += rd;
+	}
+	return len;
+}
+
+static void *
+pipe_thread(void *arg)
+{
+	struct archive_pipe *p = arg;
+	ssize_t len;
+	char *buf;
+
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (!p->stop && p->head - p->tail == PIPE_SLOTS)
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->stop) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		buf = p->buf[p->head % PIPE_SLOTS];
+		pthread_mutex_unlock(&p->lock);
+
+		len = pipe_fill(p, buf);
+
+		pthread_mutex_lock(&p->lock);
+		if (len == -1) {
+			p->error = archive_errno(p->dec);
+			if (p->error == 0)
+				p->error = EIO;
+			if (archive_error_string(p->dec))
+				p->errstr = strdup(archive_error_string(p->dec));
+		} else if (len == 0) {
+			p->eof = true;
+		} else {
+			p->len[p->head % PIPE_SLOTS] = len;
+			p->head++;
+		}
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+		if (len <= 0)
+			break;
+	}
+	return NULL;
+}
+
+static ssize_t
+pipe_read_cb(struct archive *ar, void *arg, const void **buf)
+{
+	struct archive_pipe *p = arg;
+	ssize_t len = 0;
+
+	pthread_mutex_lock(&p->lock);
+	/* the previous block is not used by libarchive anymore */
+	if (p->current) {
+		p->tail++;
+		p->current = false;
+		pthread_cond_broadcast(&p->cond);
+	}
+	while (p->head == p->tail && !p->eof && !p->error)
+		pthread_cond_wait(&p->cond, &p->lock);
+	if (p->head != p->tail) {
+		*buf = p->buf[p->tail % PIPE_SLOTS];
+		len = p->len[p->tail % PIPE_SLOTS];
+		p->current = true;
+	} else if (p->error) {
+		archive_set_error(ar, p->error, "%s",
+		    p->errstr ? p->errstr : strerror(p->error));
+		len = -1;
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return len;
+}
+
+static void
+pipe_free(struct archive_pipe *p)
+{
+	for (unsigned int i = 0; i < PIPE_SLOTS; i++)
+		free(p->buf[i]);
+	if (p->dec)
+		archive_read_free(p->dec);
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+	free(p->errstr);
+	free(p);
+}
+
+static int
+pipe_close_cb(struct archive *ar UNUSED, void *arg)
+{
+	struct archive_pipe *p = arg;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+
+	xbps_dbg_printf(p->xhp, "[archive] decompressed %u blocks in "
+	    "a separate thread\n", p->head);
+	pipe_free(p);
+
+	return ARCHIVE_OK;
+}
+
+static struct archive_pipe *
+pipe_new(struct xbps_handle *xhp, int fd, const struct stat *st)
+{
+	struct archive_pipe *p;
+	struct archive_entry *entry;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return NULL;
+	p->xhp = xhp;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	for (unsigned int i = 0; i < PIPE_SLOTS; i++) {
+		if ((p->buf[i] = malloc(PIPE_SLOTSIZE)) == NULL)
+			goto fail;
+	}
+	if ((p->dec = archive_read_new()) == NULL)
+		goto fail;
+	archive_read_support_filter_gzip(p->dec);
+	archive_read_support_filter_bzip2(p->dec);
+	archive_read_support_filter_xz(p->dec);
+	archive_read_support_filter_lz4(p->dec);
+	archive_read_support_filter_zstd(p->dec);
+	archive_read_support_format_raw(p->dec);
+
+	if (archive_read_open_fd(p->dec, fd, st->st_blksize) != ARCHIVE_OK ||
+	    archive_read_next_header(p->dec, &entry) != ARCHIVE_OK)
+		goto fail;
+	if (pthread_create(&p->thread, NULL, pipe_thread, p) != 0)
+		goto fail;
+
+	return p;
+fail:
+	pipe_free(p);
+	return NULL;
+}
+
+int HIDDEN
+xbps_archive_read_open_fd(struct xbps_handle *xhp, struct archive *ar,
+		int fd, const struct stat *st)
+{
+	struct archive_pipe *p;
+
+	/*
+	 * Not worth a thread for small packages or without
+	 * another CPU to run it.
+	 */
+	if (st->st_size < PIPE_MINSIZE || sysconf(_SC_NPROCESSORS_ONLN) <= 1)
+		return archive_read_open_fd(ar, fd, st->st_blksize);
+
+	if ((p = pipe_new(xhp, fd, st)) == NULL) {
+		if (lseek(fd, 0, SEEK_SET) == -1) {
+			archive_set_error(ar, errno, "%s", strerror(errno));
+			return ARCHIVE_FATAL;
+		}
+		return archive_read_open_fd(ar, fd, st->st_blksize);
+	}
+
+	/* the close callback is called by libarchive even on failure */
+	return archive_read_open(ar, p, NULL, pipe_read_cb, pipe_close_cb);
+}
@@ -33,9 +33,28 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 
+/*
+ * Client callbacks are serialized, packages may be unpacked in parallel.
+ * The lock is recursive, callbacks may call back into the library.
+ */
+static pthread_mutex_t cb_lock;
+static pthread_once_t cb_lock_once = PTHREAD_ONCE_INIT;
+
+static void
+cb_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&cb_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wformat-nonliteral"
 #endif
@@ -95,9 +114,24 @@ xbps_set_cb_state(struct xbps_handle *xhp,
 		else
 			xscd.desc = buf;
 	}
+	pthread_once(&cb_lock_once, cb_lock_init);
+	pthread_mutex_lock(&cb_lock);
 	retval = (*xhp->state_cb)(&xscd, xhp->state_cb_data);
+	pthread_mutex_unlock(&cb_lock);
 	if (buf != NULL)
 		free(buf);
 
 	return retval;
 }
+
+void HIDDEN
+xbps_set_cb_unpack(struct xbps_handle *xhp, struct xbps_unpack_cb_data *xucd)
+{
+	if (xhp->unpack_cb == NULL)
+		return;
+
+	pthread_once(&cb_lock_once, cb_lock_init);
+	pthread_mutex_lock(&cb_lock);
+	(*xhp->unpack_cb)(xucd, xhp->unpack_cb_data);
+	pthread_mutex_unlock(&cb_lock);
+}
@@ -134,6 +134,44 @@ store_repo(struct xbps_handle *xhp, const char *repo)
 	return xbps_repo_store(xhp, repo);
 }
 
+static void
+store_mirror(struct xbps_handle *xhp, const char *path, size_t line, char *buf)
+{
+	xbps_array_t mirrors;
+	char *repo, *url, *saveptr = NULL;
+
+	/*
+	 * Parse blank separated urls i.e
+	 * 	<repository> <mirror> [<mirror> ...]
+	 */
+	repo = strtok_r(buf, " \t", &saveptr);
+	if (repo == NULL || !xbps_repository_is_remote(repo)) {
+		xbps_dbg_printf(xhp, "%s: ignoring invalid "
+		    "mirror option at line %zu\n", path, line);
+		return;
+	}
+	if (xhp->mirrors == NULL) {
+		xhp->mirrors = xbps_dictionary_create();
+		assert(xhp->mirrors);
+	}
+	if ((mirrors = xbps_dictionary_get(xhp->mirrors, repo)) == NULL) {
+		mirrors = xbps_array_create();
+		assert(mirrors);
+		xbps_dictionary_set(xhp->mirrors, repo, mirrors);
+		xbps_object_release(mirrors);
+	}
+	while ((url = strtok_r(NULL, " \t", &saveptr)) != NULL) {
+		/* local copies of the repository are also mirrors */
+		if ((!xbps_repository_is_remote(url) &&
+		    strncmp(url, "file://", 7) != 0) ||
+		    strcmp(url, repo) == 0 ||
+		    xbps_match_string_in_array(mirrors, url))
+			continue;
+		xbps_array_add_cstring(mirrors, url);
+		xbps_dbg_printf(xhp, "%s: added mirror %s for %s\n", path, url, repo);
+	}
+}
+
 static void
 store_ignored_pkg(struct xbps_handle *xhp, const char *pkgname)
 {
@@ -172,6 +210,18 @@ enum {
 	KEY_SYSLOG,
 	KEY_VIRTUALPKG,
 	KEY_KEEPCONF,
+	KEY_STATCHECK,
+	KEY_DURABILITY,
+	KEY_IOURING,
+	KEY_FILESTORE,
+	KEY_PARALLELCONFIGURE,
+	KEY_PARALLELUNPACK,
+	KEY_HASHCACHE,
+	KEY_PREWARM,
+	KEY_PARALLELFETCH,
+	KEY_MIRROR,
+	KEY_DELTAS,
+	KEY_ZEROCOPY,
 };
 
 static const struct key {
@@ -182,15 +232,27 @@ static const struct key {
 	{ "architecture", 12, KEY_ARCHITECTURE },
 	{ "bestmatching", 12, KEY_BESTMATCHING },
 	{ "cachedir",      8, KEY_CACHEDIR },
+	{ "deltas",        6, KEY_DELTAS },
+	{ "durability",   10, KEY_DURABILITY },
+	{ "filestore",     9, KEY_FILESTORE },
 	{ "ignorepkg",     9, KEY_IGNOREPKG },
 	{ "include",       7, KEY_INCLUDE },
+	{ "iouring",       7, KEY_IOURING },
+	{ "mirror",        6, KEY_MIRROR },
 	{ "noextract",     9, KEY_NOEXTRACT },
+	{ "parallelconfigure", 17, KEY_PARALLELCONFIGURE },
+	{ "parallelfetch", 13, KEY_PARALLELFETCH },
+	{ "parallelunpack", 14, KEY_PARALLELUNPACK },
 	{ "preserve",      8, KEY_PRESERVE },
 	{ "repository",   10, KEY_REPOSITORY },
 	{ "rootdir",       7, KEY_ROOTDIR },
 	{ "syslog",        6, KEY_SYSLOG },
 	{ "virtualpkg",   10, KEY_VIRTUALPKG },
 	{ "keepconf",      8, KEY_KEEPCONF },
+	{ "statcheck",     9, KEY_STATCHECK },
+	{ "hashcache",     9, KEY_HASHCACHE },
+	{ "prewarm",       7, KEY_PREWARM },
+	{ "zerocopy",      8, KEY_ZEROCOPY },
 };
 
 static int
@@ -367,6 +429,117 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 				xbps_dbg_printf(xhp, "%s: config preservation disabled\n", path);
 			}
 			break;
+		case KEY_STATCHECK:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_STATCHECK;
+				xbps_dbg_printf(xhp, "%s: stat file checking enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_STATCHECK;
+				xbps_dbg_printf(xhp, "%s: stat file checking disabled\n", path);
+			}
+			break;
+		case KEY_HASHCACHE:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_HASH_CACHE;
+				xbps_dbg_printf(xhp, "%s: SHA256 hash cache enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_HASH_CACHE;
+				xbps_dbg_printf(xhp, "%s: SHA256 hash cache disabled\n", path);
+			}
+			break;
+		case KEY_PREWARM:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_FETCH_PREWARM;
+				xbps_dbg_printf(xhp, "%s: connection pre-warming enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_FETCH_PREWARM;
+				xbps_dbg_printf(xhp, "%s: connection pre-warming disabled\n", path);
+			}
+			break;
+		case KEY_IOURING:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_UNPACK_IOURING;
+				xbps_dbg_printf(xhp, "%s: io_uring file writer enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_UNPACK_IOURING;
+				xbps_dbg_printf(xhp, "%s: io_uring file writer disabled\n", path);
+			}
+			break;
+		case KEY_PARALLELCONFIGURE:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_CONFIGURE_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel configure enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_CONFIGURE_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel configure disabled\n", path);
+			}
+			break;
+		case KEY_PARALLELFETCH:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_FETCH_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel range downloads enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_FETCH_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel range downloads disabled\n", path);
+			}
+			break;
+		case KEY_DELTAS:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_FETCH_DELTAS;
+				xbps_dbg_printf(xhp, "%s: binary package deltas enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_FETCH_DELTAS;
+				xbps_dbg_printf(xhp, "%s: binary package deltas disabled\n", path);
+			}
+			break;
+		case KEY_ZEROCOPY:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_FETCH_ZEROCOPY;
+				xbps_dbg_printf(xhp, "%s: zero-copy downloads enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_FETCH_ZEROCOPY;
+				xbps_dbg_printf(xhp, "%s: zero-copy downloads disabled\n", path);
+			}
+			break;
+		case KEY_PARALLELUNPACK:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_UNPACK_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel unpack enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_UNPACK_PARALLEL;
+				xbps_dbg_printf(xhp, "%s: parallel unpack disabled\n", path);
+			}
+			break;
+		case KEY_FILESTORE:
+			xhp->flags &= ~XBPS_FLAG_FILESTORE_MASK;
+			if (strcasecmp(val, "reflink") == 0) {
+				xhp->flags |= XBPS_FLAG_FILESTORE_REFLINK;
+			} else if (strcasecmp(val, "hardlink") == 0) {
+				xhp->flags |= XBPS_FLAG_FILESTORE_HARDLINK;
+			} else if (strcasecmp(val, "none") != 0) {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid "
+				    "file store mode %s at line %zu\n", path,
+				    val, nlines);
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: file store set to %s\n", path, val);
+			break;
+		case KEY_DURABILITY:
+			xhp->flags &= ~XBPS_FLAG_DURABILITY_MASK;
+			if (strcasecmp(val, "none") == 0) {
+				xhp->flags |= XBPS_FLAG_DURABILITY_NONE;
+			} else if (strcasecmp(val, "transaction") == 0) {
+				xhp->flags |= XBPS_FLAG_DURABILITY_TRANSACTION;
+			} else if (strcasecmp(val, "strict") == 0) {
+				xhp->flags |= XBPS_FLAG_DURABILITY_STRICT;
+			} else if (strcasecmp(val, "default") != 0) {
+				xbps_dbg_printf(xhp, "%s: ignoring invalid "
+				    "durability mode %s at line %zu\n", path,
+				    val, nlines);
+				break;
+			}
+			xbps_dbg_printf(xhp, "%s: durability set to %s\n", path, val);
+			break;
 		case KEY_BESTMATCHING:
 			if (strcasecmp(val, "true") == 0) {
 				xhp->flags |= XBPS_FLAG_BESTMATCH;
@@ -379,6 +552,9 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 		case KEY_IGNOREPKG:
 			store_ignored_pkg(xhp, val);
 			break;
+		case KEY_MIRROR:
+			store_mirror(xhp, path, nlines, val);
+			break;
 		case KEY_NOEXTRACT:
 			store_noextract(xhp, val);
 			break;
@@ -420,6 +596,23 @@ xbps_conf_init(struct xbps_handle *xhp)
 		if ((rv = parse_files_glob(xhp, seen, xhp->sysconfdir, "*.conf", false)))
 			goto out;
 	}
+	/*
+	 * Compile the preserve and noextract lists once, these are
+	 * matched against every file of every package.
+	 */
+	xbps_matcher_free(xhp->preserved_matcher);
+	xbps_matcher_free(xhp->noextract_matcher);
+	xhp->preserved_matcher = xhp->noextract_matcher = NULL;
+	if (xhp->preserved_files &&
+	    (xhp->preserved_matcher = xbps_matcher_new(xhp->preserved_files, true)) == NULL) {
+		rv = errno;
+		goto out;
+	}
+	if (xhp->noextract &&
+	    (xhp->noextract_matcher = xbps_matcher_new(xhp->noextract, false)) == NULL) {
+		rv = errno;
+		goto out;
+	}
 
 out:
 	xbps_object_release(seen);
@@ -0,0 +1,313 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "xbps_api_impl.h"
+
+/*
+ * Binary package deltas.
+ *
+ * A delta is a zstd frame of the new binary package, compressed with
+ * the base binary package as prefix (as with zstd --patch-from), so
+ * that the unchanged parts of the archive are references to the base.
+ *
+ * The window is limited to DELTA_WINDOWLOG_MAX, so that applying a
+ * delta never needs more memory than that: the parts of the base out
+ * of the window of larger packages are not referenced.
+ */
+#define DELTA_WINDOWLOG_MAX	27	/* 128MB */
+
+char *
+xbps_binpkg_delta_name(const char *pkgver, const char *arch,
+    const char *basepkgver)
+{
+	const char *baseversion;
+
+	assert(pkgver);
+	assert(arch);
+	assert(basepkgver);
+
+	if ((baseversion = xbps_pkg_version(basepkgver)) == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return xbps_xasprintf("%s.from-%s.%s.xbpsd", pkgver, baseversion, arch);
+}
+
+#ifdef HAVE_LIBZSTD
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	ssize_t wr;
+
+	while (len > 0) {
+		if ((wr = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p += wr;
+		len -= (size_t)wr;
+	}
+	return 0;
+}
+
+static int
+open_tmpfile(const char *file, char **tmpfile)
+{
+	int fd;
+
+	if ((*tmpfile = xbps_xasprintf("%s.part", file)) == NULL)
+		return -1;
+	fd = open(*tmpfile, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if (fd == -1) {
+		free(*tmpfile);
+		*tmpfile = NULL;
+	}
+	return fd;
+}
+
+static int
+close_tmpfile(int fd, char *tmpfile, const char *file, int rv)
+{
+	if (close(fd) == -1 && rv == 0)
+		rv = errno;
+	if (rv == 0 && rename(tmpfile, file) == -1)
+		rv = errno;
+	if (rv != 0)
+		(void)unlink(tmpfile);
+	free(tmpfile);
+	return rv;
+}
+
+int
+xbps_delta_create(const char *base, const char *file, const char *delta)
+{
+	ZSTD_CCtx *cctx;
+	ZSTD_bounds bounds;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	void *basemf = NULL, *mf = NULL;
+	size_t basemflen, baselen, mflen, len, ret, outlen;
+	char *tmpfile = NULL, *outbuf;
+	int fd, wlog, rv = 0;
+
+	assert(base);
+	assert(file);
+	assert(delta);
+
+	if (!xbps_mmap_file(base, &basemf, &basemflen, &baselen))
+		return errno;
+	if (!xbps_mmap_file(file, &mf, &mflen, &len)) {
+		rv = errno;
+		(void)munmap(basemf, basemflen);
+		return rv;
+	}
+	outlen = ZSTD_CStreamOutSize();
+	if ((outbuf = malloc(outlen)) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	if ((cctx = ZSTD_createCCtx()) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	/*
+	 * The window should cover the base and the new file, so that
+	 * matches can reference the whole base.
+	 */
+	bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+	for (wlog = bounds.lowerBound;
+	    wlog < DELTA_WINDOWLOG_MAX && ((size_t)1 << wlog) < baselen + len;
+	    wlog++)
+		;
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 19);
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, wlog);
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+	ZSTD_CCtx_setPledgedSrcSize(cctx, len);
+	ret = ZSTD_CCtx_refPrefix(cctx, basemf, baselen);
+	if (ZSTD_isError(ret)) {
+		rv = EINVAL;
+		goto out_cctx;
+	}
+	if ((fd = open_tmpfile(delta, &tmpfile)) == -1) {
+		rv = errno;
+		goto out_cctx;
+	}
+	in.src = mf;
+	in.size = len;
+	in.pos = 0;
+	do {
+		out.dst = outbuf;
+		out.size = outlen;
+		out.pos = 0;
+		ret = ZSTD_compressStream2(cctx, &out, &in, ZSTD_e_end);
+		if (ZSTD_isError(ret)) {
+			rv = EINVAL;
+			break;
+		}
+		if ((rv = write_all(fd, outbuf, out.pos)) != 0)
+			break;
+	} while (ret != 0);
+	rv = close_tmpfile(fd, tmpfile, delta, rv);
+out_cctx:
+	ZSTD_freeCCtx(cctx);
+out:
+	free(outbuf);
+	(void)munmap(mf, mflen);
+	(void)munmap(basemf, basemflen);
+	return rv;
+}
+
+int
+xbps_delta_apply(const char *base, const char *delta, const char *file)
+{
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	void *basemf = NULL;
+	size_t basemflen, baselen, ret, inlen, outlen;
+	ssize_t rd;
+	char *tmpfile = NULL, *inbuf = NULL, *outbuf = NULL;
+	int fd, dfd, rv = 0;
+
+	assert(base);
+	assert(delta);
+	assert(file);
+
+	if ((dfd = open(delta, O_RDONLY|O_CLOEXEC)) == -1)
+		return errno;
+	if (!xbps_mmap_file(base, &basemf, &basemflen, &baselen)) {
+		rv = errno;
+		(void)close(dfd);
+		return rv;
+	}
+	inlen = ZSTD_DStreamInSize();
+	outlen = ZSTD_DStreamOutSize();
+	if ((inbuf = malloc(inlen)) == NULL || (outbuf = malloc(outlen)) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	if ((dctx = ZSTD_createDCtx()) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	/* larger windows are rejected, the package is downloaded instead */
+	ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, DELTA_WINDOWLOG_MAX);
+	ret = ZSTD_DCtx_refPrefix(dctx, basemf, baselen);
+	if (ZSTD_isError(ret)) {
+		rv = EINVAL;
+		goto out_dctx;
+	}
+	if ((fd = open_tmpfile(file, &tmpfile)) == -1) {
+		rv = errno;
+		goto out_dctx;
+	}
+	/* an empty delta is truncated too */
+	ret = 1;
+	while (rv == 0) {
+		if ((rd = read(dfd, inbuf, inlen)) == -1) {
+			if (errno == EINTR)
+				continue;
+			rv = errno;
+			break;
+		}
+		if (rd == 0)
+			break;
+		in.src = inbuf;
+		in.size = (size_t)rd;
+		in.pos = 0;
+		while (in.pos < in.size) {
+			out.dst = outbuf;
+			out.size = outlen;
+			out.pos = 0;
+			ret = ZSTD_decompressStream(dctx, &out, &in);
+			if (ZSTD_isError(ret)) {
+				rv = EINVAL;
+				break;
+			}
+			if ((rv = write_all(fd, outbuf, out.pos)) != 0)
+				break;
+			/* only one frame per delta */
+			if (ret == 0 && in.pos < in.size) {
+				rv = EINVAL;
+				break;
+			}
+		}
+	}
+	/* flush the remaining output, if any */
+	while (rv == 0 && ret != 0) {
+		in.src = inbuf;
+		in.size = in.pos = 0;
+		out.dst = outbuf;
+		out.size = outlen;
+		out.pos = 0;
+		ret = ZSTD_decompressStream(dctx, &out, &in);
+		if (ZSTD_isError(ret) || out.pos == 0) {
+			/* truncated delta */
+			rv = EINVAL;
+			break;
+		}
+		rv = write_all(fd, outbuf, out.pos);
+	}
+	rv = close_tmpfile(fd, tmpfile, file, rv);
+out_dctx:
+	ZSTD_freeDCtx(dctx);
+out:
+	free(inbuf);
+	free(outbuf);
+	(void)munmap(basemf, basemflen);
+	(void)close(dfd);
+	return rv;
+}
+#else
+int
+xbps_delta_create(const char *base UNUSED, const char *file UNUSED,
+    const char *delta UNUSED)
+{
+	return ENOTSUP;
+}
+
+int
+xbps_delta_apply(const char *base UNUSED, const char *delta UNUSED,
+    const char *file UNUSED)
+{
+	return ENOTSUP;
+}
+#endif
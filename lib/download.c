@@ -33,16 +33,22 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sys/wait.h>
 #include <libgen.h>
 
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 
 #include "xbps_api_impl.h"
 #include "fetch.h"
@@ -75,6 +81,7 @@ xbps_fetch_set_cache_connection(int global, int per_host)
 		per_host = XBPS_FETCH_CACHECONN_HOST;
 
 	fetchConnectionCacheInit(global, per_host);
+	fetchDNSCacheInit(XBPS_FETCH_DNS_TTL);
 }
 
 void HIDDEN
@@ -83,6 +90,120 @@ xbps_fetch_unset_cache_connection(void)
 	fetchConnectionCacheClose();
 }
 
+/*
+ * Connection pre-warming: one thread per remote repository host opens
+ * the connections into the libfetch connection cache. The threads are
+ * kept in the handle, the connection cache is shared by the process.
+ */
+struct xbps_prewarm_host {
+	pthread_t thd;
+	struct url *url;
+	int nconns;
+	int opened;
+};
+
+static void *
+prewarm_thread(void *arg)
+{
+	struct xbps_prewarm_host *ph = arg;
+
+	ph->opened = fetchConnectionPrewarm(ph->url, ph->nconns, NULL);
+	return NULL;
+}
+
+int
+xbps_fetch_prewarm(struct xbps_handle *xhp, unsigned int nconns)
+{
+	struct xbps_prewarm_host *ph;
+	struct url *url;
+	xbps_array_t mirrors;
+	const char *repouri;
+	unsigned int i, j, cnt;
+	int rv = 0;
+
+	assert(xhp);
+
+	xbps_fetch_prewarm_wait(xhp);
+
+	if (nconns == 0)
+		nconns = XBPS_FETCH_PREWARM;
+	if (nconns > XBPS_FETCH_CACHECONN_HOST)
+		nconns = XBPS_FETCH_CACHECONN_HOST;
+	if ((cnt = xbps_array_count(xhp->repositories)) == 0)
+		return 0;
+	xhp->prewarm_hosts = calloc(cnt, sizeof(*xhp->prewarm_hosts));
+	if (xhp->prewarm_hosts == NULL)
+		return ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
+		if (!xbps_repository_is_remote(repouri))
+			continue;
+		/* warm up the mirror that will be used for downloads */
+		if ((mirrors = xbps_repo_mirrors(xhp, repouri)) == NULL)
+			continue;
+		xbps_array_get_cstring_nocopy(mirrors, 0, &repouri);
+		url = fetchParseURL(repouri);
+		xbps_object_release(mirrors);
+		if (url == NULL)
+			continue;
+		if (strcasecmp(url->scheme, "http") != 0 &&
+		    strcasecmp(url->scheme, "https") != 0) {
+			fetchFreeURL(url);
+			continue;
+		}
+		for (j = 0; j < xhp->prewarm_nhosts; j++) {
+			ph = &xhp->prewarm_hosts[j];
+			if (ph->url->port == url->port &&
+			    strcasecmp(ph->url->scheme, url->scheme) == 0 &&
+			    strcasecmp(ph->url->host, url->host) == 0 &&
+			    strcmp(ph->url->user, url->user) == 0)
+				break;
+		}
+		if (j < xhp->prewarm_nhosts) {
+			fetchFreeURL(url);
+			continue;
+		}
+		ph = &xhp->prewarm_hosts[xhp->prewarm_nhosts];
+		ph->url = url;
+		ph->nconns = (int)nconns;
+		if ((rv = pthread_create(&ph->thd, NULL, prewarm_thread, ph)) != 0) {
+			fetchFreeURL(url);
+			break;
+		}
+		xhp->prewarm_nhosts++;
+	}
+	xbps_dbg_printf(xhp, "[fetch] pre-warming %u connections to %u hosts\n",
+	    nconns, xhp->prewarm_nhosts);
+
+	return rv;
+}
+
+void HIDDEN
+xbps_fetch_prewarm_wait(struct xbps_handle *xhp)
+{
+	struct xbps_prewarm_host *ph;
+
+	for (unsigned int i = 0; i < xhp->prewarm_nhosts; i++) {
+		ph = &xhp->prewarm_hosts[i];
+		pthread_join(ph->thd, NULL);
+		xbps_dbg_printf(xhp, "[fetch] %s://%s: %d new connections\n",
+		    ph->url->scheme, ph->url->host, ph->opened < 0 ? 0 : ph->opened);
+		fetchFreeURL(ph->url);
+	}
+	free(xhp->prewarm_hosts);
+	xhp->prewarm_hosts = NULL;
+	xhp->prewarm_nhosts = 0;
+}
+
+void HIDDEN
+xbps_fetch_end(struct xbps_handle *xhp)
+{
+	xbps_fetch_prewarm_wait(xhp);
+	fetchConnectionCacheClose();
+	fetchDNSCacheClose();
+}
+
 const char *
 xbps_fetch_error_string(void)
 {
@@ -92,6 +213,478 @@ xbps_fetch_error_string(void)
 	return fetchLastErrString;
 }
 
+/*
+ * Parallel download of large files in byte ranges (XBPS_FLAG_FETCH_PARALLEL).
+ *
+ * The remote file is split in XBPS_FETCH_PARALLEL_CHUNK ranges that are
+ * written by XBPS_FETCH_PARALLEL_CONNS threads into the preallocated
+ * temporary file "<file>.ranges", while the calling thread hashes the
+ * completed ranges in order. The completed ranges are recorded in
+ * "<file>.ranges.map", to resume an interrupted download from them.
+ *
+ * The sparse "<file>.ranges" is never renamed to "<file>.part", so a
+ * serial download only resumes contiguous data: the partial file of a
+ * serial download is adopted by a parallel one, and the data hashed in
+ * order is given back when ranges are not available.
+ */
+struct range_fetch {
+	struct url *url;
+	const char *flags;
+	int fd;
+	int mapfd;
+	off_t maphdrlen;
+	off_t size;
+	unsigned int nchunks;
+	unsigned char *done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int next;	/* first chunk that might not be started */
+	unsigned int running;	/* running threads */
+	off_t bytes;		/* downloaded bytes */
+	int rv;			/* first error */
+	int fetch_err;		/* and its libfetch error */
+	char fetch_errstr[MAXERRSTRING];
+};
+
+static off_t
+range_len(struct range_fetch *rf, unsigned int chunk)
+{
+	off_t off = (off_t)chunk * XBPS_FETCH_PARALLEL_CHUNK;
+
+	if (rf->size - off < XBPS_FETCH_PARALLEL_CHUNK)
+		return rf->size - off;
+	return XBPS_FETCH_PARALLEL_CHUNK;
+}
+
+static int
+range_get(struct range_fetch *rf, struct url *url, unsigned int chunk,
+    char *buf, size_t bufsiz)
+{
+	fetchIO *fio;
+	off_t off, len, pos;
+	ssize_t rd = 0, wr;
+	unsigned char mark = 1;
+	int rv = 0;
+
+	off = (off_t)chunk * XBPS_FETCH_PARALLEL_CHUNK;
+	len = range_len(rf, chunk);
+	url->offset = off;
+	url->length = (size_t)len;
+	if ((fio = fetchGet(url, rf->flags)) == NULL)
+		return EIO;
+	/* the server must honour the range */
+	if (url->offset != off || (off_t)url->length != len) {
+		fetchIO_close(fio);
+		return ENOTSUP;
+	}
+	for (pos = off; pos < off + len; pos += rd) {
+		if ((rd = fetchIO_read(fio, buf, bufsiz)) <= 0 ||
+		    rd > off + len - pos) {
+			rv = EIO;
+			break;
+		}
+		if ((wr = pwrite(rf->fd, buf, (size_t)rd, pos)) != rd) {
+			rv = wr == -1 ? errno : EIO;
+			break;
+		}
+		pthread_mutex_lock(&rf->lock);
+		rf->bytes += rd;
+		pthread_mutex_unlock(&rf->lock);
+	}
+	fetchIO_close(fio);
+	if (rv == 0 && rf->mapfd != -1)
+		(void)pwrite(rf->mapfd, &mark, 1, rf->maphdrlen + chunk);
+
+	return rv;
+}
+
+static void *
+range_thread(void *arg)
+{
+	struct range_fetch *rf = arg;
+	struct url *url;
+	char buf[32768];
+	unsigned int chunk;
+	int rv = 0;
+
+	if ((url = fetchCopyURL(rf->url)) == NULL)
+		rv = ENOMEM;
+
+	pthread_mutex_lock(&rf->lock);
+	for (;;) {
+		if (rv != 0) {
+			if (rf->rv == 0) {
+				rf->rv = rv;
+				rf->fetch_err = fetchLastErrCode;
+				xbps_strlcpy(rf->fetch_errstr, fetchLastErrString,
+				    sizeof(rf->fetch_errstr));
+			}
+			break;
+		}
+		while (rf->next < rf->nchunks && rf->done[rf->next])
+			rf->next++;
+		if (rf->rv != 0 || rf->next == rf->nchunks)
+			break;
+		chunk = rf->next++;
+		pthread_mutex_unlock(&rf->lock);
+
+		rv = range_get(rf, url, chunk, buf, sizeof(buf));
+
+		pthread_mutex_lock(&rf->lock);
+		if (rv == 0)
+			rf->done[chunk] = 1;
+		pthread_cond_broadcast(&rf->cond);
+	}
+	rf->running--;
+	pthread_cond_broadcast(&rf->cond);
+	pthread_mutex_unlock(&rf->lock);
+
+	fetchFreeURL(url);
+	return NULL;
+}
+
+static int
+range_hash(struct range_fetch *rf, unsigned int chunk, EVP_MD_CTX *sha256)
+{
+	char buf[65536];
+	off_t pos, end;
+	ssize_t rd;
+
+	pos = (off_t)chunk * XBPS_FETCH_PARALLEL_CHUNK;
+	for (end = pos + range_len(rf, chunk); pos < end; pos += rd) {
+		rd = pread(rf->fd, buf, MIN(sizeof(buf), (size_t)(end - pos)), pos);
+		if (rd <= 0)
+			return rd == 0 ? EIO : errno;
+		EVP_DigestUpdate(sha256, buf, (size_t)rd);
+	}
+	return 0;
+}
+
+/*
+ * Initializes the chunks already downloaded from the map file, or from
+ * the size of the contiguous data of a serial download, and writes the
+ * new map file. Without both nothing in the file is trusted.
+ */
+static void
+range_resume(struct range_fetch *rf, const char *mapfile, const char *hdr,
+    bool serial)
+{
+	struct stat st;
+	char *buf;
+	size_t buflen;
+	int fd;
+
+	rf->maphdrlen = (off_t)strlen(hdr);
+	buflen = (size_t)rf->maphdrlen + rf->nchunks;
+
+	if (fstat(rf->fd, &st) == -1)
+		return;
+	if ((fd = open(mapfile, O_RDONLY|O_CLOEXEC)) != -1) {
+		if ((buf = malloc(buflen)) != NULL) {
+			if (read(fd, buf, buflen) == (ssize_t)buflen &&
+			    memcmp(buf, hdr, (size_t)rf->maphdrlen) == 0 &&
+			    st.st_size == rf->size) {
+				for (unsigned int i = 0; i < rf->nchunks; i++)
+					rf->done[i] = buf[rf->maphdrlen + i] != 0;
+			}
+			free(buf);
+		}
+		(void)close(fd);
+	} else if (serial && st.st_size <= rf->size) {
+		/* the data of a serial download is contiguous */
+		for (unsigned int i = 0; i < rf->nchunks &&
+		    (off_t)(i + 1) * XBPS_FETCH_PARALLEL_CHUNK <= st.st_size; i++)
+			rf->done[i] = 1;
+	}
+
+	rf->mapfd = open(mapfile, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if (rf->mapfd == -1)
+		return;
+	if (write(rf->mapfd, hdr, (size_t)rf->maphdrlen) != rf->maphdrlen ||
+	    write(rf->mapfd, rf->done, rf->nchunks) != (ssize_t)rf->nchunks ||
+	    fdatasync(rf->mapfd) == -1) {
+		(void)close(rf->mapfd);
+		(void)unlink(mapfile);
+		rf->mapfd = -1;
+	}
+}
+
+static void
+remove_ranges(const char *filename)
+{
+	char *rangefile;
+
+	rangefile = xbps_xasprintf("%s.ranges.map", filename);
+	(void)unlink(rangefile);
+	rangefile[strlen(rangefile) - 4] = '\0';
+	(void)unlink(rangefile);
+	free(rangefile);
+}
+
+/*
+ * Returns 1 if the file has been downloaded, -1 on error (errno set),
+ * and 0 if it must be downloaded serially: not a HTTP(S) url, small
+ * file or server without support for ranges.
+ */
+static int
+fetch_file_ranges(struct xbps_handle *xhp, struct url *url,
+    const char *filename, const char *tempfile, const char *flags,
+    EVP_MD_CTX *sha256)
+{
+	struct range_fetch rf;
+	struct url_stat url_st;
+	struct timespec ts[2];
+	pthread_t thds[XBPS_FETCH_PARALLEL_CONNS];
+	char hdr[128], *rangefile = NULL, *mapfile = NULL;
+	off_t start = 0, prefix = 0, bytes;
+	unsigned int i, hashed = 0, nthreads = 0;
+	bool serial = false;
+	int rv = 0;
+
+	if (strcasecmp(url->scheme, "http") != 0 &&
+	    strcasecmp(url->scheme, "https") != 0)
+		return 0;
+	if (fetchStat(url, &url_st, flags) == -1)
+		return 0;
+	url->offset = 0;
+	url->length = 0;
+	if (url_st.size <= 2 * (off_t)XBPS_FETCH_PARALLEL_CHUNK)
+		return 0;
+
+	memset(&rf, 0, sizeof(rf));
+	rf.url = url;
+	rf.flags = flags;
+	rf.fd = rf.mapfd = -1;
+	rf.size = url_st.size;
+	rf.nchunks = (unsigned int)((rf.size + XBPS_FETCH_PARALLEL_CHUNK - 1) /
+	    XBPS_FETCH_PARALLEL_CHUNK);
+	if ((rf.done = calloc(rf.nchunks, 1)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	snprintf(hdr, sizeof(hdr), "xbps-ranges %jd %d %jd\n",
+	    (intmax_t)rf.size, XBPS_FETCH_PARALLEL_CHUNK,
+	    (intmax_t)url_st.mtime);
+	rangefile = xbps_xasprintf("%s.ranges", filename);
+	mapfile = xbps_xasprintf("%s.map", rangefile);
+
+	/* adopt the partial file of a serial download */
+	if (access(rangefile, F_OK) == -1 && errno == ENOENT &&
+	    rename(tempfile, rangefile) == 0)
+		serial = true;
+	if ((rf.fd = open(rangefile, O_RDWR|O_CREAT|O_CLOEXEC, 0644)) == -1) {
+		rv = errno;
+		goto out;
+	}
+	range_resume(&rf, mapfile, hdr, serial);
+	if (ftruncate(rf.fd, rf.size) == -1) {
+		rv = errno;
+		goto out;
+	}
+	(void)posix_fallocate(rf.fd, 0, rf.size);
+
+	for (i = 0; i < rf.nchunks; i++) {
+		if (rf.done[i])
+			start += range_len(&rf, i);
+	}
+	xbps_dbg_printf(xhp, "%s: downloading %u ranges, %jd bytes done\n",
+	    filename, rf.nchunks, (intmax_t)start);
+
+	pthread_mutex_init(&rf.lock, NULL);
+	pthread_cond_init(&rf.cond, NULL);
+	pthread_mutex_lock(&rf.lock);
+	for (i = 0; i < XBPS_FETCH_PARALLEL_CONNS; i++) {
+		if (pthread_create(&thds[i], NULL, range_thread, &rf) != 0)
+			break;
+		rf.running++;
+		nthreads++;
+	}
+	pthread_mutex_unlock(&rf.lock);
+	if (nthreads == 0) {
+		/* no threads, download them here */
+		rf.running++;
+		range_thread(&rf);
+	}
+
+	xbps_set_cb_fetch(xhp, rf.size, start, start, filename,
+	    true, false, false);
+	pthread_mutex_lock(&rf.lock);
+	for (;;) {
+		struct timespec abstime;
+
+		while (hashed < rf.nchunks && rf.done[hashed] && rf.rv == 0) {
+			pthread_mutex_unlock(&rf.lock);
+			if (sha256)
+				rv = range_hash(&rf, hashed, sha256);
+			pthread_mutex_lock(&rf.lock);
+			if (rv != 0 && rf.rv == 0)
+				rf.rv = rv;
+			prefix += range_len(&rf, hashed++);
+		}
+		if (hashed == rf.nchunks || rf.rv != 0 || rf.running == 0)
+			break;
+		clock_gettime(CLOCK_REALTIME, &abstime);
+		abstime.tv_nsec += 250000000;
+		if (abstime.tv_nsec >= 1000000000) {
+			abstime.tv_sec++;
+			abstime.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&rf.cond, &rf.lock, &abstime);
+		bytes = rf.bytes;
+		pthread_mutex_unlock(&rf.lock);
+		xbps_set_cb_fetch(xhp, rf.size, start, start + bytes,
+		    filename, false, true, false);
+		pthread_mutex_lock(&rf.lock);
+	}
+	pthread_mutex_unlock(&rf.lock);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(thds[i], NULL);
+	pthread_cond_destroy(&rf.cond);
+	pthread_mutex_destroy(&rf.lock);
+
+	if ((rv = rf.rv) == 0 && hashed < rf.nchunks)
+		rv = EIO;
+	if (rv != 0) {
+		if (rf.fetch_err != 0) {
+			fetchLastErrCode = rf.fetch_err;
+			xbps_strlcpy(fetchLastErrString, rf.fetch_errstr,
+			    sizeof(fetchLastErrString));
+		}
+		goto out;
+	}
+
+	xbps_set_cb_fetch(xhp, rf.size, start, rf.bytes, filename,
+	    false, false, true);
+
+	ts[0].tv_sec = url_st.atime ? url_st.atime : url_st.mtime;
+	ts[1].tv_sec = url_st.mtime;
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+	if (futimens(rf.fd, ts) == -1) {
+		rv = errno;
+		goto out;
+	}
+	(void)close(rf.fd);
+	rf.fd = -1;
+	if (rename(rangefile, filename) == -1) {
+		rv = errno;
+		xbps_dbg_printf(xhp, "failed to rename %s to %s: %s",
+		    rangefile, filename, strerror(rv));
+		goto out;
+	}
+	(void)unlink(mapfile);
+	/* the stale partial file of an earlier serial download, if any */
+	(void)unlink(tempfile);
+
+out:
+	if (rv != 0 && rf.fd != -1 && (rf.mapfd == -1 || rv == ENOTSUP)) {
+		/*
+		 * Without the map file only the data hashed in order
+		 * can be resumed, by a serial download.
+		 */
+		if (ftruncate(rf.fd, prefix) == 0)
+			(void)rename(rangefile, tempfile);
+		(void)unlink(mapfile);
+	}
+	if (rf.fd != -1)
+		(void)close(rf.fd);
+	if (rf.mapfd != -1)
+		(void)close(rf.mapfd);
+	free(rf.done);
+	free(rangefile);
+	free(mapfile);
+
+	if (rv == ENOTSUP) {
+		xbps_dbg_printf(xhp, "%s: server does not support ranges, "
+		    "downloading serially\n", filename);
+		if (sha256 != NULL &&
+		    EVP_DigestInit_ex(sha256, EVP_sha256(), NULL) != 1) {
+			errno = ENOMEM;
+			return -1;
+		}
+		return 0;
+	} else if (rv != 0) {
+		errno = rv;
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * Zero-copy download (XBPS_FLAG_FETCH_ZEROCOPY).
+ *
+ * The content is spliced from the socket to the file by libfetch, and
+ * hashed if needed from a mapping of the written region, in windows of
+ * FETCH_SPLICE_HASH bytes, while its pages are still in the page cache.
+ */
+#define FETCH_SPLICE_LEN	(1024 * 1024)
+#define FETCH_SPLICE_HASH	(4 * 1024 * 1024)
+
+static int
+splice_hash(int fd, off_t start, off_t end, EVP_MD_CTX *sha256)
+{
+	off_t mstart;
+	size_t mlen;
+	void *mf;
+
+	if (start == end)
+		return 0;
+	mstart = start & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+	mlen = (size_t)(end - mstart);
+	mf = mmap(NULL, mlen, PROT_READ, MAP_SHARED, fd, mstart);
+	if (mf == MAP_FAILED)
+		return errno;
+	EVP_DigestUpdate(sha256, (unsigned char *)mf + (start - mstart),
+	    (size_t)(end - start));
+	(void)munmap(mf, mlen);
+	return 0;
+}
+
+/*
+ * Returns the number of spliced bytes in bytes_dload, 0 if the stream
+ * can't be spliced and must be read, or -1 on error.
+ */
+static ssize_t
+fetch_file_splice(struct xbps_handle *xhp, fetchIO *fio, int fd,
+    EVP_MD_CTX *sha256, struct url *url, off_t size, const char *filename,
+    off_t *bytes_dload)
+{
+	off_t pos, hashed;
+	ssize_t n;
+	int rv;
+
+	if ((pos = lseek(fd, 0, SEEK_CUR)) == -1)
+		return -1;
+	hashed = pos;
+	while ((n = fetchIO_splice(fio, fd, FETCH_SPLICE_LEN)) > 0) {
+		pos += n;
+		*bytes_dload += n;
+		if (sha256 && pos - hashed >= FETCH_SPLICE_HASH) {
+			if ((rv = splice_hash(fd, hashed, pos, sha256)) != 0) {
+				xbps_dbg_printf(xhp, "failed to hash %s: %s\n",
+				    filename, strerror(rv));
+				return -1;
+			}
+			hashed = pos;
+		}
+		xbps_set_cb_fetch(xhp, size, url->offset,
+		    url->offset + *bytes_dload, filename, false, true, false);
+	}
+	if (n == -1) {
+		if (errno == ENOTSUP && *bytes_dload == 0) {
+			xbps_dbg_printf(xhp, "%s: zero-copy download not "
+			    "supported, reading it\n", filename);
+			return 0;
+		}
+		return -1;
+	}
+	if (sha256 && (rv = splice_hash(fd, hashed, pos, sha256)) != 0) {
+		xbps_dbg_printf(xhp, "failed to hash %s: %s\n",
+		    filename, strerror(rv));
+		return -1;
+	}
+	return 0;
+}
+
 int
 xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char *filename, const char *flags, unsigned char *digest, size_t digestlen)
 {
@@ -106,7 +699,7 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	char fetch_flags[8];
 	int fd = -1, rv = 0;
 	bool refetch = false, restart = false;
-	SHA256_CTX sha256;
+	EVP_MD_CTX *sha256 = NULL;
 
 	assert(xhp);
 	assert(uri);
@@ -117,7 +710,6 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 			errno = ENOBUFS;
 			return -1;
 		}
-		SHA256_Init(&sha256);
 	}
 
 	/* Extern vars declared in libfetch */
@@ -126,11 +718,35 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	if (!filename || (url = fetchParseURL(uri)) == NULL)
 		return -1;
 
+	if (digest != NULL) {
+		if ((sha256 = EVP_MD_CTX_new()) == NULL ||
+		    EVP_DigestInit_ex(sha256, EVP_sha256(), NULL) != 1) {
+			errno = ENOMEM;
+			rv = -1;
+			goto fetch_file_out;
+		}
+	}
+
 	memset(&fetch_flags, 0, sizeof(fetch_flags));
 	if (flags != NULL)
 		xbps_strlcpy(fetch_flags, flags, 7);
 
 	tempfile = xbps_xasprintf("%s.part", filename);
+	/*
+	 * Download large files in parallel byte ranges, unless the
+	 * destination file exists and might be unchanged.
+	 */
+	if ((xhp->flags & XBPS_FLAG_FETCH_PARALLEL) &&
+	    access(filename, F_OK) == -1 && errno == ENOENT) {
+		if ((rv = fetch_file_ranges(xhp, url, filename, tempfile,
+		    fetch_flags, sha256)) == 1) {
+			if (digest)
+				EVP_DigestFinal_ex(sha256, digest, NULL);
+			goto fetch_file_out;
+		} else if (rv == -1) {
+			goto fetch_file_out;
+		}
+	}
 	/*
 	 * Check if we have to resume a transfer.
 	 */
@@ -214,11 +830,12 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	    print_time(&url->last_modified));
 	/*
 	 * If restarting, open the file for appending otherwise create it.
+	 * It's readable to hash the spliced data.
 	 */
 	if (restart)
 		fd = open(tempfile, O_RDWR|O_CLOEXEC);
 	else
-		fd = open(tempfile, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC, 0644);
+		fd = open(tempfile, O_RDWR|O_CREAT|O_CLOEXEC|O_TRUNC, 0644);
 
 	if (fd == -1) {
 		rv = -1;
@@ -232,7 +849,7 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	if (restart) {
 		if (digest) {
 			while ((bytes_read = read(fd, buf, sizeof(buf))) > 0) {
-				SHA256_Update(&sha256, buf, bytes_read);
+				EVP_DigestUpdate(sha256, buf, (size_t)bytes_read);
 			}
 			if (bytes_read == -1) {
 				xbps_dbg_printf(xhp, "IO error while reading %s: %s\n",
@@ -253,11 +870,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	xbps_set_cb_fetch(xhp, url_st.size, url->offset, url->offset,
 	    filename, true, false, false);
 	/*
-	 * Start fetching requested file.
+	 * Start fetching requested file, spliced if possible.
 	 */
-	while ((bytes_read = fetchIO_read(fio, buf, sizeof(buf))) > 0) {
+	if (xhp->flags & XBPS_FLAG_FETCH_ZEROCOPY)
+		bytes_read = fetch_file_splice(xhp, fio, fd, sha256, url,
+		    url_st.size, filename, &bytes_dload);
+	while (bytes_read != -1 &&
+	    (bytes_read = fetchIO_read(fio, buf, sizeof(buf))) > 0) {
 		if (digest)
-			SHA256_Update(&sha256, buf, bytes_read);
+			EVP_DigestUpdate(sha256, buf, (size_t)bytes_read);
 		bytes_written = write(fd, buf, (size_t)bytes_read);
 		if (bytes_written != bytes_read) {
 			xbps_dbg_printf(xhp,
@@ -317,11 +938,14 @@ rename_file:
 		goto fetch_file_out;
 	}
 	rv = 1;
+	/* drop an interrupted parallel download of the same file */
+	remove_ranges(filename);
 
 	if (digest)
-		SHA256_Final(digest, &sha256);
+		EVP_DigestFinal_ex(sha256, digest, NULL);
 
 fetch_file_out:
+	EVP_MD_CTX_free(sha256);
 	if (fio != NULL)
 		fetchIO_close(fio);
 	if (fd != -1)
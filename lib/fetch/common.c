@@ -54,6 +54,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <strings.h>
+#include <time.h>
 #include <poll.h>
 #include <fcntl.h>
 
@@ -689,6 +690,222 @@ out:
 	return rv;
 }
 
+/*
+ * Resolver cache: the addresses of the recently looked up host/port/family
+ * tuples, kept for dns_cache_ttl seconds so that new connections to the
+ * same server don't need to look it up again.
+ */
+#define DNS_CACHE_MAX	32
+
+struct dns_entry {
+	struct dns_entry *next;
+	char *host;
+	int port;
+	int af;
+	time_t expires;
+	struct addrinfo *res;
+};
+
+static pthread_mutex_t dns_cache_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_entry *dns_cache;
+static int dns_cache_ttl = 0;
+
+static time_t
+dns_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/*
+ * Private copies of addrinfo lists, every entry and its address
+ * in a single allocation.
+ */
+static void
+dns_freeaddrinfo(struct addrinfo *res)
+{
+	struct addrinfo *next;
+
+	for (; res != NULL; res = next) {
+		next = res->ai_next;
+		free(res);
+	}
+}
+
+static struct addrinfo *
+dns_copyaddrinfo(const struct addrinfo *res0)
+{
+	const struct addrinfo *res;
+	struct addrinfo *copy = NULL, **last = &copy, *ai;
+
+	for (res = res0; res != NULL; res = res->ai_next) {
+		if ((ai = malloc(sizeof(*ai) + res->ai_addrlen)) == NULL) {
+			dns_freeaddrinfo(copy);
+			return NULL;
+		}
+		memcpy(ai, res, sizeof(*ai));
+		ai->ai_addr = (struct sockaddr *)(void *)(ai + 1);
+		memcpy(ai->ai_addr, res->ai_addr, res->ai_addrlen);
+		ai->ai_canonname = NULL;
+		ai->ai_next = NULL;
+		*last = ai;
+		last = &ai->ai_next;
+	}
+	return copy;
+}
+
+static void
+dns_entry_free(struct dns_entry *e)
+{
+	dns_freeaddrinfo(e->res);
+	free(e->host);
+	free(e);
+}
+
+/* Must be called with dns_cache_mtx held. */
+static struct dns_entry **
+dns_cache_find(const char *host, int port, int af)
+{
+	struct dns_entry **ep;
+
+	for (ep = &dns_cache; *ep != NULL; ep = &(*ep)->next) {
+		if ((*ep)->port == port && (*ep)->af == af &&
+		    strcasecmp((*ep)->host, host) == 0)
+			break;
+	}
+	return ep;
+}
+
+static void
+dns_cache_remove(const char *host, int port, int af)
+{
+	struct dns_entry **ep, *e;
+
+	pthread_mutex_lock(&dns_cache_mtx);
+	ep = dns_cache_find(host, port, af);
+	if ((e = *ep) != NULL) {
+		*ep = e->next;
+		dns_entry_free(e);
+	}
+	pthread_mutex_unlock(&dns_cache_mtx);
+}
+
+static void
+dns_cache_add(const char *host, int port, int af, const struct addrinfo *res)
+{
+	struct dns_entry **ep, *e, *old;
+	unsigned int n = 0;
+
+	if ((e = calloc(1, sizeof(*e))) == NULL)
+		return;
+	if ((e->host = strdup(host)) == NULL ||
+	    (e->res = dns_copyaddrinfo(res)) == NULL) {
+		dns_entry_free(e);
+		return;
+	}
+	e->port = port;
+	e->af = af;
+	e->expires = dns_now() + dns_cache_ttl;
+
+	pthread_mutex_lock(&dns_cache_mtx);
+	ep = dns_cache_find(host, port, af);
+	if ((old = *ep) != NULL) {
+		*ep = old->next;
+		dns_entry_free(old);
+	}
+	e->next = dns_cache;
+	dns_cache = e;
+
+	/* drop the least recently resolved entries */
+	for (ep = &dns_cache; *ep != NULL; ep = &(*ep)->next) {
+		if (++n > DNS_CACHE_MAX) {
+			e = *ep;
+			*ep = NULL;
+			while (e != NULL) {
+				old = e->next;
+				dns_entry_free(e);
+				e = old;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dns_cache_mtx);
+}
+
+/*
+ * Look up the addresses of host/port, from the resolver cache if the
+ * entry didn't expire yet. The result must be released with
+ * dns_freeaddrinfo(). Returns 0 or a getaddrinfo(3) error code.
+ */
+static int
+fetch_resolve(const char *host, int port, int af, struct addrinfo **res,
+    int *cached)
+{
+	struct addrinfo hints, *res0;
+	struct dns_entry *e;
+	char pbuf[10];
+	int error;
+
+	*cached = 0;
+	if (dns_cache_ttl > 0) {
+		pthread_mutex_lock(&dns_cache_mtx);
+		if ((e = *dns_cache_find(host, port, af)) != NULL &&
+		    e->expires > dns_now()) {
+			*res = dns_copyaddrinfo(e->res);
+			pthread_mutex_unlock(&dns_cache_mtx);
+			if (*res == NULL)
+				return EAI_MEMORY;
+			*cached = 1;
+			return 0;
+		}
+		pthread_mutex_unlock(&dns_cache_mtx);
+	}
+
+	snprintf(pbuf, sizeof(pbuf), "%d", port);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = af;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = 0;
+	if ((error = getaddrinfo(host, pbuf, &hints, &res0)) != 0)
+		return error;
+	*res = dns_copyaddrinfo(res0);
+	freeaddrinfo(res0);
+	if (*res == NULL)
+		return EAI_MEMORY;
+	if (dns_cache_ttl > 0)
+		dns_cache_add(host, port, af, *res);
+	return 0;
+}
+
+/*
+ * Enable the resolver cache, entries are kept for ttl seconds.
+ * A ttl of 0 disables the cache.
+ */
+void
+fetchDNSCacheInit(int ttl)
+{
+
+	dns_cache_ttl = ttl < 0 ? 0 : ttl;
+}
+
+/*
+ * Flush the resolver cache.
+ */
+void
+fetchDNSCacheClose(void)
+{
+	struct dns_entry *e;
+
+	pthread_mutex_lock(&dns_cache_mtx);
+	while ((e = dns_cache) != NULL) {
+		dns_cache = e->next;
+		dns_entry_free(e);
+	}
+	pthread_mutex_unlock(&dns_cache_mtx);
+}
+
 /*
  * Establish a TCP connection to the specified port on the specified host.
  */
@@ -696,11 +913,10 @@ conn_t *
 fetch_connect(struct url *url, int af, int verbose)
 {
 	conn_t *conn;
-	char pbuf[10];
 	struct url *socks_url = NULL, *connurl;
 	const char *socks_proxy;
-	struct addrinfo hints, *res0;
-	int sd, error;
+	struct addrinfo *res0;
+	int sd, error, cached;
 
 	socks_url = NULL;
 	socks_proxy = getenv("SOCKS_PROXY");
@@ -725,23 +941,23 @@ fetch_connect(struct url *url, int af, int verbose)
 		fetch_info("looking up %s", connurl->host);
 
 	/* look up host name and set up socket address structure */
-	snprintf(pbuf, sizeof(pbuf), "%d", connurl->port);
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = af;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = 0;
-	if ((error = getaddrinfo(connurl->host, pbuf, &hints, &res0)) != 0) {
+	if ((error = fetch_resolve(connurl->host, connurl->port, af,
+	    &res0, &cached)) != 0) {
 		netdb_seterr(error);
 		fetchFreeURL(socks_url);
 		return (NULL);
 	}
 
 	if (verbose)
-		fetch_info("connecting to %s:%d", connurl->host, connurl->port);
+		fetch_info("connecting to %s:%d%s", connurl->host, connurl->port,
+		    cached ? " (cached addresses)" : "");
 
 	sd = happy_eyeballs_connect(res0, verbose);
-	freeaddrinfo(res0);
+	dns_freeaddrinfo(res0);
 	if (sd == -1) {
+		/* the addresses might be stale, look them up next time */
+		if (cached)
+			dns_cache_remove(connurl->host, connurl->port, af);
 		fetchFreeURL(socks_url);
 		return (NULL);
 	}
@@ -806,6 +1022,18 @@ fetchConnectionCacheClose(void)
 	}
 }
 
+static int
+fetch_cache_match(const conn_t *conn, const struct url *url, int af)
+{
+	return (conn->cache_url->port == url->port &&
+	    strcmp(conn->cache_url->scheme, url->scheme) == 0 &&
+	    strcmp(conn->cache_url->host, url->host) == 0 &&
+	    strcmp(conn->cache_url->user, url->user) == 0 &&
+	    strcmp(conn->cache_url->pwd, url->pwd) == 0 &&
+	    (conn->cache_af == AF_UNSPEC || af == AF_UNSPEC ||
+	     conn->cache_af == af));
+}
+
 /*
  * Check connection cache for an existing entry matching
  * protocol/host/port/user/password/family.
@@ -816,14 +1044,9 @@ fetch_cache_get(const struct url *url, int af)
 	conn_t *conn, *last_conn = NULL;
 
 	pthread_mutex_lock(&cache_mtx);
-	for (conn = connection_cache; conn; conn = conn->next_cached) {
-		if (conn->cache_url->port == url->port &&
-		    strcmp(conn->cache_url->scheme, url->scheme) == 0 &&
-		    strcmp(conn->cache_url->host, url->host) == 0 &&
-		    strcmp(conn->cache_url->user, url->user) == 0 &&
-		    strcmp(conn->cache_url->pwd, url->pwd) == 0 &&
-		    (conn->cache_af == AF_UNSPEC || af == AF_UNSPEC ||
-		     conn->cache_af == af)) {
+	for (conn = connection_cache; conn;
+	    last_conn = conn, conn = conn->next_cached) {
+		if (fetch_cache_match(conn, url, af)) {
 			if (last_conn != NULL)
 				last_conn->next_cached = conn->next_cached;
 			else
@@ -838,6 +1061,25 @@ fetch_cache_get(const struct url *url, int af)
 	return NULL;
 }
 
+/*
+ * Count the cached connections matching the given url and family.
+ */
+int
+fetch_cache_count(const struct url *url, int af)
+{
+	conn_t *conn;
+	int n = 0;
+
+	pthread_mutex_lock(&cache_mtx);
+	for (conn = connection_cache; conn; conn = conn->next_cached) {
+		if (fetch_cache_match(conn, url, af))
+			n++;
+	}
+	pthread_mutex_unlock(&cache_mtx);
+
+	return n;
+}
+
 /*
  * Put the connection back into the cache for reuse.
  * If the connection is freed due to LRU or if the cache
@@ -1250,7 +1492,7 @@ fetch_ssl_setup_transport_layer(SSL_CTX *ctx, int verbose)
 {
 	long ssl_ctx_options;
 
-	ssl_ctx_options = SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_TICKET;
+	ssl_ctx_options = SSL_OP_ALL | SSL_OP_NO_SSLv2;
 	if (getenv("SSL_ALLOW_SSL3") == NULL)
 		ssl_ctx_options |= SSL_OP_NO_SSLv3;
 	if (getenv("SSL_NO_TLS1") != NULL)
@@ -1374,15 +1616,247 @@ fetch_ssl_cb_verify_crt(int verified, X509_STORE_CTX *ctx)
 	return (verified);
 }
 
+/*
+ * A single SSL context is shared by all connections, created with the
+ * settings from the environment. It's created again when they change,
+ * and only kept if it could be set up: a failure is retried by the next
+ * connection.
+ */
+static const char *ssl_env_vars[] = {
+	"SSL_ALLOW_SSL3", "SSL_NO_TLS1", "SSL_NO_TLS1_1", "SSL_NO_TLS1_2",
+	"SSL_NO_VERIFY_PEER", "SSL_CA_CERT_FILE", "SSL_CA_CERT_PATH",
+	"SSL_CRL_FILE", "SSL_CLIENT_CERT_FILE", "SSL_CLIENT_KEY_FILE", NULL
+};
+
 static pthread_once_t ssl_init_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t ssl_ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+static SSL_CTX *ssl_ctx;
+static char *ssl_ctx_env;	/* settings of ssl_ctx */
+
+/*
+ * Client side session cache: the last session of every host:port,
+ * so that reconnections resume it rather than doing a full handshake.
+ */
+#define SSL_SESSIONS_MAX	32
+
+struct ssl_session {
+	struct ssl_session *next;
+	char *key;
+	SSL_SESSION *sess;
+};
+
+static pthread_mutex_t ssl_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ssl_session *ssl_sessions;
+
+/* Must be called with ssl_sessions_lock held. */
+static struct ssl_session **
+ssl_session_find(const char *key)
+{
+	struct ssl_session **sp;
+
+	for (sp = &ssl_sessions; *sp != NULL; sp = &(*sp)->next) {
+		if (strcmp((*sp)->key, key) == 0)
+			break;
+	}
+	return sp;
+}
+
+static void
+ssl_session_remove(const char *key)
+{
+	struct ssl_session **sp, *s;
+
+	pthread_mutex_lock(&ssl_sessions_lock);
+	sp = ssl_session_find(key);
+	if ((s = *sp) != NULL) {
+		*sp = s->next;
+		SSL_SESSION_free(s->sess);
+		free(s->key);
+		free(s);
+	}
+	pthread_mutex_unlock(&ssl_sessions_lock);
+}
+
+/*
+ * Drops all sessions, they were established with other settings.
+ */
+static void
+ssl_session_flush(void)
+{
+	struct ssl_session *s;
+
+	pthread_mutex_lock(&ssl_sessions_lock);
+	while ((s = ssl_sessions) != NULL) {
+		ssl_sessions = s->next;
+		SSL_SESSION_free(s->sess);
+		free(s->key);
+		free(s);
+	}
+	pthread_mutex_unlock(&ssl_sessions_lock);
+}
+
+static void
+ssl_session_resume(SSL *ssl, const char *key)
+{
+	struct ssl_session *s;
+
+	pthread_mutex_lock(&ssl_sessions_lock);
+	if ((s = *ssl_session_find(key)) != NULL)
+		SSL_set_session(ssl, s->sess);
+	pthread_mutex_unlock(&ssl_sessions_lock);
+}
+
+/*
+ * Called by OpenSSL when a new session is established, the session
+ * is kept in the cache (the reference is owned by the cache).
+ */
+static int
+ssl_session_new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+	conn_t *conn = SSL_get_app_data(ssl);
+	struct ssl_session **sp, *s;
+	unsigned int n = 0;
+
+	int shared;
+
+	if (conn == NULL || conn->ssl_session_key == NULL)
+		return 0;
+	/* only keep the sessions of the current settings */
+	pthread_mutex_lock(&ssl_ctx_lock);
+	shared = SSL_get_SSL_CTX(ssl) == ssl_ctx;
+	pthread_mutex_unlock(&ssl_ctx_lock);
+	if (!shared)
+		return 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_SESSION_is_resumable(sess))
+		return 0;
+#endif
+	pthread_mutex_lock(&ssl_sessions_lock);
+	sp = ssl_session_find(conn->ssl_session_key);
+	if ((s = *sp) != NULL) {
+		/* move it to the head */
+		*sp = s->next;
+		SSL_SESSION_free(s->sess);
+	} else {
+		if ((s = calloc(1, sizeof(*s))) == NULL ||
+		    (s->key = strdup(conn->ssl_session_key)) == NULL) {
+			free(s);
+			pthread_mutex_unlock(&ssl_sessions_lock);
+			return 0;
+		}
+	}
+	s->sess = sess;
+	s->next = ssl_sessions;
+	ssl_sessions = s;
+
+	/* drop the least recently established sessions */
+	for (sp = &ssl_sessions; *sp != NULL; sp = &(*sp)->next) {
+		if (++n > SSL_SESSIONS_MAX) {
+			s = *sp;
+			*sp = NULL;
+			while (s != NULL) {
+				struct ssl_session *next = s->next;
+				SSL_SESSION_free(s->sess);
+				free(s->key);
+				free(s);
+				s = next;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ssl_sessions_lock);
+	return 1;
+}
 
 static void
 ssl_init(void)
 {
-	/* Init the SSL library and context */
+	/* Init the SSL library */
 	SSL_load_error_strings();
 	SSL_library_init();
 }
+
+/*
+ * Returns the settings from the environment used by ssl_ctx_new(),
+ * to compare them with the settings of the shared context.
+ */
+static char *
+ssl_ctx_env_get(void)
+{
+	const char **var, *val;
+	char *env, *p;
+	size_t len = 1;
+
+	for (var = ssl_env_vars; *var != NULL; var++) {
+		if ((val = getenv(*var)) != NULL)
+			len += strlen(*var) + strlen(val) + 2;
+	}
+	if ((p = env = malloc(len)) == NULL)
+		return NULL;
+	for (var = ssl_env_vars; *var != NULL; var++) {
+		if ((val = getenv(*var)) != NULL)
+			p += sprintf(p, "%s=%s\n", *var, val);
+	}
+	*p = '\0';
+	return env;
+}
+
+static SSL_CTX *
+ssl_ctx_new(int verbose)
+{
+	SSL_CTX *ctx;
+
+	ctx = SSL_CTX_new(SSLv23_client_method());
+	if (ctx == NULL)
+		return NULL;
+	SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+	SSL_CTX_set_session_cache_mode(ctx,
+	    SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, ssl_session_new_cb);
+
+	fetch_ssl_setup_transport_layer(ctx, verbose);
+	if (!fetch_ssl_setup_peer_verification(ctx, verbose) ||
+	    !fetch_ssl_setup_client_certificate(ctx, verbose)) {
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/*
+ * Returns a reference to the shared SSL context, created or created
+ * again if needed, or NULL if it could not be set up.
+ */
+static SSL_CTX *
+ssl_ctx_get(int verbose)
+{
+	SSL_CTX *ctx;
+	char *env;
+
+	(void)pthread_once(&ssl_init_once, ssl_init);
+
+	env = ssl_ctx_env_get();
+	pthread_mutex_lock(&ssl_ctx_lock);
+	if (ssl_ctx != NULL && env != NULL && strcmp(env, ssl_ctx_env) == 0) {
+		ctx = ssl_ctx;
+		SSL_CTX_up_ref(ctx);
+	} else if ((ctx = ssl_ctx_new(verbose)) != NULL && env != NULL) {
+		if (ssl_ctx != NULL) {
+			/* connections keep their own reference */
+			SSL_CTX_free(ssl_ctx);
+			ssl_session_flush();
+		}
+		free(ssl_ctx_env);
+		ssl_ctx = ctx;
+		ssl_ctx_env = env;
+		env = NULL;
+		SSL_CTX_up_ref(ctx);
+	}
+	pthread_mutex_unlock(&ssl_ctx_lock);
+	free(env);
+
+	return ctx;
+}
 #endif
 
 
@@ -1397,22 +1871,14 @@ fetch_ssl(conn_t *conn, const struct url *URL, int verbose)
 	int ret;
 	X509_NAME *name;
 	char *str;
+	size_t len;
 
-	(void)pthread_once(&ssl_init_once, ssl_init);
-
-	conn->ssl_ctx = SSL_CTX_new(SSLv23_client_method());
-	if (conn->ssl_ctx == NULL) {
+	/* the reference is released by fetch_close() */
+	if ((conn->ssl_ctx = ssl_ctx_get(verbose)) == NULL) {
 		fprintf(stderr, "failed to create SSL context\n");
 		ERR_print_errors_fp(stderr);
 		return -1;
 	}
-	SSL_CTX_set_mode(conn->ssl_ctx, SSL_MODE_AUTO_RETRY);
-
-	fetch_ssl_setup_transport_layer(conn->ssl_ctx, verbose);
-	if (!fetch_ssl_setup_peer_verification(conn->ssl_ctx, verbose))
-		return (-1);
-	if (!fetch_ssl_setup_client_certificate(conn->ssl_ctx, verbose))
-		return (-1);
 
 	conn->ssl = SSL_new(conn->ssl_ctx);
 	if (conn->ssl == NULL) {
@@ -1420,6 +1886,13 @@ fetch_ssl(conn_t *conn, const struct url *URL, int verbose)
 		return (-1);
 	}
 	SSL_set_connect_state(conn->ssl);
+	len = strlen(URL->host) + 12;
+	if ((conn->ssl_session_key = malloc(len)) != NULL) {
+		snprintf(conn->ssl_session_key, len, "%s:%d", URL->host,
+		    URL->port);
+		SSL_set_app_data(conn->ssl, conn);
+		ssl_session_resume(conn->ssl, conn->ssl_session_key);
+	}
 	if (!SSL_set_fd(conn->ssl, conn->sd)) {
 		fprintf(stderr, "SSL_set_fd failed\n");
 		return (-1);
@@ -1451,13 +1924,16 @@ fetch_ssl(conn_t *conn, const struct url *URL, int verbose)
 			fprintf(stderr,
 				"SSL certificate subject doesn't match host %s\n",
 				URL->host);
+			if (conn->ssl_session_key != NULL)
+				ssl_session_remove(conn->ssl_session_key);
 			return (-1);
 		}
 	}
 
 	if (verbose) {
-		fetch_info("%s connection established using %s",
-		    SSL_get_version(conn->ssl), SSL_get_cipher(conn->ssl));
+		fetch_info("%s connection established using %s%s",
+		    SSL_get_version(conn->ssl), SSL_get_cipher(conn->ssl),
+		    SSL_session_reused(conn->ssl) ? " (resumed)" : "");
 		conn->ssl_cert = SSL_get_peer_certificate(conn->ssl);
 		name = X509_get_subject_name(conn->ssl_cert);
 		str = X509_NAME_oneline(name, 0, 0);
@@ -1725,6 +2201,8 @@ fetch_close(conn_t *conn)
 		X509_free(conn->ssl_cert);
 		conn->ssl_cert = NULL;
 	}
+	free(conn->ssl_session_key);
+	conn->ssl_session_key = NULL;
 #endif
 	ret = close(conn->sd);
 	if (conn->cache_url)
@@ -2015,6 +2493,7 @@ struct fetchIO {
 	void *io_cookie;
 	ssize_t (*io_read)(void *, void *, size_t);
 	ssize_t (*io_write)(void *, const void *, size_t);
+	ssize_t (*io_splice)(void *, int, size_t);
 	void (*io_close)(void *);
 };
 
@@ -2041,11 +2520,18 @@ fetchIO_unopen(void *io_cookie, ssize_t (*io_read)(void *, void *, size_t),
 	f->io_cookie = io_cookie;
 	f->io_read = io_read;
 	f->io_write = io_write;
+	f->io_splice = NULL;
 	f->io_close = io_close;
 
 	return f;
 }
 
+void
+fetchIO_set_splice(fetchIO *f, ssize_t (*io_splice)(void *, int, size_t))
+{
+	f->io_splice = io_splice;
+}
+
 ssize_t
 fetchIO_read(fetchIO *f, void *buf, size_t len)
 {
@@ -2061,3 +2547,19 @@ fetchIO_write(fetchIO *f, const void *buf, size_t len)
 		return EBADF;
 	return (*f->io_write)(f->io_cookie, buf, len);
 }
+
+/*
+ * Move up to len bytes of the stream into the file descriptor fd,
+ * without copying them through userspace if the stream supports it.
+ * Returns the number of bytes moved, 0 at end of stream, or -1 with
+ * errno set to ENOTSUP if the stream can't be spliced.
+ */
+ssize_t
+fetchIO_splice(fetchIO *f, int fd, size_t len)
+{
+	if (f->io_splice == NULL) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	return (*f->io_splice)(f->io_cookie, fd, len);
+}
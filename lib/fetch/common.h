@@ -98,6 +98,7 @@ struct fetchconn {
 	SSL		*ssl;		/* SSL handle */
 	SSL_CTX		*ssl_ctx;	/* SSL context */
 	X509		*ssl_cert;	/* server certificate */
+	char		*ssl_session_key; /* host:port of the session cache */
 #endif
 
 	char		*ftp_home;
@@ -123,6 +124,7 @@ int		 fetch_default_proxy_port(const char *);
 int		 fetch_bind(int, int, const char *);
 conn_t		*fetch_cache_get(const struct url *, int);
 void		 fetch_cache_put(conn_t *, int (*)(conn_t *));
+int		 fetch_cache_count(const struct url *, int);
 int		 fetch_socks5(conn_t *, struct url *, struct url *, int);
 conn_t		*fetch_connect(struct url *, int, int);
 conn_t		*fetch_reopen(int);
@@ -146,6 +148,7 @@ int		 fetch_urlpath_safe(char);
 
 fetchIO		*fetchIO_unopen(void *, ssize_t (*)(void *, void *, size_t),
     ssize_t (*)(void *, const void *, size_t), void (*)(void *));
+void		 fetchIO_set_splice(fetchIO *, ssize_t (*)(void *, int, size_t));
 
 /*
  * I don't really like exporting http_request() and ftp_request(),
@@ -42,8 +42,8 @@
 #include "common.h"
 
 auth_t	 fetchAuthMethod;
-int	 fetchLastErrCode;
-char	 fetchLastErrString[MAXERRSTRING];
+__thread int	 fetchLastErrCode;
+__thread char	 fetchLastErrString[MAXERRSTRING];
 int	 fetchTimeout;
 int	 fetchConnTimeout = 300 * 1000;
 int	 fetchConnDelay = 250;
@@ -124,6 +124,23 @@ fetchPut(struct url *URL, const char *flags)
 	return (NULL);
 }
 
+/*
+ * Select the appropriate protocol for the URL scheme, and pre-open up
+ * to n cached connections to its server. Returns the number of new
+ * connections, or -1 if the scheme doesn't support connection caching.
+ */
+int
+fetchConnectionPrewarm(struct url *URL, int n, const char *flags)
+{
+
+	if (strcasecmp(URL->scheme, SCHEME_HTTP) == 0)
+		return (fetchPrewarmHTTP(URL, n, flags));
+	else if (strcasecmp(URL->scheme, SCHEME_HTTPS) == 0)
+		return (fetchPrewarmHTTP(URL, n, flags));
+	url_seterr(URL_BAD_SCHEME);
+	return (-1);
+}
+
 /*
  * Select the appropriate protocol for the URL scheme, and return the
  * size of the document referenced by the URL if it exists.
@@ -103,6 +103,7 @@ extern "C" {
 void		fetchIO_close(fetchIO *);
 ssize_t		fetchIO_read(fetchIO *, void *, size_t);
 ssize_t		fetchIO_write(fetchIO *, const void *, size_t);
+ssize_t		fetchIO_splice(fetchIO *, int, size_t);
 
 /* fetchIO-specific functions */
 fetchIO		*fetchXGetFile(struct url *, struct url_stat *, const char *);
@@ -116,6 +117,7 @@ int		 fetchListFile(struct url_list *, struct url *, const char *,
 fetchIO		*fetchXGetHTTP(struct url *, struct url_stat *, const char *);
 fetchIO		*fetchGetHTTP(struct url *, const char *);
 fetchIO		*fetchPutHTTP(struct url *, const char *);
+int		 fetchPrewarmHTTP(struct url *, int, const char *);
 int		 fetchStatHTTP(struct url *, struct url_stat *, const char *);
 int		 fetchListHTTP(struct url_list *, struct url *, const char *,
 		    const char *);
@@ -160,15 +162,20 @@ char		*fetchUnquoteFilename(struct url *);
 /* Connection caching */
 void		 fetchConnectionCacheInit(int, int);
 void		 fetchConnectionCacheClose(void);
+int		 fetchConnectionPrewarm(struct url *, int, const char *);
+
+/* Resolver caching */
+void		 fetchDNSCacheInit(int);
+void		 fetchDNSCacheClose(void);
 
 /* Authentication */
 typedef int (*auth_t)(struct url *);
 extern auth_t		 fetchAuthMethod;
 
 /* Last error code */
-extern int		 fetchLastErrCode;
+extern __thread int	 fetchLastErrCode;
 #define MAXERRSTRING 256
-extern char		 fetchLastErrString[MAXERRSTRING];
+extern __thread char	 fetchLastErrString[MAXERRSTRING];
 
 /* I/O timeout */
 extern int		 fetchTimeout;
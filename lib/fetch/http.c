@@ -68,6 +68,10 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#ifdef HAVE_SPLICE
+#include <fcntl.h>
+#include <poll.h>
+#endif
 
 #include <ctype.h>
 #include <errno.h>
@@ -135,6 +139,9 @@ struct httpio
 	int		 error;		/* error flag */
 	size_t		 chunksize;	/* remaining size of current chunk */
 	off_t		 contentlength;	/* remaining size of the content */
+#ifdef HAVE_SPLICE
+	int		 pipefd[2];	/* pipe to splice(2) the content */
+#endif
 };
 
 /*
@@ -298,6 +305,161 @@ http_writefn(void *v, const void *buf, size_t len)
 	return (fetch_write(io->conn, buf, len));
 }
 
+#ifdef HAVE_SPLICE
+#define HTTP_PIPE_SIZE	(1024 * 1024)
+
+/*
+ * Write data that was already read into userspace to fd
+ */
+static ssize_t
+http_splice_buffered(int fd, const char *buf, size_t len)
+{
+	ssize_t wlen;
+	size_t pos;
+
+	for (pos = 0; pos < len; pos += wlen) {
+		if ((wlen = write(fd, buf + pos, len - pos)) == -1) {
+			if (errno == EINTR)
+				continue;
+			fetch_syserr();
+			return (-1);
+		}
+	}
+	return (len);
+}
+
+/*
+ * Splice function: moves the content from the socket to fd through
+ * a pipe, without copying it to userspace. Only for plain identity
+ * encoded streams; chunked and TLS streams must be read.
+ */
+static ssize_t
+http_splicefn(void *v, int fd, size_t len)
+{
+	struct httpio *io = (struct httpio *)v;
+	conn_t *conn = io->conn;
+	struct pollfd pfd;
+	ssize_t rlen, wlen;
+	size_t l;
+	int r;
+
+	if (io->chunked) {
+		errno = ENOTSUP;
+		return (-1);
+	}
+#ifdef WITH_SSL
+	if (conn->ssl != NULL) {
+		errno = ENOTSUP;
+		return (-1);
+	}
+#endif
+	if (io->error)
+		return (-1);
+	if (io->eof || len == 0)
+		return (0);
+
+	/* data already buffered by a previous read */
+	if (io->buf && io->bufpos < io->buflen) {
+		l = io->buflen - io->bufpos;
+		if (len < l)
+			l = len;
+		if (http_splice_buffered(fd, io->buf + io->bufpos, l) == -1) {
+			io->error = 1;
+			return (-1);
+		}
+		io->bufpos += l;
+		return (l);
+	}
+	if (io->contentlength >= 0 && (off_t)len > io->contentlength)
+		len = io->contentlength;
+	if (len == 0) {
+		io->eof = 1;
+		return (0);
+	}
+	/* data read along with the headers */
+	if (conn->next_len != 0) {
+		l = conn->next_len;
+		if (len < l)
+			l = len;
+		if (http_splice_buffered(fd, conn->next_buf, l) == -1) {
+			io->error = 1;
+			return (-1);
+		}
+		conn->next_len -= l;
+		conn->next_buf += l;
+		if (io->contentlength >= 0)
+			io->contentlength -= l;
+		return (l);
+	}
+
+	if (io->pipefd[0] == -1) {
+		if (pipe2(io->pipefd, O_CLOEXEC) == -1) {
+			io->pipefd[0] = io->pipefd[1] = -1;
+			fetch_syserr();
+			return (-1);
+		}
+		/* a bigger pipe means less syscalls, but it's not fatal */
+		(void)fcntl(io->pipefd[1], F_SETPIPE_SZ, HTTP_PIPE_SIZE);
+	}
+	if (len > HTTP_PIPE_SIZE)
+		len = HTTP_PIPE_SIZE;
+
+	pfd.fd = conn->sd;
+	pfd.events = POLLIN;
+	for (;;) {
+		r = poll(&pfd, 1, fetchTimeout ? fetchTimeout * 1000 : -1);
+		if (r == 0) {
+			errno = ETIMEDOUT;
+			fetch_syserr();
+			io->error = 1;
+			return (-1);
+		}
+		if (r == -1) {
+			if (errno == EINTR && fetchRestartCalls)
+				continue;
+			fetch_syserr();
+			io->error = 1;
+			return (-1);
+		}
+		rlen = splice(conn->sd, NULL, io->pipefd[1], NULL, len,
+		    SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if (rlen == -1) {
+			if (errno == EAGAIN ||
+			    (errno == EINTR && fetchRestartCalls))
+				continue;
+			fetch_syserr();
+			io->error = 1;
+			return (-1);
+		}
+		break;
+	}
+	if (rlen == 0) {
+		io->eof = 1;
+		return (0);
+	}
+	for (l = 0; l < (size_t)rlen; l += wlen) {
+		wlen = splice(io->pipefd[0], NULL, fd, NULL, rlen - l,
+		    SPLICE_F_MOVE);
+		if (wlen == -1 && errno == EINTR) {
+			wlen = 0;
+			continue;
+		}
+		if (wlen <= 0) {
+			/* the data in the pipe is lost */
+			if (wlen == 0)
+				errno = EIO;
+			fetch_syserr();
+			io->error = 1;
+			return (-1);
+		}
+	}
+	if (io->contentlength >= 0)
+		io->contentlength -= rlen;
+
+	return (rlen);
+}
+#endif
+
 /*
  * Close function
  */
@@ -322,6 +484,12 @@ http_closefn(void *v)
 		fetch_close(io->conn);
 	}
 
+#ifdef HAVE_SPLICE
+	if (io->pipefd[0] != -1) {
+		close(io->pipefd[0]);
+		close(io->pipefd[1]);
+	}
+#endif
 	free(io->buf);
 	free(io);
 }
@@ -343,12 +511,18 @@ http_funopen(conn_t *conn, int chunked, int keep_alive, off_t clength)
 	io->chunked = chunked;
 	io->contentlength = clength;
 	io->keep_alive = keep_alive;
+#ifdef HAVE_SPLICE
+	io->pipefd[0] = io->pipefd[1] = -1;
+#endif
 	f = fetchIO_unopen(io, http_readfn, http_writefn, http_closefn);
 	if (f == NULL) {
 		fetch_syserr();
 		free(io);
 		return (NULL);
 	}
+#ifdef HAVE_SPLICE
+	fetchIO_set_splice(f, http_splicefn);
+#endif
 	return (f);
 }
 
@@ -714,19 +888,12 @@ send_proxy_headers(conn_t *conn, struct url *purl)
 }
 
 /*
- * Connect to the correct HTTP server or proxy.
+ * Address family selected by the flags.
  */
-static conn_t *
-http_connect(struct url *URL, struct url *purl, const char *flags, int *cached)
+static int
+http_af(const char *flags)
 {
-	struct url *curl;
-	conn_t *conn;
-	const char *p;
-	hdr_t h;
-	int af, verbose;
-#ifdef TCP_NOPUSH
-	int val;
-#endif
+	int af;
 
 #ifdef INET6
 	af = AF_UNSPEC;
@@ -734,20 +901,44 @@ http_connect(struct url *URL, struct url *purl, const char *flags, int *cached)
 	af = AF_INET;
 #endif
 
-	verbose = CHECK_FLAG('v');
 	if (CHECK_FLAG('4'))
 		af = AF_INET;
 #ifdef INET6
 	else if (CHECK_FLAG('6'))
 		af = AF_INET6;
 #endif
+	return (af);
+}
 
-	curl = (purl != NULL) ? purl : URL;
+/*
+ * Connections are cached by the server they talk to: the proxy for
+ * plain HTTP, and the server itself for HTTPS tunneled through a proxy.
+ */
+static struct url *
+http_cache_url(struct url *URL, struct url *purl)
+{
+	if (purl == NULL || strcasecmp(URL->scheme, SCHEME_HTTPS) == 0)
+		return (URL);
+	return (purl);
+}
 
-	if ((conn = fetch_cache_get(curl, af)) != NULL) {
-		*cached = 1;
-		return (conn);
-	}
+/*
+ * Open a new connection to the correct HTTP server or proxy.
+ */
+static conn_t *
+http_open(struct url *URL, struct url *purl, const char *flags, int af)
+{
+	struct url *curl;
+	conn_t *conn;
+	const char *p;
+	hdr_t h;
+	int verbose;
+#ifdef TCP_NOPUSH
+	int val;
+#endif
+
+	verbose = CHECK_FLAG('v');
+	curl = (purl != NULL) ? purl : URL;
 
 	if ((conn = fetch_connect(curl, af, verbose)) == NULL)
 		/* fetch_connect() has already set an error code */
@@ -780,6 +971,12 @@ http_connect(struct url *URL, struct url *purl, const char *flags, int *cached)
 				/* ignore */ ;
 			}
 		} while (h > hdr_end);
+		fetchFreeURL(conn->cache_url);
+		if ((conn->cache_url = fetchCopyURL(URL)) == NULL) {
+			fetch_syserr();
+			fetch_close(conn);
+			return (NULL);
+		}
 	}
 	if (strcasecmp(URL->scheme, SCHEME_HTTPS) == 0 &&
 	    fetch_ssl(conn, URL, verbose) == -1) {
@@ -802,6 +999,24 @@ http_connect(struct url *URL, struct url *purl, const char *flags, int *cached)
 	return (conn);
 }
 
+/*
+ * Connect to the correct HTTP server or proxy, reusing a cached
+ * connection if possible.
+ */
+static conn_t *
+http_connect(struct url *URL, struct url *purl, const char *flags, int *cached)
+{
+	conn_t *conn;
+	int af;
+
+	af = http_af(flags);
+	if ((conn = fetch_cache_get(http_cache_url(URL, purl), af)) != NULL) {
+		*cached = 1;
+		return (conn);
+	}
+	return (http_open(URL, purl, flags, af));
+}
+
 static struct url *
 http_get_proxy(struct url * url, const char *flags)
 {
@@ -989,7 +1204,11 @@ http_request(struct url *URL, const char *op, struct url_stat *us,
 		 */
 		http_cmd(conn, "Accept: */*\r\n");
 
-		if (url->offset > 0)
+		if (url->length > 0)
+			http_cmd(conn, "Range: bytes=%lld-%lld\r\n",
+			    (long long)url->offset,
+			    (long long)(url->offset + (off_t)url->length - 1));
+		else if (url->offset > 0)
 			http_cmd(conn, "Range: bytes=%lld-\r\n", (long long)url->offset);
 
 		http_cmd(conn, "\r\n");
@@ -1195,7 +1414,9 @@ http_request(struct url *URL, const char *op, struct url_stat *us,
 	if (clength != -1)
 		length = offset + clength;
 
-	if (length != -1 && size != -1 && length != size) {
+	/* a bounded range ends before the end of the document */
+	if (length != -1 && size != -1 && length != size &&
+	    (length > size || conn->err != HTTP_PARTIAL || URL->length == 0)) {
 		http_seterr(HTTP_PROTOCOL_ERROR);
 		goto ouch;
 	}
@@ -1288,6 +1509,34 @@ fetchGetHTTP(struct url *URL, const char *flags)
 	return (fetchXGetHTTP(URL, NULL, flags));
 }
 
+/*
+ * Open connections to the server (or proxy) of the URL and put them
+ * into the connection cache, so that up to n of them are cached.
+ * Returns the number of new connections.
+ */
+int
+fetchPrewarmHTTP(struct url *URL, int n, const char *flags)
+{
+	struct url *purl;
+	conn_t *conn;
+	int af, opened = 0;
+
+	if (!URL->port)
+		URL->port = fetch_default_port(URL->scheme);
+	purl = http_get_proxy(URL, flags);
+	af = http_af(flags);
+
+	for (n -= fetch_cache_count(http_cache_url(URL, purl), af); n > 0; n--) {
+		if ((conn = http_open(URL, purl, flags, af)) == NULL)
+			break;
+		fetch_cache_put(conn, fetch_close);
+		opened++;
+	}
+	fetchFreeURL(purl);
+
+	return (opened);
+}
+
 /*
  * Store a file by HTTP
  */
@@ -0,0 +1,460 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/*
+ * Content-addressed file store: regular files extracted from packages
+ * are kept in <metadir>/store/<xx>/<sha256>, files with the same SHA256
+ * hash in other packages are then reflinked or hardlinked from it
+ * rather than extracted again.
+ *
+ * 	- reflink: store files are independent copies sharing its
+ * 	  data blocks (FICLONE), only supported by some filesystems.
+ * 	- hardlink: store files share the inode of installed files,
+ * 	  only files with the same permissions, owner and modification
+ * 	  time can be shared.
+ */
+#define FILESTORE_DIR	"store"
+
+struct storeitem {
+	char *sha256;		/* hash key */
+	UT_hash_handle hh;
+};
+
+static bool
+filestore_path(struct xbps_handle *xhp, const char *sha256,
+		char *path, size_t len)
+{
+	int r;
+
+	if (strlen(sha256) != XBPS_SHA256_SIZE-1 || strchr(sha256, '/'))
+		return false;
+
+	r = snprintf(path, len, "%s/%s/%.2s/%s", xhp->metadir,
+	    FILESTORE_DIR, sha256, sha256);
+	return r > 0 && (size_t)r < len;
+}
+
+/*
+ * Creates the missing parent directories of \a file, as done by
+ * libarchive while extracting.
+ */
+static int
+mkparent(const char *file)
+{
+	char dir[PATH_MAX], *p;
+
+	if (xbps_strlcpy(dir, file, sizeof(dir)) >= sizeof(dir))
+		return ENAMETOOLONG;
+	if ((p = strrchr(dir, '/')) == NULL)
+		return ENOENT;
+	*p = '\0';
+	if (xbps_mkpath(dir, 0755) == -1 && errno != EEXIST)
+		return errno;
+	return 0;
+}
+
+static bool
+entry_metadata_match(struct archive *ext, struct archive_entry *entry,
+		struct stat *st)
+{
+	if ((st->st_mode & 07777) != (archive_entry_mode(entry) & 07777) ||
+	    st->st_mtime != archive_entry_mtime(entry))
+		return false;
+	if (geteuid() != 0)
+		return true;
+	return st->st_uid == (uid_t)archive_write_disk_uid(ext,
+	    archive_entry_uname(entry), archive_entry_uid(entry)) &&
+	    st->st_gid == (gid_t)archive_write_disk_gid(ext,
+	    archive_entry_gname(entry), archive_entry_gid(entry));
+}
+
+#ifdef HAVE_FICLONE
+static int
+entry_set_metadata(struct archive *ext, struct archive_entry *entry, int fd)
+{
+	struct timespec ts[2];
+
+	if (geteuid() == 0 && fchown(fd,
+	    (uid_t)archive_write_disk_uid(ext, archive_entry_uname(entry),
+	    archive_entry_uid(entry)),
+	    (gid_t)archive_write_disk_gid(ext, archive_entry_gname(entry),
+	    archive_entry_gid(entry))) == -1)
+		return errno;
+	if (fchmod(fd, archive_entry_mode(entry) & 07777) == -1)
+		return errno;
+
+	ts[0].tv_sec = archive_entry_atime(entry);
+	ts[0].tv_nsec = archive_entry_atime_nsec(entry);
+	ts[1].tv_sec = archive_entry_mtime(entry);
+	ts[1].tv_nsec = archive_entry_mtime_nsec(entry);
+	if (!archive_entry_atime_is_set(entry))
+		ts[0].tv_nsec = UTIME_NOW;
+	if (futimens(fd, ts) == -1)
+		return errno;
+
+	return 0;
+}
+
+static int
+reflink_get(const char *path, struct archive *ext,
+		struct archive_entry *entry, const char *file)
+{
+	int sfd, fd, rv = 0;
+
+	if ((sfd = open(path, O_RDONLY|O_CLOEXEC)) == -1)
+		return errno;
+
+	(void)unlink(file);
+	fd = open(file, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, 0600);
+	if (fd == -1 && errno == ENOENT && (rv = mkparent(file)) == 0)
+		fd = open(file, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC,
+		    0600);
+	if (fd == -1) {
+		if (rv == 0)
+			rv = errno;
+		close(sfd);
+		return rv;
+	}
+	if (ioctl(fd, FICLONE, sfd) == -1)
+		rv = errno;
+	else
+		rv = entry_set_metadata(ext, entry, fd);
+
+	close(sfd);
+	if (close(fd) == -1 && rv == 0)
+		rv = errno;
+	if (rv != 0)
+		(void)unlink(file);
+
+	return rv;
+}
+
+static int
+reflink_put(const char *path, const char *file)
+{
+	char tmp[PATH_MAX];
+	int sfd, fd, rv = 0;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		return ENAMETOOLONG;
+	if ((sfd = open(file, O_RDONLY|O_NOFOLLOW|O_CLOEXEC)) == -1)
+		return errno;
+	if ((fd = mkstemp(tmp)) == -1) {
+		rv = errno;
+		close(sfd);
+		return rv;
+	}
+	if (ioctl(fd, FICLONE, sfd) == -1 || fchmod(fd, 0444) == -1)
+		rv = errno;
+
+	close(sfd);
+	if (close(fd) == -1 && rv == 0)
+		rv = errno;
+	if (rv == 0 && rename(tmp, path) == -1)
+		rv = errno;
+	if (rv != 0)
+		(void)unlink(tmp);
+
+	return rv;
+}
+#endif
+
+/*
+ * Verifies the store file \a path against its SHA256 hash \a sha256,
+ * through the hash cache if enabled, and stores its digest in \a digest.
+ * A store file modified in place is removed and ENOENT returned.
+ */
+static int
+store_verify(struct xbps_handle *xhp, const char *path, const char *sha256,
+		unsigned char *digest)
+{
+	struct xbps_sha256_item item;
+	int rv;
+
+	memset(&item, 0, sizeof(item));
+	item.file = path;
+	item.sha256 = sha256;
+	item.cache = (xhp->flags & XBPS_FLAG_HASH_CACHE);
+	if ((rv = xbps_file_sha256_batch(&item, 1, 1)) == ERANGE) {
+		xbps_dbg_printf(xhp, "[filestore] `%s' was modified, "
+		    "removing it\n", path);
+		(void)unlink(path);
+		return ENOENT;
+	} else if (rv != 0) {
+		return rv;
+	}
+	memcpy(digest, item.digest, sizeof(item.digest));
+	return 0;
+}
+
+/*
+ * Creates the file of the archive entry \a entry from the store file
+ * with the SHA256 hash \a sha256, verified against it first; its
+ * digest is stored in \a digest.
+ * Returns 0 on success, ENOENT if the file is not in the store or can't
+ * be shared, an errno value otherwise.
+ */
+int HIDDEN
+xbps_filestore_get(struct xbps_handle *xhp, struct archive *ext,
+		struct archive_entry *entry, const char *sha256,
+		unsigned char *digest)
+{
+	const char *file = archive_entry_pathname(entry);
+	char path[PATH_MAX];
+	struct stat st;
+	int rv;
+
+	if (!filestore_path(xhp, sha256, path, sizeof(path)))
+		return EINVAL;
+	if (lstat(path, &st) == -1)
+		return errno;
+	if (!S_ISREG(st.st_mode))
+		return EINVAL;
+	if (st.st_size != archive_entry_size(entry)) {
+		/* modified in place, drop it */
+		(void)unlink(path);
+		return ENOENT;
+	}
+
+	if (xhp->flags & XBPS_FLAG_FILESTORE_HARDLINK) {
+		/* the inode is shared, all its metadata must match */
+		if (!entry_metadata_match(ext, entry, &st))
+			return ENOENT;
+		if ((rv = store_verify(xhp, path, sha256, digest)) != 0)
+			return rv;
+		(void)unlink(file);
+		if (link(path, file) == 0)
+			return 0;
+		if (errno != ENOENT)
+			return errno;
+		if ((rv = mkparent(file)) != 0)
+			return rv;
+		if (link(path, file) == -1)
+			return errno;
+		return 0;
+	}
+#ifdef HAVE_FICLONE
+	if ((rv = store_verify(xhp, path, sha256, digest)) != 0)
+		return rv;
+	return reflink_get(path, ext, entry, file);
+#else
+	(void)ext;
+	(void)entry;
+	(void)digest;
+	return ENOTSUP;
+#endif
+}
+
+/*
+ * Adds the extracted file \a file with the SHA256 hash \a sha256
+ * to the store, if it's not there yet.
+ * Returns 0 on success, an errno value otherwise.
+ */
+int HIDDEN
+xbps_filestore_put(struct xbps_handle *xhp, const char *sha256,
+		const char *file)
+{
+	char path[PATH_MAX], *p;
+
+	if (!filestore_path(xhp, sha256, path, sizeof(path)))
+		return EINVAL;
+	if (access(path, F_OK) == 0)
+		return 0;
+
+	p = strrchr(path, '/');
+	*p = '\0';
+	if (xbps_mkpath(path, 0755) == -1 && errno != EEXIST)
+		return errno;
+	*p = '/';
+
+	if (xhp->flags & XBPS_FLAG_FILESTORE_HARDLINK) {
+		if (link(file, path) == -1 && errno != EEXIST)
+			return errno;
+		return 0;
+	}
+#ifdef HAVE_FICLONE
+	return reflink_put(path, file);
+#else
+	return ENOTSUP;
+#endif
+}
+
+static int
+storeitems_add(struct storeitem **items, xbps_dictionary_t filesd)
+{
+	struct storeitem *item;
+	xbps_array_t array;
+	xbps_dictionary_t d;
+	const char *sha256;
+
+	array = xbps_dictionary_get(filesd, "files");
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		d = xbps_array_get(array, i);
+		if (!xbps_dictionary_get_cstring_nocopy(d, "sha256", &sha256))
+			continue;
+		HASH_FIND_STR(*items, sha256, item);
+		if (item != NULL)
+			continue;
+		if ((item = malloc(sizeof(*item))) == NULL)
+			return ENOMEM;
+		if ((item->sha256 = strdup(sha256)) == NULL) {
+			free(item);
+			return ENOMEM;
+		}
+		HASH_ADD_KEYPTR(hh, *items, item->sha256,
+		    strlen(item->sha256), item);
+	}
+	return 0;
+}
+
+static void
+storeitems_free(struct storeitem **items)
+{
+	struct storeitem *item, *itmp;
+
+	HASH_ITER(hh, *items, item, itmp) {
+		HASH_DEL(*items, item);
+		free(item->sha256);
+		free(item);
+	}
+}
+
+static int
+clean_subdir(struct storeitem *items, const char *dir, bool dry_run,
+		size_t *nfiles)
+{
+	struct storeitem *item;
+	struct dirent *dp;
+	DIR *dirp;
+	char *path;
+	int rv = 0;
+
+	if ((dirp = opendir(dir)) == NULL)
+		return errno;
+
+	while ((dp = readdir(dirp)) != NULL) {
+		if (dp->d_name[0] == '.')
+			continue;
+		HASH_FIND_STR(items, dp->d_name, item);
+		if (item != NULL)
+			continue;
+		path = xbps_xasprintf("%s/%s", dir, dp->d_name);
+		if (!dry_run && unlink(path) == -1 && errno != ENOENT) {
+			rv = errno;
+			free(path);
+			break;
+		}
+		free(path);
+		(*nfiles)++;
+	}
+	closedir(dirp);
+	return rv;
+}
+
+int
+xbps_filestore_clean(struct xbps_handle *xhp, bool dry_run, size_t *nfiles)
+{
+	struct storeitem *items = NULL;
+	xbps_dictionary_t filesd;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	struct dirent *dp;
+	DIR *dirp;
+	char *store, *dir;
+	size_t n = 0;
+	int rv;
+
+	store = xbps_xasprintf("%s/%s", xhp->metadir, FILESTORE_DIR);
+	if ((dirp = opendir(store)) == NULL) {
+		rv = errno;
+		free(store);
+		return rv == ENOENT ? 0 : rv;
+	}
+	/*
+	 * Collect the SHA256 hashes of all installed files.
+	 */
+	if ((rv = xbps_pkgdb_init(xhp)) != 0 && rv != ENOENT) {
+		closedir(dirp);
+		free(store);
+		return rv;
+	}
+	rv = 0;
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	while (iter && (obj = xbps_object_iterator_next(iter))) {
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
+
+		if (strncmp(pkgname, "_XBPS_", 6) == 0)
+			continue;
+		if ((filesd = xbps_pkgdb_get_pkg_files(xhp, pkgname)) == NULL)
+			continue;
+		rv = storeitems_add(&items, filesd);
+		xbps_object_release(filesd);
+		if (rv != 0)
+			break;
+	}
+	if (iter != NULL)
+		xbps_object_iterator_release(iter);
+	/*
+	 * And remove the store files not matching any of them.
+	 */
+	while (rv == 0 && (dp = readdir(dirp)) != NULL) {
+		if (dp->d_name[0] == '.')
+			continue;
+		dir = xbps_xasprintf("%s/%s", store, dp->d_name);
+		rv = clean_subdir(items, dir, dry_run, &n);
+		if (!dry_run)
+			(void)rmdir(dir);
+		free(dir);
+		if (rv == ENOTDIR)
+			rv = 0;
+	}
+	closedir(dirp);
+	storeitems_free(&items);
+	free(store);
+
+	if (nfiles != NULL)
+		*nfiles = n;
+
+	return rv;
+}
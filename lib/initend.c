@@ -144,6 +144,9 @@ xbps_init(struct xbps_handle *xhp)
 	if (xbps_path_clean(xhp->metadir) == -1)
 		return ENOTSUP;
 
+	if ((rv = xbps_repo_mirrors_init(xhp)) != 0)
+		return rv;
+
 	xbps_dbg_printf(xhp, "rootdir=%s\n", xhp->rootdir);
 	xbps_dbg_printf(xhp, "metadir=%s\n", xhp->metadir);
 	xbps_dbg_printf(xhp, "cachedir=%s\n", xhp->cachedir);
@@ -172,5 +175,10 @@ xbps_end(struct xbps_handle *xhp)
 {
 	assert(xhp);
 
+	xbps_fetch_end(xhp);
+	xbps_repo_mirrors_release(xhp);
 	xbps_pkgdb_release(xhp);
+	xbps_matcher_free(xhp->preserved_matcher);
+	xbps_matcher_free(xhp->noextract_matcher);
+	xhp->preserved_matcher = xhp->noextract_matcher = NULL;
 }
@@ -0,0 +1,263 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/*
+ * Compiled form of a list of fnmatch(3) patterns, as used by
+ * xbps_patterns_match(): the last matching pattern wins, and
+ * patterns starting with `!' negate the match.
+ *
+ * Patterns are split in three sets, each pattern keeps its position
+ * in the list:
+ *
+ *  - literals (no wildcards) in a hash table;
+ *  - prefixes (a single trailing `*') in a trie;
+ *  - the remaining globs, matched with fnmatch(3) in reverse order
+ *    and only if they come after the best literal or prefix match.
+ */
+struct match_literal {
+	char *str;
+	unsigned int idx;
+	bool negate;
+	UT_hash_handle hh;
+};
+
+struct match_node {
+	struct match_node *child;
+	struct match_node *next;
+	unsigned int idx;
+	bool negate;
+	char c;
+};
+
+struct match_glob {
+	char *pattern;
+	unsigned int idx;
+	bool negate;
+};
+
+struct xbps_matcher {
+	struct match_literal *literals;
+	struct match_node root;
+	struct match_glob *globs;
+	unsigned int nglobs;
+};
+
+static int
+add_literal(struct xbps_matcher *m, const char *str, unsigned int idx,
+		bool negate)
+{
+	struct match_literal *lit;
+
+	HASH_FIND_STR(m->literals, str, lit);
+	if (lit == NULL) {
+		if ((lit = calloc(1, sizeof(*lit))) == NULL)
+			return errno;
+		if ((lit->str = strdup(str)) == NULL) {
+			free(lit);
+			return errno;
+		}
+		HASH_ADD_KEYPTR(hh, m->literals, lit->str, strlen(lit->str), lit);
+	}
+	lit->idx = idx;
+	lit->negate = negate;
+	return 0;
+}
+
+static int
+add_prefix(struct xbps_matcher *m, const char *prefix, size_t len,
+		unsigned int idx, bool negate)
+{
+	struct match_node *node = &m->root, *n;
+
+	for (size_t i = 0; i < len; i++) {
+		for (n = node->child; n != NULL; n = n->next) {
+			if (n->c == prefix[i])
+				break;
+		}
+		if (n == NULL) {
+			if ((n = calloc(1, sizeof(*n))) == NULL)
+				return errno;
+			n->c = prefix[i];
+			n->next = node->child;
+			node->child = n;
+		}
+		node = n;
+	}
+	node->idx = idx;
+	node->negate = negate;
+	return 0;
+}
+
+static int
+add_glob(struct xbps_matcher *m, const char *pattern, unsigned int idx,
+		bool negate)
+{
+	struct match_glob *globs;
+
+	globs = realloc(m->globs, (m->nglobs + 1) * sizeof(*globs));
+	if (globs == NULL)
+		return errno;
+	m->globs = globs;
+	if ((globs[m->nglobs].pattern = strdup(pattern)) == NULL)
+		return errno;
+	globs[m->nglobs].idx = idx;
+	globs[m->nglobs].negate = negate;
+	m->nglobs++;
+	return 0;
+}
+
+static int
+add_pattern(struct xbps_matcher *m, const char *pattern, unsigned int idx)
+{
+	const char *p;
+	bool negate;
+
+	if ((negate = *pattern == '!') || *pattern == '\\')
+		pattern++;
+
+	p = pattern + strcspn(pattern, "*?[\\");
+	if (*p == '\0')
+		return add_literal(m, pattern, idx, negate);
+	if (p[0] == '*' && p[1] == '\0')
+		return add_prefix(m, pattern, p - pattern, idx, negate);
+
+	return add_glob(m, pattern, idx, negate);
+}
+
+static void
+free_nodes(struct match_node *node)
+{
+	struct match_node *next;
+
+	for (; node != NULL; node = next) {
+		next = node->next;
+		free_nodes(node->child);
+		free(node);
+	}
+}
+
+void HIDDEN
+xbps_matcher_free(struct xbps_matcher *m)
+{
+	struct match_literal *lit, *tmp;
+
+	if (m == NULL)
+		return;
+
+	HASH_ITER(hh, m->literals, lit, tmp) {
+		HASH_DEL(m->literals, lit);
+		free(lit->str);
+		free(lit);
+	}
+	free_nodes(m->root.child);
+	for (unsigned int i = 0; i < m->nglobs; i++)
+		free(m->globs[i].pattern);
+	free(m->globs);
+	free(m);
+}
+
+struct xbps_matcher HIDDEN *
+xbps_matcher_new(xbps_array_t patterns, bool literal)
+{
+	struct xbps_matcher *m;
+	const char *pattern;
+	unsigned int idx = 0;
+	int rv;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return NULL;
+
+	for (unsigned int i = 0; i < xbps_array_count(patterns); i++) {
+		if (!xbps_array_get_cstring_nocopy(patterns, i, &pattern) ||
+		    pattern == NULL)
+			continue;
+		/* positions start at 1, 0 means no match */
+		idx++;
+		if (literal)
+			rv = add_literal(m, pattern, idx, false);
+		else
+			rv = add_pattern(m, pattern, idx);
+		if (rv != 0) {
+			xbps_matcher_free(m);
+			errno = rv;
+			return NULL;
+		}
+	}
+	return m;
+}
+
+bool HIDDEN
+xbps_matcher_match(const struct xbps_matcher *m, const char *path)
+{
+	const struct match_literal *lit;
+	const struct match_node *node;
+	unsigned int best = 0;
+	bool negate = false;
+
+	assert(path);
+
+	if (m == NULL)
+		return false;
+
+	HASH_FIND_STR(m->literals, path, lit);
+	if (lit != NULL) {
+		best = lit->idx;
+		negate = lit->negate;
+	}
+	node = &m->root;
+	for (const char *p = path;; p++) {
+		if (node->idx > best) {
+			best = node->idx;
+			negate = node->negate;
+		}
+		if (*p == '\0')
+			break;
+		for (node = node->child; node != NULL; node = node->next) {
+			if (node->c == *p)
+				break;
+		}
+		if (node == NULL)
+			break;
+	}
+	for (unsigned int i = m->nglobs; i-- > 0;) {
+		if (m->globs[i].idx <= best)
+			break;
+		if (fnmatch(m->globs[i].pattern, path, 0) == 0) {
+			best = m->globs[i].idx;
+			negate = m->globs[i].negate;
+			break;
+		}
+	}
+	return best != 0 && !negate;
+}
@@ -28,10 +28,59 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 
 
+/*
+ * Scripts are passed to the shell as the command string of `sh -c',
+ * to not create, sync and remove a temporary file for every action.
+ * Larger scripts are still executed from a temporary file.
+ */
+#define SCRIPT_ARGMAX	(64 * 1024)
+
+static const struct shell {
+	const char *path;
+	const char *applet;
+} shells[] = {
+	{ "/bin/sh", NULL },
+	{ "/bin/dash", NULL },
+	{ "/bin/bash", NULL },
+	{ "/bin/busybox", "sh" },
+	{ "/bin/busybox.static", "sh" },
+	{ NULL, NULL }
+};
+
+static const struct shell *shell;
+static pthread_mutex_t shell_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Finds a shell that can be used to execute the scripts, once it's found
+ * it's used for all scripts; if none is found it's tried again later,
+ * a shell might be installed by the transaction.
+ */
+static const struct shell *
+find_shell(void)
+{
+	const struct shell *sh;
+
+	pthread_mutex_lock(&shell_lock);
+	if (shell == NULL) {
+		for (sh = shells; sh->path != NULL; sh++) {
+			if (access(sh->path, X_OK) == 0) {
+				shell = sh;
+				break;
+			}
+		}
+	}
+	sh = shell;
+	pthread_mutex_unlock(&shell_lock);
+
+	return sh;
+}
+
 int
 xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		     const void *blob,
@@ -40,16 +89,9 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		     const char *action,
 		     bool update)
 {
-	int i;
-	ssize_t ret;
-	const char *tmpdir, *version;
-	const char *shells[] = {
-		"/bin/sh",
-		"/bin/dash",
-		"/bin/bash",
-		NULL
-	};
-	char pkgname[XBPS_NAME_SIZE], *fpath;
+	const struct shell *sh;
+	const char *tmpdir, *version, *script;
+	char pkgname[XBPS_NAME_SIZE], *buf = NULL, *fpath = NULL;
 	int fd, rv;
 
 	assert(blob);
@@ -62,6 +104,37 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		return 0;
 	}
 
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
+		abort();
+	}
+	version = xbps_pkg_version(pkgver);
+	assert(version);
+
+	if ((sh = find_shell()) == NULL)
+		return -1;
+
+	/* change cwd to rootdir to exec the script */
+	if (chdir(xhp->rootdir) == -1)
+		return errno;
+
+	if (blobsiz < SCRIPT_ARGMAX && memchr(blob, '\0', blobsiz) == NULL) {
+		if ((buf = malloc(blobsiz + 1)) == NULL)
+			return errno;
+		memcpy(buf, blob, blobsiz);
+		buf[blobsiz] = '\0';
+		if (sh->applet) {
+			rv = xbps_file_exec(xhp, sh->path, sh->applet, "-c",
+			    buf, ".xbps-script", action, pkgname, version,
+			    update ? "yes" : "no", "no", xhp->native_arch, NULL);
+		} else {
+			rv = xbps_file_exec(xhp, sh->path, "-c", buf,
+			    ".xbps-script", action, pkgname, version,
+			    update ? "yes" : "no", "no", xhp->native_arch, NULL);
+		}
+		free(buf);
+		return rv;
+	}
+
 	if (strcmp(xhp->rootdir, "/") == 0) {
 		tmpdir = getenv("TMPDIR");
 		if (tmpdir == NULL)
@@ -72,63 +145,38 @@ xbps_pkg_exec_buffer(struct xbps_handle *xhp,
 		fpath = strdup(".xbps-script-XXXXXX");
 	}
 
-	/* change cwd to rootdir to exec the script */
-	if (chdir(xhp->rootdir) == -1) {
-		rv = errno;
-		goto out;
-	}
-
 	/* Create temp file to run script */
 	if ((fd = mkstemp(fpath)) == -1) {
 		rv = errno;
 		xbps_dbg_printf(xhp, "%s: mkstemp %s\n",
 		    __func__, strerror(errno));
-		goto out;
+		free(fpath);
+		return rv;
 	}
 	/* write blob to our temp fd */
-	ret = write(fd, blob, blobsiz);
-	if (ret == -1) {
-		rv = errno;
-		xbps_dbg_printf(xhp, "%s: write %s\n",
-		    __func__, strerror(errno));
-		close(fd);
-		goto out;
+	script = blob;
+	for (size_t off = 0; off < blobsiz;) {
+		ssize_t ret = write(fd, script + off, blobsiz - off);
+		if (ret == -1) {
+			rv = errno;
+			xbps_dbg_printf(xhp, "%s: write %s\n",
+			    __func__, strerror(errno));
+			close(fd);
+			goto out;
+		}
+		off += ret;
 	}
 	fchmod(fd, 0750);
-#ifdef HAVE_FDATASYNC
-	fdatasync(fd);
-#else
-	fsync(fd);
-#endif
 	close(fd);
 
-	/* exec script */
-	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
-		abort();
-	}
-	version = xbps_pkg_version(pkgver);
-	assert(version);
-
-	// find a shell that can be used to execute the script.
-	for (i = 0; shells[i] != NULL; i++) {
-		if (access(shells[i], X_OK) == 0) {
-			break;
-		}
-	}
-	if (shells[i] != NULL) {
-		rv = xbps_file_exec(xhp, shells[i], fpath, action, pkgname, version,
-				update ? "yes" : "no",
-				"no", xhp->native_arch, NULL);
-	} else if (access("/bin/busybox", X_OK) == 0) {
-		rv = xbps_file_exec(xhp, "/bin/busybox", "sh", fpath, action, pkgname, version,
-				update ? "yes" : "no",
-				"no", xhp->native_arch, NULL);
-	} else if (access("/bin/busybox.static", X_OK) == 0) {
-		rv = xbps_file_exec(xhp, "/bin/busybox.static", "sh", fpath, action, pkgname, version,
-				update ? "yes" : "no",
-				"no", xhp->native_arch, NULL);
+	if (sh->applet) {
+		rv = xbps_file_exec(xhp, sh->path, sh->applet, fpath, action,
+		    pkgname, version, update ? "yes" : "no", "no",
+		    xhp->native_arch, NULL);
 	} else {
-		rv = -1;
+		rv = xbps_file_exec(xhp, sh->path, fpath, action, pkgname,
+		    version, update ? "yes" : "no", "no",
+		    xhp->native_arch, NULL);
 	}
 
 out:
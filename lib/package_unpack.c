@@ -32,8 +32,57 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <pthread.h>
+
+#include <openssl/evp.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <linux/openat2.h>
+#endif
 
 #include "xbps_api_impl.h"
+#include "uthash.h"
+
+/*
+ * Per package hash table of files.plist entries, to avoid
+ * scanning the "files" and "conf_files" arrays for every
+ * archive entry.
+ */
+struct fileitem {
+	char *file;		/* hash key */
+	const char *sha256;
+	xbps_dictionary_t d;
+	bool conf;
+	UT_hash_handle hh;
+};
+
+/*
+ * Set of directories, used to synchronize the directories with
+ * extracted files once per package in the strict durability mode.
+ */
+struct diritem {
+	char *dir;		/* hash key */
+	UT_hash_handle hh;
+};
+
+/*
+ * Extraction state of a package, shared by the file writers.
+ */
+struct unpack_ctx {
+	struct xbps_handle *xhp;
+	const char *pkgver;
+	struct archive *ext;
+	struct diritem *syncdirs;
+	struct xbps_unpack_cb_data *xucd;
+#ifdef HAVE_IO_URING
+	struct uring_batch *uring;
+#endif
+	bool statcheck;
+	bool hashcache;
+	bool strict;
+	bool filestore;
+};
 
 static int
 set_extract_flags(uid_t euid)
@@ -53,7 +102,7 @@ match_preserved_file(struct xbps_handle *xhp, const char *entry)
 {
 	const char *file;
 
-	if (xhp->preserved_files == NULL)
+	if (xhp->preserved_matcher == NULL)
 		return false;
 
 	if (entry[0] == '.' && entry[1] != '\0') {
@@ -63,7 +112,731 @@ match_preserved_file(struct xbps_handle *xhp, const char *entry)
 		file = entry;
 	}
 
-	return xbps_match_string_in_array(xhp->preserved_files, file);
+	return xbps_matcher_match(xhp->preserved_matcher, file);
+}
+
+static int
+fileitems_add(struct fileitem **items, xbps_dictionary_t filesd,
+		const char *key, bool conf)
+{
+	xbps_array_t array;
+	xbps_dictionary_t d;
+	struct fileitem *item;
+	const char *file;
+
+	array = xbps_dictionary_get(filesd, key);
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		d = xbps_array_get(array, i);
+		if (!xbps_dictionary_get_cstring_nocopy(d, "file", &file))
+			continue;
+		HASH_FIND_STR(*items, file, item);
+		if (item != NULL)
+			continue;
+		if ((item = calloc(1, sizeof (struct fileitem))) == NULL)
+			return ENOMEM;
+		item->file = __UNCONST(file);
+		item->d = d;
+		item->conf = conf;
+		xbps_dictionary_get_cstring_nocopy(d, "sha256", &item->sha256);
+		HASH_ADD_KEYPTR(hh, *items, item->file, strlen(item->file), item);
+	}
+	return 0;
+}
+
+static void
+fileitems_free(struct fileitem **items)
+{
+	struct fileitem *item, *itmp;
+
+	HASH_ITER(hh, *items, item, itmp) {
+		HASH_DEL(*items, item);
+		free(item);
+	}
+}
+
+static struct fileitem *
+fileitems_lookup(struct fileitem *items, const char *file)
+{
+	struct fileitem *item = NULL;
+
+	assert(file);
+
+	HASH_FIND_STR(items, file, item);
+	return item;
+}
+
+/*
+ * Returns true if the file on disk can be assumed to match the new
+ * package file without hashing it: its SHA256 hash did not change
+ * between the installed and new package and its stat data matches
+ * the data recorded in the installed files database.
+ */
+static bool
+file_stat_match(struct fileitem *curitems, struct fileitem *item,
+		struct archive_entry *entry, const struct stat *st)
+{
+	struct fileitem *cur;
+	uint64_t size = 0, mtime = 0, ino, ctim;
+
+	if (!S_ISREG(st->st_mode) || archive_entry_size(entry) != st->st_size)
+		return false;
+
+	cur = fileitems_lookup(curitems, item->file);
+	if (cur == NULL || cur->sha256 == NULL ||
+	    strcmp(cur->sha256, item->sha256) != 0)
+		return false;
+
+	/* xbps-create(1) omits zero size and mtime objects */
+	xbps_dictionary_get_uint64(cur->d, "size", &size);
+	xbps_dictionary_get_uint64(cur->d, "mtime", &mtime);
+	if (size != (uint64_t)st->st_size || mtime != (uint64_t)st->st_mtime)
+		return false;
+
+	/* recorded at extraction time */
+	if (xbps_dictionary_get_uint64(cur->d, "inode", &ino) &&
+	    ino != (uint64_t)st->st_ino)
+		return false;
+	if (xbps_dictionary_get_uint64(cur->d, "ctime", &ctim) &&
+	    ctim != (uint64_t)st->st_ctime)
+		return false;
+
+	return true;
+}
+
+/*
+ * Records inode and ctime of the extracted file into the new files
+ * database, to be trusted by file_stat_match() in the next update.
+ */
+static void
+file_stat_record(struct fileitem *item, const char *file)
+{
+	struct stat st;
+
+	if (lstat(file, &st) == -1 || !S_ISREG(st.st_mode))
+		return;
+
+	xbps_dictionary_set_uint64(item->d, "inode", (uint64_t)st.st_ino);
+	xbps_dictionary_set_uint64(item->d, "ctime", (uint64_t)st.st_ctime);
+}
+
+/*
+ * Adds the parent directory of \a file to the set \a dirs.
+ */
+static int
+diritems_add(struct diritem **dirs, const char *file)
+{
+	struct diritem *item = NULL;
+	const char *p;
+	size_t len;
+
+	if ((p = strrchr(file, '/')) == NULL)
+		return 0;
+	len = p - file;
+
+	HASH_FIND(hh, *dirs, file, len, item);
+	if (item != NULL)
+		return 0;
+	if ((item = calloc(1, sizeof (struct diritem))) == NULL)
+		return ENOMEM;
+	if ((item->dir = strndup(file, len)) == NULL) {
+		free(item);
+		return ENOMEM;
+	}
+	HASH_ADD_KEYPTR(hh, *dirs, item->dir, len, item);
+	return 0;
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Returns true if the parent directory of \a file is in the set \a dirs.
+ */
+static bool
+diritems_lookup(struct diritem *dirs, const char *file)
+{
+	struct diritem *item = NULL;
+	const char *p;
+
+	if ((p = strrchr(file, '/')) == NULL)
+		return false;
+
+	HASH_FIND(hh, dirs, file, (size_t)(p - file), item);
+	return item != NULL;
+}
+#endif
+
+/*
+ * Synchronizes and removes all directories from the set \a dirs.
+ * If \a sync is false they are only removed.
+ */
+static int
+diritems_flush(struct diritem **dirs, bool sync)
+{
+	struct diritem *item, *itmp;
+	int rv = 0, r;
+	char *buf;
+
+	HASH_ITER(hh, *dirs, item, itmp) {
+		HASH_DEL(*dirs, item);
+		if (sync && rv == 0) {
+			/* xbps_fsync_dir() syncs the parent of a path */
+			buf = xbps_xasprintf("%s/.", item->dir);
+			if ((r = xbps_fsync_dir(buf)) != 0 && r != ENOENT)
+				rv = r;
+			free(buf);
+		}
+		free(item->dir);
+		free(item);
+	}
+	return rv;
+}
+
+/*
+ * Extracts the current archive entry through the write disk object
+ * \a ext, computing the SHA256 digest of its data while it's written
+ * if \a digest is set. Returns 0 on success, an errno value otherwise.
+ */
+static int
+extract_entry(struct archive *ar, struct archive *ext,
+		struct archive_entry *entry, unsigned char *digest)
+{
+	EVP_MD_CTX *sha256 = NULL;
+	const void *buf;
+	size_t size;
+	la_int64_t offset, hashed = 0;
+	int r;
+
+	if (digest) {
+		if ((sha256 = EVP_MD_CTX_new()) == NULL)
+			return ENOMEM;
+		if (EVP_DigestInit_ex(sha256, EVP_sha256(), NULL) != 1) {
+			EVP_MD_CTX_free(sha256);
+			return EINVAL;
+		}
+	}
+
+	if (archive_write_header(ext, entry) != ARCHIVE_OK)
+		goto ext_error;
+
+	if (archive_entry_size(entry) > 0) {
+		while ((r = archive_read_data_block(ar, &buf, &size,
+		    &offset)) == ARCHIVE_OK) {
+			if (digest) {
+				/* sparse files: hash the holes too */
+				static const char zeros[4096];
+				while (hashed < offset) {
+					size_t n = sizeof zeros;
+					if ((la_int64_t)n > offset - hashed)
+						n = (size_t)(offset - hashed);
+					EVP_DigestUpdate(sha256, zeros, n);
+					hashed += n;
+				}
+				EVP_DigestUpdate(sha256, buf, size);
+				hashed += size;
+			}
+			if (archive_write_data_block(ext, buf, size,
+			    offset) != ARCHIVE_OK)
+				goto ext_error;
+		}
+		if (r != ARCHIVE_EOF) {
+			if ((r = archive_errno(ar)) == 0)
+				r = EIO;
+			EVP_MD_CTX_free(sha256);
+			return r;
+		}
+	}
+	if (archive_write_finish_entry(ext) != ARCHIVE_OK)
+		goto ext_error;
+
+	if (digest)
+		EVP_DigestFinal_ex(sha256, digest, NULL);
+	EVP_MD_CTX_free(sha256);
+
+	return 0;
+
+ext_error:
+	EVP_MD_CTX_free(sha256);
+	if ((r = archive_errno(ext)) == 0)
+		r = EIO;
+	return r;
+}
+
+/*
+ * Completes the extraction of the file \a pname: verifies its SHA256
+ * hash if \a digest is set, synchronizes it in the strict durability
+ * mode, records its stat data and runs the unpack callback.
+ * Returns 0 on success, an errno value otherwise.
+ */
+static int
+extract_done(struct unpack_ctx *ctx, struct fileitem *fileitem,
+		const char *pname, int type, const unsigned char *digest)
+{
+	struct xbps_handle *xhp = ctx->xhp;
+	int rv;
+
+	if (digest && !xbps_sha256_digest_compare(fileitem->sha256,
+	    strlen(fileitem->sha256), digest, XBPS_SHA256_DIGEST_SIZE)) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, ERANGE,
+		    ctx->pkgver, "%s: [unpack] SHA256 mismatch for extracted "
+		    "file `%s'", ctx->pkgver, pname);
+		return ERANGE;
+	}
+	if (digest && ctx->filestore && !fileitem->conf &&
+	    (rv = xbps_filestore_put(xhp, fileitem->sha256, pname)) != 0) {
+		xbps_dbg_printf(xhp, "%s: [unpack] failed to add `%s' to "
+		    "the file store: %s\n", ctx->pkgver, pname, strerror(rv));
+		if (rv == ENOTSUP || rv == EOPNOTSUPP || rv == ENOTTY ||
+		    rv == EXDEV)
+			ctx->filestore = false;
+	}
+	if (digest && ctx->hashcache && type == AE_IFREG)
+		(void)xbps_file_hash_cache_set(pname, digest);
+	if (ctx->strict && ((type == AE_IFREG &&
+	    (rv = xbps_fsync_file(pname)) != 0) ||
+	    (rv = diritems_add(&ctx->syncdirs, pname)) != 0)) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv,
+		    ctx->pkgver, "%s: [unpack] failed to sync file `%s': %s",
+		    ctx->pkgver, pname, strerror(rv));
+		return rv;
+	}
+	if (ctx->statcheck && fileitem && !fileitem->conf)
+		file_stat_record(fileitem, pname);
+	if (xhp->unpack_cb != NULL) {
+		ctx->xucd->entry = pname;
+		ctx->xucd->entry_extract_count++;
+		xbps_set_cb_unpack(xhp, ctx->xucd);
+	}
+	return 0;
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * io_uring(7) file writer: small regular files whose parent directory
+ * already exists are buffered, then created, written and closed in
+ * batches. Ownership, permissions and timestamps are still set with
+ * synchronous calls once a batch completes, io_uring has no opcodes
+ * for them. Files that can't be written this way are retried through
+ * the libarchive write disk object.
+ */
+#define URING_BATCH_FILES	64
+#define URING_BATCH_SIZE	(16*1024*1024)
+#define URING_MAX_FILESIZE	(1024*1024)
+#define URING_MAX_WORKERS	4
+
+#define URING_DATA(idx, op)	(((uint64_t)(idx) << 2) | (op))
+
+enum {
+	URING_OP_UNLINK = 0,
+	URING_OP_OPEN,
+	URING_OP_WRITE,
+	URING_OP_CLOSE
+};
+
+struct uring_item {
+	struct archive_entry *entry;
+	struct fileitem *fileitem;
+	struct open_how how;
+	char *buf;
+	size_t len;
+	int fd;
+	int error;
+	bool unlink;
+	bool verify;
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+};
+
+struct uring_batch {
+	struct xbps_uring ring;
+	struct uring_item items[URING_BATCH_FILES];
+	struct diritem *dirs;	/* known existing directories */
+	size_t nitems;
+	size_t size;
+	mode_t umask;
+	uid_t euid;
+	gid_t egid;
+};
+
+static struct uring_batch *
+uring_batch_new(struct xbps_handle *xhp)
+{
+	static const uint8_t ops[] = {
+		IORING_OP_UNLINKAT, IORING_OP_OPENAT2,
+		IORING_OP_WRITE, IORING_OP_CLOSE
+	};
+	struct uring_batch *batch;
+	int rv;
+
+	if ((batch = calloc(1, sizeof(*batch))) == NULL)
+		return NULL;
+
+	if ((rv = xbps_uring_init(&batch->ring, 2 * URING_BATCH_FILES,
+	    ops, __arraycount(ops))) != 0) {
+		xbps_dbg_printf(xhp, "[unpack] io_uring unavailable, "
+		    "using the default file writer: %s\n", strerror(rv));
+		free(batch);
+		return NULL;
+	}
+	xbps_uring_set_max_workers(&batch->ring, URING_MAX_WORKERS);
+	/*
+	 * Set by unpack_binary_pkg(), umask(2) can't be read without
+	 * changing it for the whole process.
+	 */
+	batch->umask = UNPACK_UMASK;
+	batch->euid = geteuid();
+	batch->egid = getegid();
+
+	return batch;
+}
+
+static void
+uring_batch_clear(struct uring_batch *batch)
+{
+	for (size_t i = 0; i < batch->nitems; i++) {
+		archive_entry_free(batch->items[i].entry);
+		free(batch->items[i].buf);
+	}
+	batch->nitems = batch->size = 0;
+}
+
+static void
+uring_batch_free(struct uring_batch *batch)
+{
+	if (batch == NULL)
+		return;
+
+	uring_batch_clear(batch);
+	diritems_flush(&batch->dirs, false);
+	xbps_uring_fini(&batch->ring);
+	free(batch);
+}
+
+/*
+ * Returns true if \a entry can be written by the io_uring writer.
+ */
+static bool
+uring_eligible(struct uring_batch *batch, struct archive_entry *entry)
+{
+	const char *pname = archive_entry_pathname(entry);
+	struct stat st;
+	const char *p;
+	char *dir;
+	bool rv;
+
+	if (archive_entry_filetype(entry) != AE_IFREG ||
+	    archive_entry_hardlink(entry) != NULL ||
+	    archive_entry_size(entry) > URING_MAX_FILESIZE)
+		return false;
+
+	if ((p = strrchr(pname, '/')) == NULL)
+		return false;
+	if (diritems_lookup(batch->dirs, pname))
+		return true;
+
+	if ((dir = strndup(pname, (size_t)(p - pname))) == NULL)
+		return false;
+	rv = lstat(dir, &st) == 0 && S_ISDIR(st.st_mode) &&
+	    diritems_add(&batch->dirs, pname) == 0;
+	free(dir);
+
+	return rv;
+}
+
+/*
+ * Waits for \a count completions and stores its results
+ * in the batch items.
+ */
+static int
+uring_complete(struct uring_batch *batch, unsigned count)
+{
+	struct uring_item *item;
+	struct io_uring_cqe cqe;
+	int rv;
+
+	if ((rv = xbps_uring_submit(&batch->ring)) != 0)
+		return rv;
+
+	while (count-- > 0) {
+		if ((rv = xbps_uring_wait_cqe(&batch->ring, &cqe)) != 0)
+			return rv;
+
+		item = &batch->items[cqe.user_data >> 2];
+		switch (cqe.user_data & 3) {
+		case URING_OP_UNLINK:
+			/* a failed unlink makes the O_EXCL open fail */
+			break;
+		case URING_OP_OPEN:
+			if (cqe.res >= 0)
+				item->fd = cqe.res;
+			else
+				item->error = -cqe.res;
+			break;
+		case URING_OP_WRITE:
+			if (cqe.res < 0)
+				item->error = -cqe.res;
+			else if ((size_t)cqe.res != item->len)
+				item->error = EIO;
+			break;
+		case URING_OP_CLOSE:
+			if (cqe.res == -ECANCELED)
+				(void)close(item->fd);
+			else if (cqe.res < 0 && item->error == 0)
+				item->error = -cqe.res;
+			item->fd = -1;
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Sets the ownership, permissions and timestamps of a file created
+ * by the io_uring writer, as done by ARCHIVE_EXTRACT_{OWNER,PERM,TIME}.
+ */
+static int
+uring_set_metadata(struct unpack_ctx *ctx, struct archive_entry *entry)
+{
+	struct uring_batch *batch = ctx->uring;
+	const char *pname = archive_entry_pathname(entry);
+	mode_t mode = archive_entry_mode(entry) & 07777;
+	struct timespec ts[2];
+	la_int64_t uid, gid;
+
+	if (batch->euid == 0) {
+		uid = archive_write_disk_uid(ctx->ext,
+		    archive_entry_uname(entry), archive_entry_uid(entry));
+		gid = archive_write_disk_gid(ctx->ext,
+		    archive_entry_gname(entry), archive_entry_gid(entry));
+		if ((uid != batch->euid || gid != batch->egid) &&
+		    fchownat(AT_FDCWD, pname, (uid_t)uid, (gid_t)gid,
+		    AT_SYMLINK_NOFOLLOW) == -1)
+			return errno;
+	}
+	if ((mode & (batch->umask|S_ISUID|S_ISGID|S_ISVTX)) &&
+	    fchmodat(AT_FDCWD, pname, mode, 0) == -1)
+		return errno;
+
+	ts[0].tv_nsec = ts[1].tv_nsec = UTIME_OMIT;
+	if (archive_entry_atime_is_set(entry)) {
+		ts[0].tv_sec = archive_entry_atime(entry);
+		ts[0].tv_nsec = archive_entry_atime_nsec(entry);
+	}
+	if (archive_entry_mtime_is_set(entry)) {
+		ts[1].tv_sec = archive_entry_mtime(entry);
+		ts[1].tv_nsec = archive_entry_mtime_nsec(entry);
+	}
+	if ((ts[0].tv_nsec != UTIME_OMIT || ts[1].tv_nsec != UTIME_OMIT) &&
+	    utimensat(AT_FDCWD, pname, ts, AT_SYMLINK_NOFOLLOW) == -1)
+		return errno;
+
+	return 0;
+}
+
+/*
+ * Writes a batch item through the libarchive write disk object.
+ */
+static int
+uring_fallback(struct unpack_ctx *ctx, struct uring_item *item)
+{
+	int rv;
+
+	if (archive_write_header(ctx->ext, item->entry) != ARCHIVE_OK ||
+	    (item->len > 0 && archive_write_data(ctx->ext, item->buf,
+	    item->len) != (la_ssize_t)item->len) ||
+	    archive_write_finish_entry(ctx->ext) != ARCHIVE_OK) {
+		if ((rv = archive_errno(ctx->ext)) == 0)
+			rv = EIO;
+		return rv;
+	}
+	return 0;
+}
+
+/*
+ * Writes all files in the batch to disk.
+ * Returns 0 on success, an errno value otherwise.
+ */
+static int
+uring_flush(struct unpack_ctx *ctx)
+{
+	struct xbps_handle *xhp = ctx->xhp;
+	struct uring_batch *batch = ctx->uring;
+	struct uring_item *item;
+	struct io_uring_sqe *sqe;
+	const char *pname;
+	unsigned count = 0;
+	int rv = 0;
+
+	if (batch->nitems == 0)
+		return 0;
+	/*
+	 * Remove existing files and create the new ones.
+	 */
+	for (size_t i = 0; i < batch->nitems; i++) {
+		item = &batch->items[i];
+		pname = archive_entry_pathname(item->entry);
+		if (item->unlink) {
+			sqe = xbps_uring_get_sqe(&batch->ring);
+			assert(sqe);
+			sqe->opcode = IORING_OP_UNLINKAT;
+			sqe->flags = IOSQE_IO_HARDLINK;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uintptr_t)pname;
+			sqe->user_data = URING_DATA(i, URING_OP_UNLINK);
+			count++;
+		}
+		/* same restrictions as ARCHIVE_EXTRACT_SECURE_* */
+		item->how.flags = O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC;
+		item->how.mode = archive_entry_mode(item->entry) & 07777;
+		item->how.resolve = RESOLVE_BENEATH|RESOLVE_NO_SYMLINKS;
+		sqe = xbps_uring_get_sqe(&batch->ring);
+		assert(sqe);
+		sqe->opcode = IORING_OP_OPENAT2;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)pname;
+		sqe->len = sizeof(item->how);
+		sqe->off = (uintptr_t)&item->how;
+		sqe->user_data = URING_DATA(i, URING_OP_OPEN);
+		count++;
+	}
+	if ((rv = uring_complete(batch, count)) != 0)
+		goto fail;
+	/*
+	 * Write and close the created files.
+	 */
+	count = 0;
+	for (size_t i = 0; i < batch->nitems; i++) {
+		item = &batch->items[i];
+		if (item->fd == -1)
+			continue;
+		if (item->len > 0) {
+			sqe = xbps_uring_get_sqe(&batch->ring);
+			assert(sqe);
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->fd = item->fd;
+			sqe->addr = (uintptr_t)item->buf;
+			sqe->len = (uint32_t)item->len;
+			sqe->user_data = URING_DATA(i, URING_OP_WRITE);
+			count++;
+		}
+		sqe = xbps_uring_get_sqe(&batch->ring);
+		assert(sqe);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = item->fd;
+		sqe->user_data = URING_DATA(i, URING_OP_CLOSE);
+		count++;
+	}
+	if ((rv = uring_complete(batch, count)) != 0)
+		goto fail;
+
+	for (size_t i = 0; i < batch->nitems; i++) {
+		item = &batch->items[i];
+		pname = archive_entry_pathname(item->entry);
+		if (item->error == 0)
+			item->error = uring_set_metadata(ctx, item->entry);
+		if (item->error != 0) {
+			xbps_dbg_printf(xhp, "%s: [unpack] io_uring failed to "
+			    "write `%s' (%s), retrying\n", ctx->pkgver, pname,
+			    strerror(item->error));
+			if ((rv = uring_fallback(ctx, item)) != 0) {
+				xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
+				    rv, ctx->pkgver, "%s: [unpack] failed to "
+				    "extract file `%s': %s", ctx->pkgver, pname,
+				    strerror(rv));
+				break;
+			}
+		}
+		if (xhp->unpack_cb != NULL) {
+			ctx->xucd->entry_size = archive_entry_size(item->entry);
+			ctx->xucd->entry_is_conf = false;
+		}
+		if ((rv = extract_done(ctx, item->fileitem, pname, AE_IFREG,
+		    item->verify ? item->digest : NULL)) != 0)
+			break;
+	}
+	uring_batch_clear(batch);
+	return rv;
+
+fail:
+	xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, ctx->pkgver,
+	    "%s: [unpack] io_uring file writer failed: %s",
+	    ctx->pkgver, strerror(rv));
+	for (size_t i = 0; i < batch->nitems; i++) {
+		if (batch->items[i].fd != -1)
+			(void)close(batch->items[i].fd);
+	}
+	uring_batch_clear(batch);
+	return rv;
+}
+
+/*
+ * Reads the data of the current archive entry and adds it to the batch,
+ * which is written to disk if full.
+ * Returns 0 on success, an errno value otherwise.
+ */
+static int
+uring_queue(struct unpack_ctx *ctx, struct archive *ar,
+		struct archive_entry *entry, struct fileitem *fileitem,
+		bool exists, bool verify)
+{
+	struct uring_batch *batch = ctx->uring;
+	struct uring_item *item = &batch->items[batch->nitems];
+	size_t len, off = 0;
+	la_ssize_t r;
+	int rv;
+
+	memset(item, 0, sizeof(*item));
+	item->fd = -1;
+	len = (size_t)archive_entry_size(entry);
+	if ((item->entry = archive_entry_clone(entry)) == NULL)
+		return ENOMEM;
+	if (len > 0 && (item->buf = malloc(len)) == NULL) {
+		archive_entry_free(item->entry);
+		return ENOMEM;
+	}
+	while (off < len) {
+		if ((r = archive_read_data(ar, item->buf + off, len - off)) <= 0) {
+			if (r == 0 || (rv = archive_errno(ar)) == 0)
+				rv = EIO;
+			archive_entry_free(item->entry);
+			free(item->buf);
+			return rv;
+		}
+		off += (size_t)r;
+	}
+	item->len = len;
+	item->fileitem = fileitem;
+	item->unlink = exists;
+	if ((item->verify = verify)) {
+		if (EVP_Digest(item->buf, len, item->digest, NULL,
+		    EVP_sha256(), NULL) != 1) {
+			archive_entry_free(item->entry);
+			free(item->buf);
+			return EINVAL;
+		}
+	}
+	batch->nitems++;
+	batch->size += len;
+
+	if (batch->nitems == URING_BATCH_FILES || batch->size >= URING_BATCH_SIZE)
+		return uring_flush(ctx);
+
+	return 0;
+}
+#endif
+
+static void
+transd_add_uint64(struct xbps_handle *xhp, const char *key, uint64_t n)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	uint64_t cur = 0;
+
+	if (xhp->transd == NULL || n == 0)
+		return;
+
+	/* packages may be unpacked in parallel */
+	pthread_mutex_lock(&lock);
+	xbps_dictionary_get_uint64(xhp->transd, key, &cur);
+	xbps_dictionary_set_uint64(xhp->transd, key, cur + n);
+	pthread_mutex_unlock(&lock);
 }
 
 static int
@@ -71,7 +844,8 @@ unpack_archive(struct xbps_handle *xhp,
 	       xbps_dictionary_t pkg_repod,
 	       const char *pkgver,
 	       const char *fname,
-	       struct archive *ar)
+	       struct archive *ar,
+	       struct xbps_unpack_job *job)
 {
 	xbps_dictionary_t binpkg_propsd, binpkg_filesd, pkg_filesd, obsd;
 	xbps_array_t array, obsoletes;
@@ -79,16 +853,20 @@ unpack_archive(struct xbps_handle *xhp,
 	xbps_trans_type_t ttype;
 	const struct stat *entry_statp;
 	void *instbuf = NULL, *rembuf = NULL;
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
 	struct stat st;
 	struct xbps_unpack_cb_data xucd;
+	struct unpack_ctx ctx;
 	struct archive_entry *entry;
+	struct fileitem *fileitems = NULL, *curitems = NULL, *fileitem;
 	size_t  instbufsiz = 0, rembufsiz = 0;
+	uint64_t nstatcheck = 0, nhashcheck = 0, nfilestore = 0;
 	ssize_t entry_size;
 	const char *entry_pname, *binpkg_pkgver, *pkgname;
 	char *buf = NULL;
 	int ar_rv, rv, error, entry_type, flags;
 	bool preserve, update, file_exists, keep_conf_file;
-	bool skip_extract, force, xucd_stats;
+	bool skip_extract, force, xucd_stats, statcheck, verify;
 	uid_t euid;
 
 	binpkg_propsd = binpkg_filesd = pkg_filesd = NULL;
@@ -100,6 +878,10 @@ unpack_archive(struct xbps_handle *xhp,
 	ttype = xbps_transaction_pkg_type(pkg_repod);
 
 	memset(&xucd, 0, sizeof(xucd));
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.xhp = xhp;
+	ctx.pkgver = pkgver;
+	ctx.xucd = &xucd;
 
 	euid = geteuid();
 
@@ -111,6 +893,11 @@ unpack_archive(struct xbps_handle *xhp,
 		force = true;
 	}
 
+	statcheck = ctx.statcheck = (xhp->flags & XBPS_FLAG_STATCHECK);
+	ctx.hashcache = (xhp->flags & XBPS_FLAG_HASH_CACHE);
+	ctx.strict = (xhp->flags & XBPS_FLAG_DURABILITY_STRICT);
+	ctx.filestore = (xhp->flags & XBPS_FLAG_FILESTORE_MASK);
+
 	if (ttype == XBPS_TRANS_UPDATE) {
 		update = true;
 	}
@@ -232,10 +1019,28 @@ unpack_archive(struct xbps_handle *xhp,
 		goto out;
 	}
 
+	/*
+	 * Index files and conf_files from the binpkg files.plist by path.
+	 */
+	if ((rv = fileitems_add(&fileitems, binpkg_filesd, "conf_files", true)) != 0 ||
+	    (rv = fileitems_add(&fileitems, binpkg_filesd, "files", false)) != 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
+		    "%s: [unpack] failed to index package files: %s",
+		    pkgver, strerror(rv));
+		goto out;
+	}
+
 	/*
 	 * Internalize current pkg metadata files plist.
 	 */
 	pkg_filesd = xbps_pkgdb_get_pkg_files(xhp, pkgname);
+	if (statcheck && pkg_filesd &&
+	    (rv = fileitems_add(&curitems, pkg_filesd, "files", false)) != 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
+		    "%s: [unpack] failed to index package files: %s",
+		    pkgver, strerror(rv));
+		goto out;
+	}
 
 	/* Add pkg install/remove scripts data objects into our dictionary */
 	if (instbuf != NULL) {
@@ -250,6 +1055,26 @@ unpack_archive(struct xbps_handle *xhp,
 		xbps_dictionary_set(pkg_repod, "remove-script", data);
 		xbps_object_release(data);
 	}
+	/*
+	 * Files are extracted through our own write disk object, to hash
+	 * its data while it's being written.
+	 */
+	if ((ctx.ext = archive_write_disk_new()) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	archive_write_disk_set_options(ctx.ext, flags);
+	archive_write_disk_set_standard_lookup(ctx.ext);
+#ifdef HAVE_IO_URING
+	if (xhp->flags & XBPS_FLAG_UNPACK_IOURING)
+		ctx.uring = uring_batch_new(xhp);
+#endif
+	/*
+	 * In a parallel unpack, wait for the previous packages of the
+	 * transaction as required by the INSTALL script.
+	 */
+	if (job != NULL && (rv = xbps_unpack_job_wait(job, instbuf != NULL)) != 0)
+		goto out;
 	/*
 	 * Execute INSTALL "pre" ACTION before unpacking files.
 	 */
@@ -262,6 +1087,8 @@ unpack_archive(struct xbps_handle *xhp,
 			goto out;
 		}
 	}
+	if (job != NULL)
+		xbps_unpack_job_ready(job);
 	/*
 	 * Unpack all files on archive now.
 	 */
@@ -312,7 +1139,7 @@ unpack_archive(struct xbps_handle *xhp,
 		/*
 		 * Skip files that match noextract patterns from configuration file.
 		 */
-		if (xhp->noextract && xbps_patterns_match(xhp->noextract, entry_pname+1)) {
+		if (xbps_noextract_match(xhp, entry_pname+1)) {
 			xbps_dbg_printf(xhp, "[unpack] %s skipped (matched by a pattern)\n", entry_pname+1);
 			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FILE_PRESERVED, 0,
 			    pkgver, "%s: file `%s' won't be extracted, "
@@ -326,6 +1153,7 @@ unpack_archive(struct xbps_handle *xhp,
 		 * Otherwise skip extracting it.
 		 */
 		skip_extract = file_exists = keep_conf_file = false;
+		fileitem = NULL;
 		if (lstat(entry_pname, &st) == 0)
 			file_exists = true;
 		/*
@@ -346,10 +1174,12 @@ unpack_archive(struct xbps_handle *xhp,
 		 * Check if current entry is a configuration file,
 		 * that should be kept.
 		 */
-		if (!force && (entry_type == AE_IFREG)) {
+		if (entry_type == AE_IFREG) {
 			buf = strchr(entry_pname, '.') + 1;
 			assert(buf != NULL);
-			keep_conf_file = xbps_entry_is_a_conf_file(binpkg_filesd, buf);
+			fileitem = fileitems_lookup(fileitems, buf);
+			if (!force)
+				keep_conf_file = fileitem && fileitem->conf;
 		}
 
 		/*
@@ -387,8 +1217,17 @@ unpack_archive(struct xbps_handle *xhp,
 					}
 					rv = 0;
 				} else {
-					rv = xbps_file_hash_check_dictionary(
-					    xhp, binpkg_filesd, "files", buf);
+					if (fileitem == NULL || fileitem->sha256 == NULL) {
+						rv = 1;
+					} else if (statcheck && file_stat_match(curitems,
+					    fileitem, entry, &st)) {
+						nstatcheck++;
+						rv = 0;
+					} else {
+						nhashcheck++;
+						rv = xbps_file_hash_check(xhp,
+						    buf, fileitem->sha256);
+					}
 					if (rv == -1) {
 						/* error */
 						xbps_dbg_printf(xhp,
@@ -412,6 +1251,18 @@ unpack_archive(struct xbps_handle *xhp,
 				}
 			}
 		}
+		/*
+		 * Files hardlinked from the file store share its inode with
+		 * other packages, don't change its metadata in place.
+		 */
+		if (!force && skip_extract && file_exists && !keep_conf_file &&
+		    (xhp->flags & XBPS_FLAG_FILESTORE_HARDLINK) &&
+		    S_ISREG(st.st_mode) && st.st_nlink > 1 &&
+		    (archive_entry_mode(entry) != st.st_mode ||
+		    archive_entry_mtime(entry) != st.st_mtime ||
+		    (euid == 0 && (archive_entry_uid(entry) != st.st_uid ||
+		    archive_entry_gid(entry) != st.st_gid))))
+			skip_extract = false;
 		/*
 		 * Check if current uid/gid differs from file in binpkg,
 		 * and change permissions if true.
@@ -484,6 +1335,8 @@ unpack_archive(struct xbps_handle *xhp,
 			    pkgver, entry_pname);
 		}
 		if (!force && skip_extract) {
+			if (statcheck && fileitem && !fileitem->conf)
+				file_stat_record(fileitem, entry_pname);
 			archive_read_data_skip(ar);
 			continue;
 		}
@@ -493,23 +1346,73 @@ unpack_archive(struct xbps_handle *xhp,
 		 */
 		entry_pname = archive_entry_pathname(entry);
 		/*
-		 * Extract entry from archive.
+		 * Link the file from the file store if its SHA256 hash
+		 * is there, its data in the archive is skipped. The store
+		 * file is verified, its digest is handled as the one of
+		 * an extracted file.
+		 */
+		if (ctx.filestore && fileitem && fileitem->sha256 &&
+		    !fileitem->conf && !keep_conf_file &&
+		    archive_entry_hardlink(entry) == NULL) {
+			error = xbps_filestore_get(xhp, ctx.ext, entry,
+			    fileitem->sha256, digest);
+			if (error == 0) {
+				nfilestore++;
+				archive_read_data_skip(ar);
+				if ((error = extract_done(&ctx, fileitem,
+				    entry_pname, entry_type, digest)) != 0)
+					break;
+				continue;
+			} else if (error != ENOENT) {
+				xbps_dbg_printf(xhp, "%s: [unpack] failed to "
+				    "link `%s' from the file store: %s\n",
+				    pkgver, entry_pname, strerror(error));
+			}
+			error = 0;
+		}
+		/*
+		 * Extract entry from archive, hashing regular files
+		 * with a known SHA256 hash while its data is written.
 		 */
-		if (archive_read_extract(ar, entry, flags) != 0) {
-			error = archive_errno(ar);
+		verify = fileitem && fileitem->sha256 &&
+		    archive_entry_hardlink(entry) == NULL;
+#ifdef HAVE_IO_URING
+		if (ctx.uring != NULL) {
+			if (!keep_conf_file && uring_eligible(ctx.uring, entry)) {
+				if ((error = uring_queue(&ctx, ar, entry,
+				    fileitem, file_exists, verify)) != 0) {
+					xbps_set_cb_state(xhp,
+					    XBPS_STATE_UNPACK_FAIL,
+					    error, pkgver,
+					    "%s: [unpack] failed to extract "
+					    "file `%s': %s", pkgver,
+					    entry_pname, strerror(error));
+					break;
+				}
+				continue;
+			}
+			/* hardlink targets must exist on disk */
+			if (archive_entry_hardlink(entry) != NULL &&
+			    (error = uring_flush(&ctx)) != 0)
+				break;
+		}
+#endif
+		if ((error = extract_entry(ar, ctx.ext, entry,
+		    verify ? digest : NULL)) != 0) {
 			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
 			    error, pkgver,
 			    "%s: [unpack] failed to extract file `%s': %s",
 			    pkgver, entry_pname, strerror(error));
 			break;
-		} else {
-			if (xhp->unpack_cb != NULL) {
-				xucd.entry = entry_pname;
-				xucd.entry_extract_count++;
-				(*xhp->unpack_cb)(&xucd, xhp->unpack_cb_data);
-			}
 		}
+		if ((error = extract_done(&ctx, fileitem, entry_pname,
+		    entry_type, verify ? digest : NULL)) != 0)
+			break;
 	}
+#ifdef HAVE_IO_URING
+	if (ctx.uring != NULL && !error && ar_rv != ARCHIVE_FATAL)
+		error = uring_flush(&ctx);
+#endif
 	/*
 	 * If there was any error extracting files from archive, error out.
 	 */
@@ -522,23 +1425,32 @@ unpack_archive(struct xbps_handle *xhp,
 		    pkgver, strerror(rv));
 		goto out;
 	}
+	if (ctx.strict && (rv = diritems_flush(&ctx.syncdirs, true)) != 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
+		    "%s: [unpack] failed to sync directories: %s",
+		    pkgver, strerror(rv));
+		goto out;
+	}
+	if (statcheck) {
+		xbps_dbg_printf(xhp, "%s: %"PRIu64" files matched by stat, "
+		    "%"PRIu64" files hashed\n", pkgver, nstatcheck, nhashcheck);
+	}
+	transd_add_uint64(xhp, "unpack-statcheck-files", nstatcheck);
+	transd_add_uint64(xhp, "unpack-hashcheck-files", nhashcheck);
+	transd_add_uint64(xhp, "unpack-filestore-files", nfilestore);
 	/*
 	 * Externalize binpkg files.plist to disk, if not empty.
 	 */
 	if (xbps_dictionary_count(binpkg_filesd)) {
-		mode_t prev_umask;
-		prev_umask = umask(022);
 		buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-		if (!xbps_dictionary_externalize_to_file(binpkg_filesd, buf)) {
+		if (!xbps_dictionary_externalize_sync(xhp, binpkg_filesd, buf, false)) {
 			rv = errno;
-			umask(prev_umask);
 			free(buf);
 			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
 			    rv, pkgver, "%s: [unpack] failed to externalize pkg "
 			    "pkg metadata files: %s", pkgver, strerror(rv));
 			goto out;
 		}
-		umask(prev_umask);
 		free(buf);
 	}
 out:
@@ -550,6 +1462,14 @@ out:
 		unlink(buf);
 		free(buf);
 	}
+	fileitems_free(&fileitems);
+	fileitems_free(&curitems);
+	(void)diritems_flush(&ctx.syncdirs, false);
+#ifdef HAVE_IO_URING
+	uring_batch_free(ctx.uring);
+#endif
+	if (ctx.ext != NULL)
+		archive_write_free(ctx.ext);
 	if (xbps_object_type(binpkg_propsd) == XBPS_TYPE_DICTIONARY)
 		xbps_object_release(binpkg_propsd);
 	if (xbps_object_type(binpkg_filesd) == XBPS_TYPE_DICTIONARY)
@@ -562,15 +1482,16 @@ out:
 	return rv;
 }
 
-int HIDDEN
-xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
+static int
+unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		struct xbps_unpack_job *job)
 {
 	struct archive *ar = NULL;
 	struct stat st;
 	const char *pkgver;
 	char *bpkg = NULL;
 	int pkg_fd = -1, rv = 0;
-	mode_t myumask;
+	mode_t myumask = 0;
 
 	assert(xbps_object_type(pkg_repod) == XBPS_TYPE_DICTIONARY);
 
@@ -600,7 +1521,12 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	archive_read_support_filter_zstd(ar);
 	archive_read_support_format_tar(ar);
 
-	myumask = umask(022);
+	/*
+	 * The umask is per process, a parallel unpack sets it once
+	 * for all its threads.
+	 */
+	if (job == NULL)
+		myumask = umask(UNPACK_UMASK);
 
 	pkg_fd = open(bpkg, O_RDONLY|O_CLOEXEC);
 	if (pkg_fd == -1) {
@@ -619,7 +1545,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		    pkgver, bpkg, strerror(rv));
 		goto out;
 	}
-	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
+	if (xbps_archive_read_open_fd(xhp, ar, pkg_fd, &st) == ARCHIVE_FATAL) {
 		rv = archive_errno(ar);
 		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
 		    rv, pkgver,
@@ -643,7 +1569,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	/*
 	 * Extract archive files.
 	 */
-	if ((rv = unpack_archive(xhp, pkg_repod, pkgver, bpkg, ar)) != 0) {
+	if ((rv = unpack_archive(xhp, pkg_repod, pkgver, bpkg, ar, job)) != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
 		    "%s: [unpack] failed to unpack files from archive: %s",
 		    pkgver, strerror(rv));
@@ -659,13 +1585,6 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 		    "%s: [unpack] failed to set state to unpacked: %s",
 		    pkgver, strerror(rv));
 	}
-	/* register alternatives */
-	if ((rv = xbps_alternatives_register(xhp, pkg_repod)) != 0) {
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
-		    rv, pkgver,
-		    "%s: [unpack] failed to register alternatives: %s",
-		    pkgver, strerror(rv));
-	}
 
 out:
 	if (pkg_fd != -1)
@@ -676,7 +1595,46 @@ out:
 		free(bpkg);
 
 	/* restore */
-	umask(myumask);
+	if (job == NULL)
+		umask(myumask);
 
 	return rv;
 }
+
+int HIDDEN
+xbps_unpack_alternatives(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
+{
+	const char *pkgver = NULL;
+	int rv;
+
+	if ((rv = xbps_alternatives_register(xhp, pkg_repod)) != 0) {
+		xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
+		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
+		    rv, pkgver,
+		    "%s: [unpack] failed to register alternatives: %s",
+		    pkgver, strerror(rv));
+	}
+	return rv;
+}
+
+int HIDDEN
+xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
+{
+	int rv;
+
+	if ((rv = unpack_binary_pkg(xhp, pkg_repod, NULL)) != 0)
+		return rv;
+
+	return xbps_unpack_alternatives(xhp, pkg_repod);
+}
+
+/*
+ * Unpacks a package as part of a parallel unpack, its alternatives
+ * must be registered later with xbps_unpack_alternatives().
+ */
+int HIDDEN
+xbps_unpack_binary_pkg_job(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		struct xbps_unpack_job *job)
+{
+	return unpack_binary_pkg(xhp, pkg_repod, job);
+}
@@ -87,7 +87,8 @@ xbps_pkgdb_lock(struct xbps_handle *xhp)
 		}
 		/* if pkgdb is unexistent, create it with an empty dictionary */
 		xhp->pkgdb = xbps_dictionary_create();
-		if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
+		if (!xbps_dictionary_externalize_sync(xhp, xhp->pkgdb,
+		    xhp->pkgdb_plist, true)) {
 			rv = errno;
 			xbps_dbg_printf(xhp, "[pkgdb] failed to create pkgdb "
 			    "%s: %s\n", xhp->pkgdb_plist, strerror(rv));
@@ -292,7 +293,8 @@ xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 		    !xbps_dictionary_equals(xhp->pkgdb, pkgdb_storage)) {
 			/* flush dictionary to storage */
 			prev_umask = umask(022);
-			if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
+			if (!xbps_dictionary_externalize_sync(xhp, xhp->pkgdb,
+			    xhp->pkgdb_plist, true)) {
 				umask(prev_umask);
 				return errno;
 			}
@@ -26,10 +26,13 @@
  * From: $NetBSD: pkg_io.c,v 1.9 2009/08/16 21:10:15 joerg Exp $
  */
 
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "xbps_api_impl.h"
 
@@ -80,7 +83,7 @@ fetch_archive_close(struct archive *a UNUSED, void *client_data)
 }
 
 static struct archive *
-open_archive_by_url(struct url *url)
+open_archive_by_url(struct url *url, bool concat)
 {
 	struct fetch_archive *f;
 	struct archive *a;
@@ -101,6 +104,8 @@ open_archive_by_url(struct url *url)
 	archive_read_support_filter_lz4(a);
 	archive_read_support_filter_zstd(a);
 	archive_read_support_format_tar(a);
+	if (concat)
+		archive_read_set_options(a, "tar:read_concatenated_archives");
 
 	if (archive_read_open(a, f, fetch_archive_open, fetch_archive_read,
 	    fetch_archive_close)) {
@@ -111,11 +116,18 @@ open_archive_by_url(struct url *url)
 	return a;
 }
 
+/*
+ * If concat is set, concatenated archives are read as one, as with
+ * repository archives with index segments.
+ */
 static struct archive *
-open_archive(const char *url)
+open_archive(const char *url, bool *metadata, bool concat)
 {
 	struct url *u;
 	struct archive *a;
+	struct stat st;
+	uint64_t metasize;
+	int fd = -1;
 
 	if (!xbps_repository_is_remote(url)) {
 		if ((a = archive_read_new()) == NULL)
@@ -127,34 +139,53 @@ open_archive(const char *url)
 		archive_read_support_filter_lz4(a);
 		archive_read_support_filter_zstd(a);
 		archive_read_support_format_tar(a);
+		if (concat)
+			archive_read_set_options(a, "tar:read_concatenated_archives");
+
+		/*
+		 * Read only the metadata frame of packages with an index.
+		 */
+		if (metadata && *metadata) {
+			fd = open(url, O_RDONLY|O_CLOEXEC);
+			if (fd != -1 && (fstat(fd, &st) == -1 ||
+			    xbps_archive_read_index(fd, st.st_size, &metasize))) {
+				close(fd);
+				fd = -1;
+			}
+			*metadata = fd != -1;
+		}
 
-		if (archive_read_open_filename(a, url, 32768)) {
+		if (fd != -1) {
+			if (xbps_archive_read_open_metadata(a, fd, true)) {
+				archive_read_finish(a);
+				return NULL;
+			}
+		} else if (archive_read_open_filename(a, url, 32768)) {
 			archive_read_finish(a);
 			return NULL;
 		}
 		return a;
 	}
-	
+	if (metadata)
+		*metadata = false;
+
 	if ((u = fetchParseURL(url)) == NULL)
 		return NULL;
 
-	a = open_archive_by_url(u);
+	a = open_archive_by_url(u, concat);
 	fetchFreeURL(u);
 
 	return a;
 }
 
-char *
-xbps_archive_fetch_file(const char *url, const char *fname)
+static char *
+fetch_file(const char *url, const char *fname, bool *metadata)
 {
 	struct archive *a;
 	struct archive_entry *entry;
 	char *buf = NULL;
 
-	assert(url);
-	assert(fname);
-
-	if ((a = open_archive(url)) == NULL)
+	if ((a = open_archive(url, metadata, false)) == NULL)
 		return NULL;
 
 	while ((archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
@@ -175,20 +206,31 @@ xbps_archive_fetch_file(const char *url, const char *fname)
 	return buf;
 }
 
+char *
+xbps_archive_fetch_file(const char *url, const char *fname)
+{
+	assert(url);
+	assert(fname);
+
+	return fetch_file(url, fname, NULL);
+}
+
 bool
 xbps_repo_fetch_remote(struct xbps_repo *repo, const char *url)
 {
 	struct archive *a;
 	struct archive_entry *entry;
-	uint8_t i = 0;
+	xbps_dictionary_t seg;
+	bool segok = true;
+	int rv;
 
 	assert(url);
 	assert(repo);
 
-	if ((a = open_archive(url)) == NULL)
+	if ((a = open_archive(url, NULL, true)) == NULL)
 		return false;
 
-	while ((archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+	while ((rv = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
 		const char *bfile;
 		char *buf;
 
@@ -200,24 +242,31 @@ xbps_repo_fetch_remote(struct xbps_repo *repo, const char *url)
 			buf = xbps_archive_get_file(a, entry);
 			repo->idxmeta = xbps_dictionary_internalize(buf);
 			free(buf);
-			i++;
 		} else if (strcmp(bfile, XBPS_REPOIDX) == 0) {
 			buf = xbps_archive_get_file(a, entry);
 			repo->idx = xbps_dictionary_internalize(buf);
 			free(buf);
-			i++;
+		} else if (strcmp(bfile, XBPS_REPOIDX_SEGMENT) == 0) {
+			/* segments are appended after the index */
+			seg = xbps_archive_get_dictionary(a, entry);
+			if (xbps_object_type(repo->idx) != XBPS_TYPE_DICTIONARY ||
+			    !xbps_repo_merge_segment(repo->idx, seg))
+				segok = false;
+			if (seg != NULL)
+				xbps_object_release(seg);
+			if (!segok)
+				break;
 		} else {
 			archive_read_data_skip(a);
 		}
-		if (i == 2)
-			break;
 	}
 	archive_read_finish(a);
 
 	if (xbps_object_type(repo->idxmeta) == XBPS_TYPE_DICTIONARY)
 		repo->is_signed = true;
 
-	if (xbps_object_type(repo->idx) == XBPS_TYPE_DICTIONARY)
+	if (xbps_object_type(repo->idx) == XBPS_TYPE_DICTIONARY &&
+	    segok && rv == ARCHIVE_EOF)
 		return true;
 
 	return false;
@@ -234,7 +283,7 @@ xbps_archive_fetch_file_into_fd(const char *url, const char *fname, int fd)
 	assert(fname);
 	assert(fd != -1);
 
-	if ((a = open_archive(url)) == NULL)
+	if ((a = open_archive(url, NULL, false)) == NULL)
 		return EINVAL;
 
 	while ((archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
@@ -262,9 +311,20 @@ xbps_dictionary_t
 xbps_archive_fetch_plist(const char *url, const char *plistf)
 {
 	xbps_dictionary_t d;
+	bool metadata = true;
 	char *buf;
 
-	if ((buf = xbps_archive_fetch_file(url, plistf)) == NULL)
+	assert(url);
+	assert(plistf);
+
+	/*
+	 * Package plists are metadata entries, a plist that isn't found
+	 * in the metadata frame is searched in the whole package.
+	 */
+	buf = fetch_file(url, plistf, &metadata);
+	if (buf == NULL && metadata)
+		buf = fetch_file(url, plistf, NULL);
+	if (buf == NULL)
 		return NULL;
 
 	d = xbps_dictionary_internalize(buf);
@@ -80,6 +80,81 @@ repo_get_dict(struct xbps_repo *repo)
 	return xbps_archive_get_dictionary(repo->ar, entry);
 }
 
+/*
+ * Repository index segments.
+ *
+ * xbps-rindex(1) may append the changes to the index to the repository
+ * archive, as another archive with a XBPS_REPOIDX_SEGMENT dictionary,
+ * rather than writing it again: "packages" has the added or updated
+ * packages and "removed" the names of the removed ones.
+ * Segments are applied in order to the index when it's opened.
+ */
+bool HIDDEN
+xbps_repo_merge_segment(xbps_dictionary_t idx, xbps_dictionary_t seg)
+{
+	xbps_array_t removed;
+	xbps_dictionary_t pkgs;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	const char *pkgname;
+
+	if (xbps_object_type(seg) != XBPS_TYPE_DICTIONARY)
+		return false;
+
+	removed = xbps_dictionary_get(seg, "removed");
+	for (unsigned int i = 0; i < xbps_array_count(removed); i++) {
+		if (!xbps_array_get_cstring_nocopy(removed, i, &pkgname))
+			return false;
+		xbps_dictionary_remove(idx, pkgname);
+	}
+	if ((pkgs = xbps_dictionary_get(seg, "packages")) == NULL)
+		return true;
+	if ((iter = xbps_dictionary_iterator(pkgs)) == NULL)
+		return false;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		if (!xbps_dictionary_set(idx,
+		    xbps_dictionary_keysym_cstring_nocopy(keysym),
+		    xbps_dictionary_get_keysym(pkgs, keysym))) {
+			xbps_object_iterator_release(iter);
+			return false;
+		}
+	}
+	xbps_object_iterator_release(iter);
+	return true;
+}
+
+static bool
+repo_get_segments(struct xbps_repo *repo)
+{
+	struct archive_entry *entry;
+	xbps_dictionary_t seg;
+	const char *bfile;
+	int rv;
+
+	while ((rv = archive_read_next_header(repo->ar, &entry)) == ARCHIVE_OK) {
+		bfile = archive_entry_pathname(entry);
+		if (strcmp(bfile, XBPS_REPOIDX_SEGMENT) != 0) {
+			archive_read_data_skip(repo->ar);
+			continue;
+		}
+		seg = xbps_archive_get_dictionary(repo->ar, entry);
+		if (!xbps_repo_merge_segment(repo->idx, seg)) {
+			xbps_dbg_printf(repo->xhp, "[repo] `%s' invalid index "
+			    "segment\n", repo->uri);
+			if (seg != NULL)
+				xbps_object_release(seg);
+			return false;
+		}
+		xbps_object_release(seg);
+	}
+	if (rv != ARCHIVE_EOF) {
+		xbps_dbg_printf(repo->xhp, "[repo] `%s' failed to read index "
+		    "segments: %s\n", repo->uri, archive_error_string(repo->ar));
+		return false;
+	}
+	return true;
+}
+
 bool
 xbps_repo_lock(struct xbps_handle *xhp, const char *repodir,
 		int *lockfd, char **lockfname)
@@ -149,6 +224,8 @@ repo_open_local(struct xbps_repo *repo, const char *repofile)
 	archive_read_support_filter_lz4(repo->ar);
 	archive_read_support_filter_zstd(repo->ar);
 	archive_read_support_format_tar(repo->ar);
+	/* index segments are appended archives */
+	archive_read_set_options(repo->ar, "tar:read_concatenated_archives");
 
 	if (archive_read_open_fd(repo->ar, repo->fd, st.st_blksize) == ARCHIVE_FATAL) {
 		xbps_dbg_printf(repo->xhp,
@@ -163,12 +240,14 @@ repo_open_local(struct xbps_repo *repo, const char *repofile)
 		(void)unlink(repofile);
 		return false;
 	}
-	xbps_dictionary_make_immutable(repo->idx);
 	repo->idxmeta = repo_get_dict(repo);
 	if (repo->idxmeta != NULL) {
 		repo->is_signed = true;
 		xbps_dictionary_make_immutable(repo->idxmeta);
 	}
+	if (!repo_get_segments(repo))
+		return false;
+	xbps_dictionary_make_immutable(repo->idx);
 	/*
 	 * We don't need the archive anymore, we are only
 	 * interested in the proplib dictionaries.
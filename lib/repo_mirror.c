@@ -0,0 +1,405 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "xbps_api_impl.h"
+#include "fetch.h"
+
+/*
+ * Repository mirrors.
+ *
+ * A remote repository with mirrors (mirror=<repository> <url>...) is
+ * downloaded from the best of its urls: the primary url and its mirrors
+ * are probed with a HEAD request of the repository index, and ranked
+ * by the round trip time plus the time to download MIRROR_RANK_BYTES
+ * with the throughput of previous downloads. The probes are kept in
+ * <metadir>/mirrors.plist for MIRROR_PROBE_TTL seconds.
+ *
+ * A url that fails a download is ranked last for the rest of the run,
+ * and the download is retried from the next one.
+ */
+#define MIRROR_PROBE_TTL	3600
+#define MIRROR_RANK_BYTES	(1024*1024)
+
+/*
+ * State of the mirrors of a handle, created by xbps_init() if there are
+ * mirrors and released by xbps_end().
+ */
+struct xbps_mirror_stats {
+	pthread_mutex_t lock;
+	xbps_dictionary_t stats;	/* url -> stats, saved in metadir */
+	xbps_dictionary_t failed;	/* urls that failed in this run */
+	xbps_dictionary_t probed;	/* repositories probed in this run */
+	bool dirty;
+};
+
+struct mirror_probe {
+	pthread_t thd;
+	char *repodata;
+	char err[MAXERRSTRING];
+	uint64_t rtt;
+	bool ok;
+	bool started;
+};
+
+struct mirror_rank {
+	const char *url;
+	uint64_t cost;
+	unsigned int idx;
+	bool healthy;
+};
+
+/* Must be called with ms->lock held. */
+static void
+mirrors_load(struct xbps_handle *xhp, struct xbps_mirror_stats *ms)
+{
+	char *plist;
+
+	if (ms->stats != NULL)
+		return;
+
+	plist = xbps_xasprintf("%s/mirrors.plist", xhp->metadir);
+	ms->stats = xbps_dictionary_internalize_from_file(plist);
+	free(plist);
+	if (ms->stats == NULL)
+		ms->stats = xbps_dictionary_create();
+}
+
+/* Must be called with ms->lock held. */
+static xbps_dictionary_t
+mirror_get_stats(struct xbps_mirror_stats *ms, const char *url, bool create)
+{
+	xbps_dictionary_t d;
+
+	if (ms->stats == NULL)
+		return NULL;
+	d = xbps_dictionary_get(ms->stats, url);
+	if (d == NULL && create) {
+		if ((d = xbps_dictionary_create()) == NULL)
+			return NULL;
+		xbps_dictionary_set(ms->stats, url, d);
+		xbps_object_release(d);
+	}
+	return d;
+}
+
+static void *
+probe_thread(void *arg)
+{
+	struct mirror_probe *mp = arg;
+	struct url_stat us;
+	struct url *url;
+	struct timespec t0;
+
+	if ((url = fetchParseURL(mp->repodata)) == NULL)
+		return NULL;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (fetchStat(url, &us, NULL) == 0) {
+		mp->rtt = xbps_usecs_since(&t0);
+		mp->ok = true;
+	} else {
+		/* the fetch error is per thread */
+		xbps_strlcpy(mp->err, fetchLastErrString, sizeof(mp->err));
+	}
+	fetchFreeURL(url);
+	return NULL;
+}
+
+/*
+ * Probes the urls of a repository without a recent probe, in parallel.
+ * Must be called with ms->lock held.
+ */
+static void
+mirrors_probe(struct xbps_handle *xhp, struct xbps_mirror_stats *ms,
+    xbps_array_t urls)
+{
+	struct mirror_probe *probes;
+	xbps_dictionary_t d;
+	const char *arch, *url;
+	uint64_t probed, now;
+	unsigned int i, cnt;
+
+	arch = xhp->target_arch ? xhp->target_arch : xhp->native_arch;
+	now = (uint64_t)time(NULL);
+	cnt = xbps_array_count(urls);
+	if ((probes = calloc(cnt, sizeof(*probes))) == NULL)
+		return;
+
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(urls, i, &url);
+		d = mirror_get_stats(ms, url, false);
+		if (xbps_dictionary_get_uint64(d, "probed", &probed) &&
+		    probed <= now && probed + MIRROR_PROBE_TTL > now)
+			continue;
+		probes[i].repodata = xbps_xasprintf("%s/%s-repodata", url, arch);
+		if (pthread_create(&probes[i].thd, NULL, probe_thread, &probes[i]) == 0)
+			probes[i].started = true;
+		else
+			probe_thread(&probes[i]);
+	}
+	for (i = 0; i < cnt; i++) {
+		if (probes[i].repodata == NULL)
+			continue;
+		if (probes[i].started)
+			pthread_join(probes[i].thd, NULL);
+		xbps_array_get_cstring_nocopy(urls, i, &url);
+		if ((d = mirror_get_stats(ms, url, true)) != NULL) {
+			xbps_dictionary_set_uint64(d, "probed", now);
+			xbps_dictionary_set_uint64(d, "rtt", probes[i].rtt);
+			xbps_dictionary_set_bool(d, "healthy", probes[i].ok);
+			ms->dirty = true;
+		}
+		if (probes[i].ok)
+			xbps_dbg_printf(xhp, "[mirror] %s: %" PRIu64 " usecs\n",
+			    url, probes[i].rtt);
+		else
+			xbps_dbg_printf(xhp, "[mirror] %s: probe failed: %s\n",
+			    url, probes[i].err);
+		free(probes[i].repodata);
+	}
+	free(probes);
+}
+
+static int
+rank_cmp(const void *a, const void *b)
+{
+	const struct mirror_rank *ra = a, *rb = b;
+
+	if (ra->healthy != rb->healthy)
+		return ra->healthy ? -1 : 1;
+	if (ra->cost != rb->cost)
+		return ra->cost < rb->cost ? -1 : 1;
+	return ra->idx < rb->idx ? -1 : 1;
+}
+
+/*
+ * Returns the urls to download the repository \a repouri from, best
+ * first: the repository itself and its mirrors. The array must be
+ * released by the caller.
+ */
+xbps_array_t HIDDEN
+xbps_repo_mirrors(struct xbps_handle *xhp, const char *repouri)
+{
+	struct xbps_mirror_stats *ms = xhp->mirror_stats;
+	struct mirror_rank *ranks;
+	xbps_array_t mirrors, urls, ranked;
+	xbps_dictionary_t d;
+	const char *url;
+	uint64_t rtt, tput, best_tput = 0;
+	unsigned int i, cnt;
+	bool probed = false, failed;
+
+	if ((urls = xbps_array_create()) == NULL)
+		return NULL;
+	xbps_array_add_cstring_nocopy(urls, repouri);
+	mirrors = xbps_dictionary_get(xhp->mirrors, repouri);
+	for (i = 0; i < xbps_array_count(mirrors); i++) {
+		xbps_array_get_cstring_nocopy(mirrors, i, &url);
+		xbps_array_add_cstring_nocopy(urls, url);
+	}
+	if ((cnt = xbps_array_count(urls)) == 1 || ms == NULL)
+		return urls;
+
+	pthread_mutex_lock(&ms->lock);
+	mirrors_load(xhp, ms);
+	xbps_dictionary_get_bool(ms->probed, repouri, &probed);
+	if (!probed) {
+		mirrors_probe(xhp, ms, urls);
+		xbps_dictionary_set_bool(ms->probed, repouri, true);
+	}
+
+	if ((ranks = calloc(cnt, sizeof(*ranks))) == NULL) {
+		pthread_mutex_unlock(&ms->lock);
+		xbps_object_release(urls);
+		return NULL;
+	}
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(urls, i, &url);
+		d = mirror_get_stats(ms, url, false);
+		if (xbps_dictionary_get_uint64(d, "throughput", &tput) &&
+		    tput > best_tput)
+			best_tput = tput;
+	}
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(urls, i, &url);
+		d = mirror_get_stats(ms, url, false);
+		rtt = tput = 0;
+		failed = false;
+		xbps_dictionary_get_uint64(d, "rtt", &rtt);
+		xbps_dictionary_get_uint64(d, "throughput", &tput);
+		xbps_dictionary_get_bool(d, "healthy", &ranks[i].healthy);
+		xbps_dictionary_get_bool(ms->failed, url, &failed);
+		/* unknown throughputs are assumed to be the best one */
+		if (tput == 0)
+			tput = best_tput;
+		ranks[i].url = url;
+		ranks[i].idx = i;
+		ranks[i].healthy = ranks[i].healthy && !failed;
+		ranks[i].cost = rtt;
+		if (tput > 0)
+			ranks[i].cost += (uint64_t)MIRROR_RANK_BYTES * 1000000 / tput;
+	}
+	pthread_mutex_unlock(&ms->lock);
+	qsort(ranks, cnt, sizeof(*ranks), rank_cmp);
+
+	if ((ranked = xbps_array_create()) != NULL) {
+		for (i = 0; i < cnt; i++) {
+			xbps_array_add_cstring(ranked, ranks[i].url);
+			xbps_dbg_printf(xhp, "[mirror] %s[%u]: %s (%s, cost %"
+			    PRIu64 ")\n", repouri, i, ranks[i].url,
+			    ranks[i].healthy ? "healthy" : "failed",
+			    ranks[i].cost);
+		}
+	}
+	free(ranks);
+	xbps_object_release(urls);
+
+	return ranked;
+}
+
+/*
+ * Ranks \a url last for the rest of the run, and probes it again
+ * in the next one.
+ */
+void HIDDEN
+xbps_repo_mirror_failed(struct xbps_handle *xhp, const char *url)
+{
+	struct xbps_mirror_stats *ms = xhp->mirror_stats;
+	xbps_dictionary_t d;
+
+	if (ms == NULL)
+		return;
+
+	pthread_mutex_lock(&ms->lock);
+	xbps_dictionary_set_bool(ms->failed, url, true);
+	if ((d = mirror_get_stats(ms, url, false)) != NULL) {
+		xbps_dictionary_set_bool(d, "healthy", false);
+		xbps_dictionary_set_uint64(d, "probed", 0);
+		ms->dirty = true;
+	}
+	pthread_mutex_unlock(&ms->lock);
+	xbps_dbg_printf(xhp, "[mirror] %s: marked as failed\n", url);
+}
+
+/*
+ * Updates the throughput of \a url with a download of \a bytes
+ * that took \a usecs.
+ */
+void HIDDEN
+xbps_repo_mirror_update(struct xbps_handle *xhp, const char *url,
+    uint64_t bytes, uint64_t usecs)
+{
+	struct xbps_mirror_stats *ms = xhp->mirror_stats;
+	xbps_dictionary_t d;
+	uint64_t tput, old = 0;
+
+	/* too small to measure the throughput */
+	if (ms == NULL || bytes < 65536 || usecs == 0)
+		return;
+
+	pthread_mutex_lock(&ms->lock);
+	if ((d = mirror_get_stats(ms, url, false)) != NULL) {
+		tput = bytes * 1000000 / usecs;
+		if (xbps_dictionary_get_uint64(d, "throughput", &old) && old > 0)
+			tput = (old * 3 + tput) / 4;
+		xbps_dictionary_set_uint64(d, "throughput", tput);
+		ms->dirty = true;
+	}
+	pthread_mutex_unlock(&ms->lock);
+}
+
+void HIDDEN
+xbps_repo_mirrors_save(struct xbps_handle *xhp)
+{
+	struct xbps_mirror_stats *ms = xhp->mirror_stats;
+	char *plist;
+
+	if (ms == NULL)
+		return;
+
+	pthread_mutex_lock(&ms->lock);
+	if (ms->stats != NULL && ms->dirty) {
+		plist = xbps_xasprintf("%s/mirrors.plist", xhp->metadir);
+		if (!xbps_dictionary_externalize_to_file(ms->stats, plist)) {
+			xbps_dbg_printf(xhp, "[mirror] failed to write %s: %s\n",
+			    plist, strerror(errno));
+		} else {
+			ms->dirty = false;
+		}
+		free(plist);
+	}
+	pthread_mutex_unlock(&ms->lock);
+}
+
+int HIDDEN
+xbps_repo_mirrors_init(struct xbps_handle *xhp)
+{
+	struct xbps_mirror_stats *ms;
+
+	if (xbps_dictionary_count(xhp->mirrors) == 0)
+		return 0;
+	if ((ms = calloc(1, sizeof(*ms))) == NULL)
+		return ENOMEM;
+	ms->failed = xbps_dictionary_create();
+	ms->probed = xbps_dictionary_create();
+	if (ms->failed == NULL || ms->probed == NULL) {
+		if (ms->failed != NULL)
+			xbps_object_release(ms->failed);
+		if (ms->probed != NULL)
+			xbps_object_release(ms->probed);
+		free(ms);
+		return ENOMEM;
+	}
+	pthread_mutex_init(&ms->lock, NULL);
+	xhp->mirror_stats = ms;
+	return 0;
+}
+
+void HIDDEN
+xbps_repo_mirrors_release(struct xbps_handle *xhp)
+{
+	struct xbps_mirror_stats *ms = xhp->mirror_stats;
+
+	if (ms == NULL)
+		return;
+
+	xbps_repo_mirrors_save(xhp);
+	if (ms->stats != NULL)
+		xbps_object_release(ms->stats);
+	xbps_object_release(ms->failed);
+	xbps_object_release(ms->probed);
+	pthread_mutex_destroy(&ms->lock);
+	free(ms);
+	xhp->mirror_stats = NULL;
+}
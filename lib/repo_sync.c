@@ -74,9 +74,11 @@ xbps_get_remote_repo_string(const char *uri)
 int HIDDEN
 xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 {
+	xbps_array_t mirrors;
 	mode_t prev_umask;
-	const char *arch, *fetchstr = NULL;
+	const char *arch, *url, *fetchstr = NULL;
 	char *repodata, *lrepodir, *uri_fixedp;
+	unsigned int i, cnt;
 	int rv = 0;
 
 	assert(uri != NULL);
@@ -124,28 +126,48 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 		return -1;
 	}
 	free(lrepodir);
-	/*
-	 * Remote repository plist index full URL.
-	 */
-	repodata = xbps_xasprintf("%s/%s-repodata", uri, arch);
 
-	/* reposync start cb */
-	xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC, 0, repodata, NULL);
-	/*
-	 * Download plist index file from repository.
-	 */
-	if ((rv = xbps_fetch_file(xhp, repodata, NULL)) == -1) {
-		/* reposync error cb */
+	if ((mirrors = xbps_repo_mirrors(xhp, uri)) == NULL) {
+		umask(prev_umask);
+		return -1;
+	}
+	cnt = xbps_array_count(mirrors);
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(mirrors, i, &url);
+		/*
+		 * Remote repository plist index full URL.
+		 */
+		repodata = xbps_xasprintf("%s/%s-repodata", url, arch);
+
+		/* reposync start cb */
+		xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC, 0, repodata, NULL);
+		/*
+		 * Download plist index file from repository.
+		 */
+		if ((rv = xbps_fetch_file(xhp, repodata, NULL)) != -1) {
+			free(repodata);
+			if (rv == 1)
+				rv = 0;
+			break;
+		}
 		fetchstr = xbps_fetch_error_string();
-		xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC_FAIL,
-		    fetchLastErrCode != 0 ? fetchLastErrCode : errno, NULL,
-		    "[reposync] failed to fetch file `%s': %s",
-		    repodata, fetchstr ? fetchstr : strerror(errno));
-	} else if (rv == 1)
-		rv = 0;
+		if (i + 1 < cnt) {
+			/* try the next mirror */
+			xbps_dbg_printf(xhp, "[reposync] failed to fetch file "
+			    "`%s': %s\n", repodata,
+			    fetchstr ? fetchstr : strerror(errno));
+		} else {
+			/* reposync error cb */
+			xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC_FAIL,
+			    fetchLastErrCode != 0 ? fetchLastErrCode : errno, NULL,
+			    "[reposync] failed to fetch file `%s': %s",
+			    repodata, fetchstr ? fetchstr : strerror(errno));
+		}
+		xbps_repo_mirror_failed(xhp, url);
+		free(repodata);
+	}
+	xbps_object_release(mirrors);
 	umask(prev_umask);
 
-	free(repodata);
-
 	return rv;
 }
@@ -76,6 +76,7 @@ xbps_rpool_sync(struct xbps_handle *xhp, const char *uri)
 			continue;
 		}
 	}
+	xbps_repo_mirrors_save(xhp);
 	return 0;
 }
 
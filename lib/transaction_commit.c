@@ -56,12 +56,44 @@
  * data type is specified on its edge, i.e string, array, integer, dictionary.
  */
 
+/*
+ * Returns true if the package can be unpacked in parallel with the
+ * previous ones, updated packages can't have a REMOVE script nor
+ * alternatives to unregister before being unpacked.
+ */
+static bool
+parallel_unpack(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		xbps_trans_type_t ttype)
+{
+	xbps_dictionary_t pkgd;
+	const char *pkgname = NULL;
+	pkg_state_t state = 0;
+
+	if (!(xhp->flags & XBPS_FLAG_UNPACK_PARALLEL))
+		return false;
+	if (ttype == XBPS_TRANS_INSTALL || ttype == XBPS_TRANS_REINSTALL)
+		return true;
+	if (ttype != XBPS_TRANS_UPDATE)
+		return false;
+
+	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgname", &pkgname);
+	if ((pkgd = xbps_pkgdb_get_pkg(xhp, pkgname)) == NULL)
+		return false;
+	if (xbps_pkg_state_dictionary(pkgd, &state) != 0 ||
+	    state != XBPS_PKG_STATE_INSTALLED)
+		return false;
+
+	return !xbps_dictionary_get(pkgd, "remove-script") &&
+	    !xbps_dictionary_get(pkgd, "alternatives");
+}
+
 int
 xbps_transaction_commit(struct xbps_handle *xhp)
 {
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
 	xbps_trans_type_t ttype;
+	xbps_array_t unpack = NULL, configure = NULL;
 	const char *pkgver = NULL;
 	int rv = 0;
 	bool update;
@@ -92,6 +124,11 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	if (iter == NULL)
 		return EINVAL;
 
+	/*
+	 * Wait for the connections being pre-warmed, if any.
+	 */
+	xbps_fetch_prewarm_wait(xhp);
+
 	/*
 	 * Download and verify binary packages.
 	 */
@@ -146,10 +183,55 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 		    xhp->rootdir, strerror(errno));
 		goto out;
 	}
+	if ((unpack = xbps_array_create()) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
 
 		ttype = xbps_transaction_pkg_type(obj);
+		if (ttype == XBPS_TRANS_HOLD) {
+			/*
+			 * Package is on hold mode, ignore it.
+			 */
+			continue;
+		} else if (parallel_unpack(xhp, obj, ttype)) {
+			/*
+			 * Queue package to be unpacked in parallel.
+			 */
+			if (ttype == XBPS_TRANS_UPDATE) {
+				xbps_set_cb_state(xhp, XBPS_STATE_UPDATE, 0,
+				    pkgver, NULL);
+				rv = xbps_remove_pkg(xhp, pkgver, true);
+				if (rv != 0) {
+					xbps_set_cb_state(xhp,
+					    XBPS_STATE_UPDATE_FAIL,
+					    rv, pkgver,
+					    "%s: [trans] failed to update "
+					    "package `%s'", pkgver,
+					    strerror(rv));
+					goto out;
+				}
+			} else {
+				xbps_set_cb_state(xhp, XBPS_STATE_INSTALL, 0,
+				    pkgver, NULL);
+			}
+			xbps_array_add(unpack, obj);
+			continue;
+		}
+		/*
+		 * Any other step waits for the queued packages.
+		 */
+		if (xbps_array_count(unpack) > 0) {
+			if ((rv = xbps_transaction_unpack(xhp, unpack)) != 0)
+				goto out;
+			xbps_object_release(unpack);
+			if ((unpack = xbps_array_create()) == NULL) {
+				rv = ENOMEM;
+				goto out;
+			}
+		}
 		if (ttype == XBPS_TRANS_REMOVE) {
 			/*
 			 * Remove package.
@@ -192,11 +274,6 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 				    strerror(rv));
 				goto out;
 			}
-		} else if (ttype == XBPS_TRANS_HOLD) {
-			/*
-			 * Package is on hold mode, ignore it.
-			 */
-			continue;
 		} else {
 			/* Install or reinstall package */
 			xbps_set_cb_state(xhp, XBPS_STATE_INSTALL, 0,
@@ -219,6 +296,9 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			goto out;
 		}
 	}
+	if ((rv = xbps_transaction_unpack(xhp, unpack)) != 0)
+		goto out;
+
 	/* if there are no packages to install or update we are done */
 	if (!xbps_dictionary_get(xhp->transd, "total-update-pkgs") &&
 	    !xbps_dictionary_get(xhp->transd, "total-install-pkgs"))
@@ -242,6 +322,11 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	 */
 	xbps_set_cb_state(xhp, XBPS_STATE_TRANS_CONFIGURE, 0, NULL, NULL);
 
+	configure = xbps_array_create();
+	if (configure == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
 		ttype = xbps_transaction_pkg_type(obj);
@@ -251,31 +336,28 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 			    "%s: %d\n", __func__, pkgver, ttype);
 			continue;
 		}
-		update = false;
-		if (ttype == XBPS_TRANS_UPDATE)
-			update = true;
-
-		rv = xbps_configure_pkg(xhp, pkgver, false, update);
-		if (rv != 0) {
-			xbps_dbg_printf(xhp, "%s: configure failed for "
-			    "%s: %s\n", __func__, pkgver, strerror(rv));
+		if (!xbps_array_add(configure, obj)) {
+			rv = ENOMEM;
 			goto out;
 		}
-		/*
-		 * Notify client callback when a package has been
-		 * installed or updated.
-		 */
-		if (update) {
-			xbps_set_cb_state(xhp, XBPS_STATE_UPDATE_DONE, 0,
-			    pkgver, NULL);
-		} else {
-			xbps_set_cb_state(xhp, XBPS_STATE_INSTALL_DONE, 0,
-			    pkgver, NULL);
-		}
 	}
+	rv = xbps_transaction_configure(xhp, configure);
 
 out:
+	if (unpack != NULL)
+		xbps_object_release(unpack);
+	if (configure != NULL)
+		xbps_object_release(configure);
 	xbps_object_iterator_release(iter);
+	if (rv == 0 && (xhp->flags & XBPS_FLAG_DURABILITY_TRANSACTION) &&
+	    !(xhp->flags & XBPS_FLAG_DOWNLOAD_ONLY)) {
+		/* Sync all unpacked files before recording them in pkgdb */
+		if ((rv = xbps_syncfs(xhp)) != 0) {
+			xbps_set_cb_state(xhp, XBPS_STATE_TRANS_FAIL, rv, NULL,
+			    "[trans] failed to sync rootdir `%s': %s",
+			    xhp->rootdir, strerror(rv));
+		}
+	}
 	if (rv == 0) {
 		/* Force a pkgdb write for all unpacked pkgs in transaction */
 		rv = xbps_pkgdb_update(xhp, true, true);
@@ -0,0 +1,307 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/*
+ * Parallel configuration of the packages of a transaction.
+ *
+ * A package is configured once all packages it depends on (run_depends,
+ * including virtual packages) that come before it in the transaction
+ * have been configured. Dependencies on later packages (cycles) are
+ * ignored, as in the serial order. Independent packages are configured
+ * concurrently, by as many threads as online CPUs.
+ */
+struct configure_job {
+	xbps_dictionary_t pkgd;
+	unsigned int *deps;
+	unsigned int ndeps;
+	int rv;
+	bool started;
+	bool done;
+};
+
+struct configure_sched {
+	struct xbps_handle *xhp;
+	struct configure_job *jobs;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int njobs;
+	unsigned int next;	/* jobs [0, next) have been started */
+	int rv;			/* first error */
+};
+
+struct pkgname_item {
+	char *name;
+	unsigned int idx;
+	UT_hash_handle hh;
+};
+
+static int
+configure_one(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
+{
+	const char *pkgver = NULL;
+	bool update;
+	int rv;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	update = xbps_transaction_pkg_type(pkgd) == XBPS_TRANS_UPDATE;
+
+	rv = xbps_configure_pkg(xhp, pkgver, false, update);
+	if (rv != 0) {
+		xbps_dbg_printf(xhp, "%s: configure failed for "
+		    "%s: %s\n", __func__, pkgver, strerror(rv));
+		return rv;
+	}
+	/*
+	 * Notify client callback when a package has been
+	 * installed or updated.
+	 */
+	if (update) {
+		xbps_set_cb_state(xhp, XBPS_STATE_UPDATE_DONE, 0,
+		    pkgver, NULL);
+	} else {
+		xbps_set_cb_state(xhp, XBPS_STATE_INSTALL_DONE, 0,
+		    pkgver, NULL);
+	}
+	return 0;
+}
+
+static int
+add_name(struct pkgname_item **names, const char *name, unsigned int idx)
+{
+	struct pkgname_item *item;
+
+	HASH_FIND_STR(*names, name, item);
+	if (item != NULL)
+		return 0;
+	if ((item = malloc(sizeof(*item))) == NULL)
+		return ENOMEM;
+	if ((item->name = strdup(name)) == NULL) {
+		free(item);
+		return ENOMEM;
+	}
+	item->idx = idx;
+	HASH_ADD_KEYPTR(hh, *names, item->name, strlen(item->name), item);
+	return 0;
+}
+
+/*
+ * Builds the dependency graph of the jobs, only with edges to previous
+ * jobs, so that it's acyclic.
+ */
+static int
+build_deps(struct configure_sched *sched)
+{
+	struct pkgname_item *names = NULL, *item, *itmp;
+	xbps_array_t array;
+	const char *str;
+	char name[XBPS_NAME_SIZE];
+	int rv = 0;
+
+	for (unsigned int i = 0; i < sched->njobs && rv == 0; i++) {
+		struct configure_job *job = &sched->jobs[i];
+
+		array = xbps_dictionary_get(job->pkgd, "run_depends");
+		for (unsigned int j = 0; j < xbps_array_count(array); j++) {
+			xbps_array_get_cstring_nocopy(array, j, &str);
+			if (!xbps_pkgpattern_name(name, sizeof(name), str) &&
+			    !xbps_pkg_name(name, sizeof(name), str))
+				continue;
+			HASH_FIND_STR(names, name, item);
+			if (item == NULL)
+				continue;
+			if (job->ndeps % 8 == 0) {
+				unsigned int *deps;
+
+				deps = realloc(job->deps,
+				    (job->ndeps + 8) * sizeof(*deps));
+				if (deps == NULL) {
+					rv = ENOMEM;
+					break;
+				}
+				job->deps = deps;
+			}
+			job->deps[job->ndeps++] = item->idx;
+		}
+		/* register the names this package provides for the next ones */
+		xbps_dictionary_get_cstring_nocopy(job->pkgd, "pkgname", &str);
+		if (rv == 0)
+			rv = add_name(&names, str, i);
+		array = xbps_dictionary_get(job->pkgd, "provides");
+		for (unsigned int j = 0; j < xbps_array_count(array) && rv == 0; j++) {
+			xbps_array_get_cstring_nocopy(array, j, &str);
+			if (xbps_pkg_name(name, sizeof(name), str))
+				rv = add_name(&names, name, i);
+		}
+	}
+	HASH_ITER(hh, names, item, itmp) {
+		HASH_DEL(names, item);
+		free(item->name);
+		free(item);
+	}
+	return rv;
+}
+
+/* Must be called with the scheduler lock held. */
+static struct configure_job *
+next_job(struct configure_sched *sched)
+{
+	for (unsigned int i = sched->next; i < sched->njobs; i++) {
+		struct configure_job *job = &sched->jobs[i];
+		unsigned int j;
+
+		if (job->started)
+			continue;
+		for (j = 0; j < job->ndeps; j++) {
+			if (!sched->jobs[job->deps[j]].done)
+				break;
+		}
+		if (j < job->ndeps)
+			continue;
+
+		job->started = true;
+		while (sched->next < sched->njobs && sched->jobs[sched->next].started)
+			sched->next++;
+		return job;
+	}
+	return NULL;
+}
+
+static void *
+configure_thread(void *arg)
+{
+	struct configure_sched *sched = arg;
+	struct configure_job *job;
+	int rv;
+
+	pthread_mutex_lock(&sched->lock);
+	for (;;) {
+		if (sched->rv != 0 || sched->next == sched->njobs)
+			break;
+		if ((job = next_job(sched)) == NULL) {
+			pthread_cond_wait(&sched->cond, &sched->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&sched->lock);
+
+		rv = configure_one(sched->xhp, job->pkgd);
+
+		pthread_mutex_lock(&sched->lock);
+		job->rv = rv;
+		job->done = true;
+		if (rv != 0 && sched->rv == 0)
+			sched->rv = rv;
+		pthread_cond_broadcast(&sched->cond);
+	}
+	pthread_mutex_unlock(&sched->lock);
+
+	return NULL;
+}
+
+/*
+ * Configures the packages in \a pkgs, in parallel if possible.
+ * Returns 0 on success, an errno value otherwise.
+ */
+int HIDDEN
+xbps_transaction_configure(struct xbps_handle *xhp, xbps_array_t pkgs)
+{
+	struct configure_sched sched;
+	pthread_t *thds;
+	unsigned int i, npkgs, nthreads = 0;
+	mode_t myumask;
+	long ncpus;
+	int rv;
+
+	npkgs = xbps_array_count(pkgs);
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!(xhp->flags & XBPS_FLAG_CONFIGURE_PARALLEL) ||
+	    npkgs <= 1 || ncpus <= 1) {
+		for (i = 0; i < npkgs; i++) {
+			if ((rv = configure_one(xhp, xbps_array_get(pkgs, i))) != 0)
+				return rv;
+		}
+		return 0;
+	}
+
+	memset(&sched, 0, sizeof(sched));
+	sched.xhp = xhp;
+	sched.njobs = npkgs;
+	if ((sched.jobs = calloc(npkgs, sizeof(*sched.jobs))) == NULL)
+		return ENOMEM;
+	for (i = 0; i < npkgs; i++)
+		sched.jobs[i].pkgd = xbps_array_get(pkgs, i);
+	if ((rv = build_deps(&sched)) != 0)
+		goto out;
+	if ((thds = calloc((size_t)ncpus, sizeof(*thds))) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	pthread_mutex_init(&sched.lock, NULL);
+	pthread_cond_init(&sched.cond, NULL);
+	/*
+	 * The umask is per process, set it once for all threads.
+	 */
+	myumask = umask(022);
+
+	for (i = 0; i < npkgs && i < (unsigned int)ncpus; i++) {
+		if (pthread_create(&thds[i], NULL, configure_thread, &sched) != 0)
+			break;
+		nthreads++;
+	}
+	if (nthreads == 0) {
+		/* no threads, configure them here */
+		configure_thread(&sched);
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(thds[i], NULL);
+
+	umask(myumask);
+
+	xbps_dbg_printf(xhp, "[trans] configured %u packages with %u threads\n",
+	    npkgs, nthreads);
+
+	rv = sched.rv;
+	pthread_cond_destroy(&sched.cond);
+	pthread_mutex_destroy(&sched.lock);
+	free(thds);
+out:
+	for (i = 0; i < npkgs; i++)
+		free(sched.jobs[i].deps);
+	free(sched.jobs);
+
+	return rv;
+}
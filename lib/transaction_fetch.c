@@ -28,24 +28,28 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/stat.h>
 
 #include "xbps_api_impl.h"
 
+/*
+ * Verifies the binary package \a pkgd, \a item has the result of
+ * hashing its file.
+ */
 static int
-verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
+verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd,
+		const struct xbps_sha256_item *item)
 {
 	struct xbps_repo *repo;
-	const char *pkgver, *repoloc, *sha256;
-	char *binfile;
+	const char *pkgver, *repoloc;
+	char *sigfile;
 	int rv = 0;
 
 	xbps_dictionary_get_cstring_nocopy(pkgd, "repository", &repoloc);
 	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
 
-	binfile = xbps_repository_pkg_path(xhp, pkgd);
-	if (binfile == NULL) {
-		return ENOMEM;
-	}
 	/*
 	 * For pkgs in local repos check the sha256 hash.
 	 * For pkgs in remote repos check the RSA signature.
@@ -54,91 +58,248 @@ verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 		rv = errno;
 		xbps_dbg_printf(xhp, "%s: failed to get repository "
 			"%s: %s\n", pkgver, repoloc, strerror(errno));
-		goto out;
+		return rv;
 	}
 	if (repo->is_remote) {
 		/* remote repo */
 		xbps_set_cb_state(xhp, XBPS_STATE_VERIFY, 0, pkgver,
 			"%s: verifying RSA signature...", pkgver);
 
-		if (!xbps_verify_file_signature(repo, binfile)) {
-			char *sigfile;
+		sigfile = xbps_xasprintf("%s.sig", item->file);
+		if (item->rv != 0) {
+			xbps_dbg_printf(xhp, "can't open file %s: %s\n",
+			    item->file, strerror(item->rv));
+		}
+		if (item->rv != 0 ||
+		    !xbps_verify_signature(repo, sigfile, __UNCONST(item->digest))) {
 			rv = EPERM;
 			xbps_set_cb_state(xhp, XBPS_STATE_VERIFY_FAIL, rv, pkgver,
 				"%s: the RSA signature is not valid!", pkgver);
 			xbps_set_cb_state(xhp, XBPS_STATE_VERIFY_FAIL, rv, pkgver,
 				"%s: removed pkg archive and its signature.", pkgver);
-			(void)remove(binfile);
-			sigfile = xbps_xasprintf("%s.sig", binfile);
+			(void)remove(item->file);
 			(void)remove(sigfile);
-			free(sigfile);
-			goto out;
 		}
+		free(sigfile);
 	} else {
 		/* local repo */
 		xbps_set_cb_state(xhp, XBPS_STATE_VERIFY, 0, pkgver,
 			"%s: verifying SHA256 hash...", pkgver);
-		xbps_dictionary_get_cstring_nocopy(pkgd, "filename-sha256", &sha256);
-		if ((rv = xbps_file_sha256_check(binfile, sha256)) != 0) {
+		/* packages without a hash can't be verified */
+		if ((rv = item->sha256 ? item->rv : EINVAL) != 0) {
 			xbps_set_cb_state(xhp, XBPS_STATE_VERIFY_FAIL, rv, pkgver,
 				"%s: SHA256 hash is not valid: %s", pkgver, strerror(rv));
-			goto out;
 		}
+	}
+	return rv;
+}
 
+/*
+ * Reconstructs the binary package from the binary package of the
+ * installed version in the cache and a delta provided by the repository.
+ * The reconstructed package must match the sha256 hash in the index,
+ * and its signature is verified as usual.
+ */
+static int
+download_delta(struct xbps_handle *xhp, const char *url,
+    xbps_dictionary_t repo_pkgd, unsigned char *digest, size_t digestlen)
+{
+	xbps_dictionary_t pkgd, deltad;
+	const char *pkgname, *pkgver, *arch, *basepkgver, *basearch, *sha256;
+	const char *deltasha256;
+	char *name, *base = NULL, *delta = NULL, *file = NULL, *uri = NULL;
+	int rv;
+
+	if (!(xhp->flags & XBPS_FLAG_FETCH_DELTAS))
+		return ENOTSUP;
+
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgname", &pkgname);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "architecture", &arch);
+	if (!xbps_dictionary_get_cstring_nocopy(repo_pkgd, "filename-sha256", &sha256))
+		return ENOENT;
+	if ((pkgd = xbps_pkgdb_get_pkg(xhp, pkgname)) == NULL)
+		return ENOENT;
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &basepkgver);
+	deltad = xbps_dictionary_get(xbps_dictionary_get(repo_pkgd, "deltas"),
+	    basepkgver);
+	if (deltad == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(deltad, "architecture", &basearch) ||
+	    !xbps_dictionary_get_cstring_nocopy(deltad, "filename-sha256", &deltasha256))
+		return ENOENT;
+
+	base = xbps_xasprintf("%s/%s.%s.xbps", xhp->cachedir, basepkgver, basearch);
+	if (access(base, R_OK) == -1) {
+		rv = errno;
+		free(base);
+		return rv;
 	}
+	if ((name = xbps_binpkg_delta_name(pkgver, arch, basepkgver)) == NULL) {
+		rv = errno;
+		free(base);
+		return rv;
+	}
+	uri = xbps_xasprintf("%s/%s", url, name);
+	delta = xbps_xasprintf("%s/%s", xhp->cachedir, name);
+	file = xbps_xasprintf("%s/%s.%s.xbps", xhp->cachedir, pkgver, arch);
+	free(name);
+
+	xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
+		"Downloading `%s' delta from `%s' (from `%s')...", pkgver,
+		basepkgver, url);
+
+	if (xbps_fetch_file_dest(xhp, uri, delta, NULL) == -1) {
+		rv = fetchLastErrCode ? fetchLastErrCode : errno;
+		xbps_dbg_printf(xhp, "[trans] failed to download `%s': %s\n",
+		    uri, xbps_fetch_error_string() ? xbps_fetch_error_string() :
+		    strerror(rv));
+		goto out;
+	}
+	if ((rv = xbps_file_sha256_check(delta, deltasha256)) != 0) {
+		rv = EINVAL;
+		xbps_dbg_printf(xhp, "[trans] `%s': SHA256 mismatch\n", delta);
+		goto out;
+	}
+	if ((rv = xbps_delta_apply(base, delta, file)) != 0) {
+		xbps_dbg_printf(xhp, "[trans] failed to apply `%s': %s\n",
+		    delta, strerror(rv));
+		goto out;
+	}
+	if (!xbps_file_sha256_raw(digest, digestlen, file) ||
+	    !xbps_sha256_digest_compare(sha256, strlen(sha256), digest, digestlen)) {
+		rv = EINVAL;
+		xbps_dbg_printf(xhp, "[trans] `%s': reconstructed package "
+		    "SHA256 mismatch\n", file);
+		(void)remove(file);
+		goto out;
+	}
+	xbps_dbg_printf(xhp, "[trans] `%s' reconstructed from `%s'\n",
+	    pkgver, basepkgver);
 out:
-	free(binfile);
+	if (rv != 0)
+		memset(digest, 0, digestlen);
+	(void)remove(delta);
+	free(base);
+	free(delta);
+	free(file);
+	free(uri);
 	return rv;
 }
 
+/*
+ * Downloads the binary package and its signature from \a url,
+ * the repository or one of its mirrors. Failures are reported
+ * to the client callback if it's the \a last url to try.
+ */
 static int
-download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
+download_binpkg_from(struct xbps_handle *xhp, const char *url,
+    xbps_dictionary_t repo_pkgd, unsigned char *digest, size_t digestlen,
+    bool last)
 {
-	struct xbps_repo *repo;
+	struct timespec t0;
+	struct stat st;
 	char buf[PATH_MAX];
 	char *sigsuffix;
-	const char *pkgver, *arch, *fetchstr, *repoloc;
-	unsigned char digest[XBPS_SHA256_DIGEST_SIZE] = {0};
-	int rv = 0;
-
-	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "repository", &repoloc);
-	if (!xbps_repository_is_remote(repoloc))
-		return ENOTSUP;
+	const char *fetchstr, *pkgver, *arch;
+	uint64_t usecs;
+	int rv;
 
 	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgver", &pkgver);
 	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "architecture", &arch);
 
-	snprintf(buf, sizeof buf, "%s/%s.%s.xbps.sig", repoloc, pkgver, arch);
+	snprintf(buf, sizeof buf, "%s/%s.%s.xbps.sig", url, pkgver, arch);
 	sigsuffix = buf+(strlen(buf)-sizeof (".sig")+1);
 
 	xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
-		"Downloading `%s' signature (from `%s')...", pkgver, repoloc);
+		"Downloading `%s' signature (from `%s')...", pkgver, url);
 
 	if ((rv = xbps_fetch_file(xhp, buf, NULL)) == -1) {
 		rv = fetchLastErrCode ? fetchLastErrCode : errno;
 		fetchstr = xbps_fetch_error_string();
+		if (!last) {
+			xbps_dbg_printf(xhp, "[trans] failed to download `%s' "
+			    "signature from `%s': %s\n", pkgver, url,
+			    fetchstr ? fetchstr : strerror(rv));
+			return rv;
+		}
 		xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD_FAIL, rv,
 			pkgver, "[trans] failed to download `%s' signature from `%s': %s",
-			pkgver, repoloc, fetchstr ? fetchstr : strerror(rv));
+			pkgver, url, fetchstr ? fetchstr : strerror(rv));
 		return rv;
 	}
 	rv = 0;
 
 	*sigsuffix = '\0';
 
+	if (download_delta(xhp, url, repo_pkgd, digest, digestlen) == 0)
+		return 0;
+
 	xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD, 0, pkgver,
-		"Downloading `%s' package (from `%s')...", pkgver, repoloc);
+		"Downloading `%s' package (from `%s')...", pkgver, url);
 
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	if ((rv = xbps_fetch_file_sha256(xhp, buf, NULL, digest,
-	    sizeof digest)) == -1) {
+	    digestlen)) == -1) {
 		rv = fetchLastErrCode ? fetchLastErrCode : errno;
 		fetchstr = xbps_fetch_error_string();
+		if (!last) {
+			xbps_dbg_printf(xhp, "[trans] failed to download `%s' "
+			    "package from `%s': %s\n", pkgver, url,
+			    fetchstr ? fetchstr : strerror(rv));
+			return rv;
+		}
 		xbps_set_cb_state(xhp, XBPS_STATE_DOWNLOAD_FAIL, rv,
 			pkgver, "[trans] failed to download `%s' package from `%s': %s",
-			pkgver, repoloc, fetchstr ? fetchstr : strerror(rv));
+			pkgver, url, fetchstr ? fetchstr : strerror(rv));
 		return rv;
 	}
-	rv = 0;
+	if (rv == 1) {
+		/* downloaded, update the throughput of the mirror */
+		usecs = xbps_usecs_since(&t0);
+		snprintf(buf, sizeof buf, "%s/%s.%s.xbps", xhp->cachedir, pkgver, arch);
+		if (stat(buf, &st) == 0)
+			xbps_repo_mirror_update(xhp, url, (uint64_t)st.st_size, usecs);
+	}
+	return 0;
+}
+
+static int
+download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
+{
+	struct xbps_repo *repo;
+	xbps_array_t mirrors;
+	char buf[PATH_MAX];
+	char *sigsuffix;
+	const char *pkgver, *arch, *repoloc, *url;
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE] = {0};
+	unsigned int i, cnt;
+	int rv = 0;
+
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "repository", &repoloc);
+	if (!xbps_repository_is_remote(repoloc))
+		return ENOTSUP;
+
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(repo_pkgd, "architecture", &arch);
+
+	/*
+	 * Download from the best url of the repository, and
+	 * fall back to the next ones on failures.
+	 */
+	if ((mirrors = xbps_repo_mirrors(xhp, repoloc)) == NULL)
+		return errno ? errno : ENOMEM;
+	cnt = xbps_array_count(mirrors);
+	for (i = 0; i < cnt; i++) {
+		xbps_array_get_cstring_nocopy(mirrors, i, &url);
+		rv = download_binpkg_from(xhp, url, repo_pkgd, digest,
+		    sizeof digest, i + 1 == cnt);
+		if (rv == 0)
+			break;
+		xbps_repo_mirror_failed(xhp, url);
+	}
+	xbps_object_release(mirrors);
+	if (rv != 0)
+		return rv;
 
 	xbps_set_cb_state(xhp, XBPS_STATE_VERIFY, 0, pkgver,
 		"%s: verifying RSA signature...", pkgver);
@@ -191,6 +352,7 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 int
 xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 {
+	struct xbps_sha256_item *items = NULL;
 	xbps_array_t fetch = NULL, verify = NULL;
 	xbps_object_t obj;
 	xbps_trans_type_t ttype;
@@ -258,8 +420,26 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_VERIFY, 0, NULL, NULL);
 		xbps_dbg_printf(xhp, "[trans] verifying %d packages.\n", n);
 	}
+	if (n && (items = calloc(n, sizeof(*items))) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < n; i++) {
+		obj = xbps_array_get(verify, i);
+		xbps_dictionary_get_cstring_nocopy(obj, "repository", &repoloc);
+		if ((items[i].file = xbps_repository_pkg_path(xhp, obj)) == NULL) {
+			rv = ENOMEM;
+			goto out;
+		}
+		if (!xbps_repository_is_remote(repoloc)) {
+			xbps_dictionary_get_cstring_nocopy(obj,
+			    "filename-sha256", &items[i].sha256);
+		}
+	}
+	/* hash all packages at once, failures are reported below */
+	(void)xbps_file_sha256_batch(items, n, 0);
 	for (i = 0; i < n; i++) {
-		if ((rv = verify_binpkg(xhp, xbps_array_get(verify, i))) != 0) {
+		if ((rv = verify_binpkg(xhp, xbps_array_get(verify, i), &items[i])) != 0) {
 			xbps_dbg_printf(xhp, "[trans] failed to check binpkgs: "
 				"%s\n", strerror(rv));
 			goto out;
@@ -267,6 +447,12 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	}
 
 out:
+	xbps_repo_mirrors_save(xhp);
+	if (items != NULL) {
+		for (i = 0; i < n; i++)
+			free(__UNCONST(items[i].file));
+		free(items);
+	}
 	if (fetch)
 		xbps_object_release(fetch);
 	if (verify)
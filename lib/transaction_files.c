@@ -128,11 +128,11 @@ typestr(enum type typ)
 static bool
 match_preserved_file(struct xbps_handle *xhp, const char *file)
 {
-	if (xhp->preserved_files == NULL)
+	if (xhp->preserved_matcher == NULL)
 		return false;
 
 	assert(file && *file == '.');
-	return xbps_match_string_in_array(xhp->preserved_files, file+1);
+	return xbps_matcher_match(xhp->preserved_matcher, file+1);
 }
 
 static bool
@@ -306,7 +306,14 @@ collect_obsoletes(struct xbps_handle *xhp)
 		 * Skip unexisting files and keep files with hash mismatch.
 		 */
 		if (item->old.sha256 != NULL) {
-			rv = xbps_file_sha256_check(item->file, item->old.sha256);
+			struct xbps_sha256_item hitem;
+
+			/* through the SHA256 cache (XBPS_FLAG_HASH_CACHE) */
+			memset(&hitem, 0, sizeof(hitem));
+			hitem.file = item->file;
+			hitem.sha256 = item->old.sha256;
+			hitem.cache = (xhp->flags & XBPS_FLAG_HASH_CACHE);
+			rv = xbps_file_sha256_batch(&hitem, 1, 1);
 			switch (rv) {
 			case 0:
 				/* hash matches, we can safely delete and/or overwrite it */
@@ -648,7 +655,6 @@ collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
 	xbps_dictionary_t filesd;
 	struct archive *ar = NULL;
 	struct archive_entry *entry;
-	struct stat st;
 	const char *pkgver, *pkgname;
 	char *bpkg;
 	/* size_t entry_size; */
@@ -689,15 +695,10 @@ collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
 		    pkgver, bpkg, strerror(rv));
 		goto out;
 	}
-	if (fstat(pkg_fd, &st) == -1) {
-		rv = errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    rv, pkgver,
-		    "%s: failed to fstat binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
-	}
-	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
+	/*
+	 * Only the metadata frame is read, if the package has an index.
+	 */
+	if (xbps_archive_read_open_metadata(ar, pkg_fd, false) == ARCHIVE_FATAL) {
 		rv = archive_errno(ar);
 		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
 		    rv, pkgver,
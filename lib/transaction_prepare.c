@@ -290,6 +290,18 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	if (xhp->transd == NULL)
 		return ENXIO;
 
+	/*
+	 * Open the connections to the repositories while the
+	 * transaction is being prepared.
+	 */
+	if (xhp->flags & XBPS_FLAG_FETCH_PREWARM) {
+		if ((rv = xbps_fetch_prewarm(xhp, 0)) != 0) {
+			xbps_dbg_printf(xhp, "%s: failed to pre-warm "
+			    "connections: %s\n", __func__, strerror(rv));
+			rv = 0;
+		}
+	}
+
 	/*
 	 * Collect dependencies for pkgs in transaction.
 	 */
@@ -0,0 +1,266 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Parallel unpack of the packages of a transaction.
+ *
+ * xbps_transaction_files() guarantees that packages don't write the
+ * same files, so packages without ordering constraints are unpacked
+ * concurrently by a pool of threads, in transaction order:
+ *
+ * 	- A package only starts extracting its files once all previous
+ * 	  packages have executed its INSTALL pre action.
+ * 	- A package with an INSTALL script only executes its pre action
+ * 	  once all previous packages have been unpacked.
+ *
+ * Alternatives and pkgdb registration are done serially in order
+ * once the packages have been unpacked.
+ */
+struct xbps_unpack_job {
+	struct unpack_sched *sched;
+	xbps_dictionary_t pkgd;
+	unsigned int idx;
+	int rv;
+	bool ready;
+	bool done;
+};
+
+struct unpack_sched {
+	struct xbps_handle *xhp;
+	struct xbps_unpack_job *jobs;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int njobs;
+	unsigned int next;	/* next job to be started */
+	unsigned int nready;	/* jobs [0, nready) are ready */
+	unsigned int ndone;	/* jobs [0, ndone) are done */
+	unsigned int failed;	/* first failed job, njobs if none */
+};
+
+/* Must be called with the scheduler lock held. */
+static void
+sched_advance(struct unpack_sched *sched)
+{
+	while (sched->nready < sched->njobs && sched->jobs[sched->nready].ready)
+		sched->nready++;
+	while (sched->ndone < sched->njobs && sched->jobs[sched->ndone].done)
+		sched->ndone++;
+	pthread_cond_broadcast(&sched->cond);
+}
+
+int HIDDEN
+xbps_unpack_job_wait(struct xbps_unpack_job *job, bool script)
+{
+	struct unpack_sched *sched = job->sched;
+	int rv = 0;
+
+	pthread_mutex_lock(&sched->lock);
+	for (;;) {
+		if (sched->failed < job->idx) {
+			rv = ECANCELED;
+			break;
+		}
+		if ((script ? sched->ndone : sched->nready) >= job->idx)
+			break;
+		pthread_cond_wait(&sched->cond, &sched->lock);
+	}
+	pthread_mutex_unlock(&sched->lock);
+
+	return rv;
+}
+
+void HIDDEN
+xbps_unpack_job_ready(struct xbps_unpack_job *job)
+{
+	struct unpack_sched *sched = job->sched;
+
+	pthread_mutex_lock(&sched->lock);
+	job->ready = true;
+	sched_advance(sched);
+	pthread_mutex_unlock(&sched->lock);
+}
+
+static void *
+unpack_thread(void *arg)
+{
+	struct unpack_sched *sched = arg;
+	struct xbps_unpack_job *job;
+	int rv;
+
+	for (;;) {
+		pthread_mutex_lock(&sched->lock);
+		if (sched->failed < sched->njobs || sched->next == sched->njobs) {
+			pthread_mutex_unlock(&sched->lock);
+			break;
+		}
+		job = &sched->jobs[sched->next++];
+		pthread_mutex_unlock(&sched->lock);
+
+		rv = xbps_unpack_binary_pkg_job(sched->xhp, job->pkgd, job);
+
+		pthread_mutex_lock(&sched->lock);
+		job->rv = rv;
+		job->ready = job->done = true;
+		if (rv != 0 && job->idx < sched->failed)
+			sched->failed = job->idx;
+		sched_advance(sched);
+		pthread_mutex_unlock(&sched->lock);
+	}
+	return NULL;
+}
+
+static int
+register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
+{
+	const char *pkgver = NULL;
+	int rv;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+
+	if ((rv = xbps_unpack_alternatives(xhp, pkgd)) != 0)
+		return rv;
+	if ((rv = xbps_register_pkg(xhp, pkgd)) != 0) {
+		xbps_dbg_printf(xhp, "[trans] failed to register "
+		    "%s: %s\n", pkgver, strerror(rv));
+	}
+	return rv;
+}
+
+/*
+ * Unpacks and registers the packages in \a pkgs, in parallel if possible.
+ * Returns 0 on success, an errno value otherwise.
+ */
+int HIDDEN
+xbps_transaction_unpack(struct xbps_handle *xhp, xbps_array_t pkgs)
+{
+	struct unpack_sched sched;
+	pthread_t *thds;
+	xbps_dictionary_t pkgd;
+	const char *pkgver = NULL;
+	unsigned int i, npkgs, nthreads = 0;
+	mode_t myumask;
+	long ncpus;
+	int rv = 0;
+
+	npkgs = xbps_array_count(pkgs);
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (npkgs <= 1 || ncpus <= 1) {
+		for (i = 0; i < npkgs; i++) {
+			pkgd = xbps_array_get(pkgs, i);
+			xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+			if ((rv = xbps_unpack_binary_pkg(xhp, pkgd)) != 0) {
+				xbps_dbg_printf(xhp, "[trans] failed to unpack "
+				    "%s: %s\n", pkgver, strerror(rv));
+				return rv;
+			}
+			if ((rv = xbps_register_pkg(xhp, pkgd)) != 0) {
+				xbps_dbg_printf(xhp, "[trans] failed to "
+				    "register %s: %s\n", pkgver, strerror(rv));
+				return rv;
+			}
+		}
+		return 0;
+	}
+	/*
+	 * pkgdb is lazily initialized, do it before starting threads.
+	 */
+	if ((rv = xbps_pkgdb_init(xhp)) != 0 && rv != ENOENT)
+		return rv;
+	rv = 0;
+
+	memset(&sched, 0, sizeof(sched));
+	sched.xhp = xhp;
+	sched.njobs = sched.failed = npkgs;
+	if ((sched.jobs = calloc(npkgs, sizeof(*sched.jobs))) == NULL)
+		return ENOMEM;
+	if ((thds = calloc((size_t)ncpus, sizeof(*thds))) == NULL) {
+		free(sched.jobs);
+		return ENOMEM;
+	}
+	for (i = 0; i < npkgs; i++) {
+		sched.jobs[i].sched = &sched;
+		sched.jobs[i].pkgd = xbps_array_get(pkgs, i);
+		sched.jobs[i].idx = i;
+	}
+	pthread_mutex_init(&sched.lock, NULL);
+	pthread_cond_init(&sched.cond, NULL);
+	/*
+	 * The umask is per process, set it once for all threads.
+	 */
+	myumask = umask(UNPACK_UMASK);
+
+	for (i = 0; i < npkgs && i < (unsigned int)ncpus; i++) {
+		if ((rv = pthread_create(&thds[i], NULL, unpack_thread,
+		    &sched)) != 0)
+			break;
+		nthreads++;
+	}
+	if (nthreads == 0) {
+		/* no threads, unpack them here */
+		unpack_thread(&sched);
+		rv = 0;
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(thds[i], NULL);
+
+	umask(myumask);
+
+	xbps_dbg_printf(xhp, "[trans] unpacked %u packages with %u threads\n",
+	    sched.ndone, nthreads);
+	/*
+	 * Register unpacked packages in transaction order, up to
+	 * the first failure.
+	 */
+	for (i = 0; i < npkgs; i++) {
+		struct xbps_unpack_job *job = &sched.jobs[i];
+
+		xbps_dictionary_get_cstring_nocopy(job->pkgd, "pkgver", &pkgver);
+		if ((rv = job->rv) != 0) {
+			xbps_dbg_printf(xhp, "[trans] failed to unpack "
+			    "%s: %s\n", pkgver, strerror(rv));
+			break;
+		}
+		if ((rv = register_pkg(xhp, job->pkgd)) != 0)
+			break;
+	}
+	pthread_cond_destroy(&sched.cond);
+	pthread_mutex_destroy(&sched.lock);
+	free(sched.jobs);
+	free(thds);
+
+	return rv;
+}
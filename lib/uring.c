@@ -0,0 +1,259 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_IO_URING
+# define _GNU_SOURCE	/* for syscall(2) and MAP_POPULATE */
+#endif
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Minimal io_uring(7) interface, using the raw system calls to not
+ * depend on liburing.
+ */
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Returns true if all opcodes in \a ops are supported by the kernel.
+ */
+static bool
+uring_probe(int fd, const uint8_t *ops, size_t nops)
+{
+	struct io_uring_probe *probe;
+	size_t len;
+	bool rv = true;
+
+	len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	if ((probe = calloc(1, len)) == NULL)
+		return false;
+
+	if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == -1) {
+		free(probe);
+		return false;
+	}
+	for (size_t i = 0; i < nops; i++) {
+		if (ops[i] > probe->last_op ||
+		    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			rv = false;
+			break;
+		}
+	}
+	free(probe);
+	return rv;
+}
+
+int HIDDEN
+xbps_uring_init(struct xbps_uring *ring, unsigned entries,
+		const uint8_t *ops, size_t nops)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+	int rv;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+
+	if ((ring->fd = sys_io_uring_setup(entries, &p)) == -1)
+		return errno;
+
+	if (!uring_probe(ring->fd, ops, nops)) {
+		close(ring->fd);
+		ring->fd = -1;
+		return ENOTSUP;
+	}
+
+	ring->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_sz > ring->sq_sz)
+			ring->sq_sz = ring->cq_sz;
+		ring->cq_sz = ring->sq_sz;
+	}
+	sq = mmap(NULL, ring->sq_sz, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto fail;
+	ring->sq_ptr = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, ring->cq_sz, PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto fail;
+		ring->cq_ptr = cq;
+	}
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	ring->sq_head = (unsigned *)((char *)sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)((char *)sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)((char *)cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)((char *)cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+	ring->sq_entries = p.sq_entries;
+	ring->sqe_tail = *ring->sq_tail;
+
+	return 0;
+
+fail:
+	rv = errno;
+	xbps_uring_fini(ring);
+	return rv;
+}
+
+void HIDDEN
+xbps_uring_fini(struct xbps_uring *ring)
+{
+	if (ring->sqes != NULL)
+		munmap(ring->sqes, ring->sqes_sz);
+	if (ring->cq_ptr != NULL)
+		munmap(ring->cq_ptr, ring->cq_sz);
+	if (ring->sq_ptr != NULL)
+		munmap(ring->sq_ptr, ring->sq_sz);
+	if (ring->fd > 0)
+		close(ring->fd);
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+/*
+ * Limits the number of kernel workers of the ring that may block,
+ * like file creation and removal. Best effort, requires Linux 5.15.
+ */
+void HIDDEN
+xbps_uring_set_max_workers(struct xbps_uring *ring, unsigned n)
+{
+	unsigned workers[2] = { 0, n };
+
+	(void)sys_io_uring_register(ring->fd,
+	    IORING_REGISTER_IOWQ_MAX_WORKERS, workers, 2);
+}
+
+/*
+ * Returns a zeroed submission queue entry, or NULL if the
+ * submission queue is full.
+ */
+struct io_uring_sqe HIDDEN *
+xbps_uring_get_sqe(struct xbps_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head, idx;
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (ring->sqe_tail - head >= ring->sq_entries)
+		return NULL;
+
+	idx = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[idx] = idx;
+	ring->sqe_tail++;
+
+	return sqe;
+}
+
+/*
+ * Submits all queued entries, returns 0 on success or an errno value.
+ */
+int HIDDEN
+xbps_uring_submit(struct xbps_uring *ring)
+{
+	unsigned to_submit;
+	int r;
+
+	to_submit = ring->sqe_tail - *ring->sq_tail;
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+	while (to_submit > 0) {
+		r = sys_io_uring_enter(ring->fd, to_submit, 0, 0);
+		if (r == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return errno;
+		}
+		to_submit -= (unsigned)r;
+	}
+	return 0;
+}
+
+/*
+ * Waits for a completion queue entry and copies it into \a cqe.
+ * Returns 0 on success or an errno value.
+ */
+int HIDDEN
+xbps_uring_wait_cqe(struct xbps_uring *ring, struct io_uring_cqe *cqe)
+{
+	unsigned head, tail;
+
+	for (;;) {
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		if (head != tail) {
+			*cqe = ring->cqes[head & *ring->cq_mask];
+			__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+			return 0;
+		}
+		if (sys_io_uring_enter(ring->fd, 0, 1,
+		    IORING_ENTER_GETEVENTS) == -1 && errno != EINTR)
+			return errno;
+	}
+}
@@ -42,6 +42,7 @@
 #include <fnmatch.h>
 #include <ctype.h>
 #include <libgen.h>
+#include <time.h>
 #include <sys/utsname.h>
 
 #include "xbps_api_impl.h"
@@ -699,3 +700,24 @@ xbps_patterns_match(xbps_array_t patterns, const char *path)
 
 	return match;
 }
+
+bool
+xbps_noextract_match(struct xbps_handle *xhp, const char *path)
+{
+	assert(xhp);
+
+	return xbps_matcher_match(xhp->noextract_matcher, path);
+}
+
+/*
+ * Returns the microseconds elapsed since \a t0 in the monotonic clock.
+ */
+uint64_t HIDDEN
+xbps_usecs_since(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (uint64_t)(t1.tv_sec - t0->tv_sec) * 1000000 +
+	    (uint64_t)(t1.tv_nsec / 1000) - (uint64_t)(t0->tv_nsec / 1000);
+}
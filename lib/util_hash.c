@@ -23,6 +23,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -30,8 +31,19 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
-#include <openssl/sha.h>
+#ifdef HAVE_XATTR
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#endif
+
+#include <openssl/evp.h>
 
 #include "xbps_api_impl.h"
 
@@ -108,13 +120,272 @@ xbps_mmap_file(const char *file, void **mmf, size_t *mmflen, size_t *filelen)
 	return true;
 }
 
+/*
+ * Files are hashed with read(2) and posix_fadvise(2), binary packages
+ * of HASH_MMAP_MIN bytes or more are mmap(2)ed with madvise(2) to avoid
+ * copying their data.
+ *
+ * A mapping raises SIGBUS if its file is truncated while it is read,
+ * so it is only used for binary packages: they are written to a
+ * temporary file that is renamed into place, never truncated. Other
+ * files, like the installed files checked by xbps-pkgdb(8), may be
+ * rewritten by another process meanwhile and must fail as a mismatch.
+ */
+#define HASH_BUFSIZE	(128 * 1024)
+#define HASH_MMAP_MIN	(256 * 1024)
+#define HASH_MMAP_CHUNK	(1024 * 1024)
+
+static pthread_mutex_t hash_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct xbps_hash_stats hash_stats;
+
+enum {
+	HASH_READ = 0,
+	HASH_MAPPED,
+	HASH_CACHED
+};
+
+static void
+hash_stats_add(uint64_t bytes, int how, const struct timespec *start)
+{
+	uint64_t usecs = xbps_usecs_since(start);
+
+	pthread_mutex_lock(&hash_stats_lock);
+	hash_stats.files++;
+	if (how == HASH_MAPPED)
+		hash_stats.mmap_files++;
+	else if (how == HASH_CACHED)
+		hash_stats.cached_files++;
+	hash_stats.bytes += bytes;
+	hash_stats.usecs += usecs;
+	pthread_mutex_unlock(&hash_stats_lock);
+}
+
+void
+xbps_file_hash_stats(struct xbps_hash_stats *stats, bool reset)
+{
+	pthread_mutex_lock(&hash_stats_lock);
+	if (stats != NULL)
+		*stats = hash_stats;
+	if (reset)
+		memset(&hash_stats, 0, sizeof(hash_stats));
+	pthread_mutex_unlock(&hash_stats_lock);
+}
+
+static bool
+hash_can_mmap(const char *file, const struct stat *st)
+{
+	size_t len = strlen(file);
+
+	if (!S_ISREG(st->st_mode) || st->st_size < HASH_MMAP_MIN ||
+	    (uint64_t)st->st_size > SIZE_MAX)
+		return false;
+	return len > 5 && strcmp(file + len - 5, ".xbps") == 0;
+}
+
+static int
+hash_mmap(EVP_MD_CTX *ctx, int fd, size_t size)
+{
+	unsigned char *mf;
+	size_t off, len;
+	int rv = 0;
+
+	mf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mf == MAP_FAILED)
+		return errno;
+	(void)posix_madvise(mf, size, POSIX_MADV_SEQUENTIAL);
+
+	for (off = 0; off < size; off += len) {
+		len = size - off;
+		if (len > HASH_MMAP_CHUNK)
+			len = HASH_MMAP_CHUNK;
+		if (EVP_DigestUpdate(ctx, mf + off, len) != 1) {
+			rv = EINVAL;
+			break;
+		}
+	}
+	(void)munmap(mf, size);
+	return rv;
+}
+
+static int
+hash_read(EVP_MD_CTX *ctx, int fd, char *buf, uint64_t *bytes)
+{
+	ssize_t len;
+
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+
+	while ((len = read(fd, buf, HASH_BUFSIZE)) > 0) {
+		if (EVP_DigestUpdate(ctx, buf, (size_t)len) != 1)
+			return EINVAL;
+		*bytes += (uint64_t)len;
+	}
+	if (len == -1)
+		return errno;
+	return 0;
+}
+
+/*
+ * SHA256 cache stored in the user.xbps.sha256 extended attribute of
+ * installed files: the digest is trusted while the file has the same
+ * mtime, size, inode number and inode generation it had when the
+ * attribute was set.
+ */
+#define HASH_XATTR	"user.xbps.sha256"
+
+struct hash_xattr {
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	uint64_t mtime_sec;
+	uint64_t mtime_nsec;
+	uint64_t size;
+	uint64_t ino;
+	uint64_t generation;
+};
+
+#ifdef HAVE_XATTR
+static void
+hash_xattr_stat(struct hash_xattr *hx, int fd, const struct stat *st)
+{
+	int generation = 0;
+
+#ifdef FS_IOC_GETVERSION
+	if (ioctl(fd, FS_IOC_GETVERSION, &generation) == -1)
+		generation = 0;
+#else
+	(void)fd;
+#endif
+	hx->mtime_sec = (uint64_t)st->st_mtim.tv_sec;
+	hx->mtime_nsec = (uint64_t)st->st_mtim.tv_nsec;
+	hx->size = (uint64_t)st->st_size;
+	hx->ino = (uint64_t)st->st_ino;
+	hx->generation = (uint64_t)(unsigned int)generation;
+}
+
+static bool
+hash_cache_get(int fd, const struct stat *st, unsigned char *digest)
+{
+	struct hash_xattr hx, cur;
+
+	if (fgetxattr(fd, HASH_XATTR, &hx, sizeof(hx)) != sizeof(hx))
+		return false;
+
+	hash_xattr_stat(&cur, fd, st);
+	if (hx.mtime_sec != cur.mtime_sec || hx.mtime_nsec != cur.mtime_nsec ||
+	    hx.size != cur.size || hx.ino != cur.ino ||
+	    hx.generation != cur.generation)
+		return false;
+
+	memcpy(digest, hx.digest, sizeof(hx.digest));
+	return true;
+}
+
+int HIDDEN
+xbps_file_hash_cache_set(const char *file, const unsigned char *digest)
+{
+	struct hash_xattr hx, cur;
+	struct stat st;
+	int fd, rv = 0;
+
+	if ((fd = open(file, O_RDONLY|O_CLOEXEC|O_NOFOLLOW|O_NONBLOCK)) == -1)
+		return errno;
+	if (fstat(fd, &st) == -1) {
+		rv = errno;
+	} else if (!S_ISREG(st.st_mode)) {
+		rv = EINVAL;
+	} else {
+		memset(&hx, 0, sizeof(hx));
+		memcpy(hx.digest, digest, sizeof(hx.digest));
+		hash_xattr_stat(&hx, fd, &st);
+		/* unchanged, e.g. hardlinked from the file store */
+		if ((fgetxattr(fd, HASH_XATTR, &cur,
+		    sizeof(cur)) != sizeof(cur) ||
+		    memcmp(&cur, &hx, sizeof(hx)) != 0) &&
+		    fsetxattr(fd, HASH_XATTR, &hx, sizeof(hx), 0) == -1)
+			rv = errno;
+	}
+	(void)close(fd);
+	return rv;
+}
+#else
+static bool
+hash_cache_get(int fd UNUSED, const struct stat *st UNUSED,
+		unsigned char *digest UNUSED)
+{
+	return false;
+}
+
+int HIDDEN
+xbps_file_hash_cache_set(const char *file UNUSED,
+		const unsigned char *digest UNUSED)
+{
+	return ENOTSUP;
+}
+#endif
+
+/*
+ * Hashes the file \a file with \a ctx into \a digest, using \a buf
+ * for reads. If \a cached is set, the digest is taken from the SHA256
+ * cache when valid and \a cached is set to true.
+ * Returns 0 on success, an errno value otherwise.
+ */
+static int
+hash_file(EVP_MD_CTX *ctx, char *buf, const char *file, unsigned char *digest,
+		bool *cached)
+{
+	struct timespec start;
+	struct stat st;
+	uint64_t bytes = 0;
+	bool mapped = false;
+	int fd, rv;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if ((fd = open(file, O_RDONLY|O_CLOEXEC)) < 0)
+		return errno;
+	if (fstat(fd, &st) == -1) {
+		rv = errno;
+		(void)close(fd);
+		return rv;
+	}
+	if (cached != NULL && (*cached = hash_cache_get(fd, &st, digest))) {
+		(void)close(fd);
+		hash_stats_add(0, HASH_CACHED, &start);
+		return 0;
+	}
+	if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+		(void)close(fd);
+		return EINVAL;
+	}
+	if (hash_can_mmap(file, &st) &&
+	    hash_mmap(ctx, fd, (size_t)st.st_size) == 0) {
+		mapped = true;
+		bytes = (uint64_t)st.st_size;
+		rv = 0;
+	} else {
+		/* read the file, restarting the digest if mmap failed */
+		if (hash_can_mmap(file, &st) &&
+		    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+			(void)close(fd);
+			return EINVAL;
+		}
+		rv = hash_read(ctx, fd, buf, &bytes);
+	}
+	(void)close(fd);
+
+	if (rv == 0 && EVP_DigestFinal_ex(ctx, digest, NULL) != 1)
+		rv = EINVAL;
+	if (rv == 0)
+		hash_stats_add(bytes, mapped ? HASH_MAPPED : HASH_READ, &start);
+
+	return rv;
+}
+
 bool
 xbps_file_sha256_raw(unsigned char *dst, size_t dstlen, const char *file)
 {
-	int fd;
-	ssize_t len;
-	char buf[65536];
-	SHA256_CTX sha256;
+	EVP_MD_CTX *ctx;
+	char *buf;
+	int rv;
 
 	assert(dstlen >= XBPS_SHA256_DIGEST_SIZE);
 	if (dstlen < XBPS_SHA256_DIGEST_SIZE) {
@@ -122,22 +393,123 @@ xbps_file_sha256_raw(unsigned char *dst, size_t dstlen, const char *file)
 		return false;
 	}
 
-	if ((fd = open(file, O_RDONLY)) < 0)
+	if ((buf = malloc(HASH_BUFSIZE)) == NULL)
+		return false;
+	if ((ctx = EVP_MD_CTX_new()) == NULL) {
+		free(buf);
+		errno = ENOMEM;
+		return false;
+	}
+	rv = hash_file(ctx, buf, file, dst, NULL);
+	EVP_MD_CTX_free(ctx);
+	free(buf);
+
+	if (rv != 0) {
+		errno = rv;
 		return false;
+	}
+	return true;
+}
 
-	SHA256_Init(&sha256);
+struct hash_batch {
+	struct xbps_sha256_item *items;
+	pthread_mutex_t lock;
+	unsigned int nitems;
+	unsigned int next;
+};
 
-	while ((len = read(fd, buf, sizeof(buf))) > 0)
-		SHA256_Update(&sha256, buf, len);
+static void *
+hash_batch_thread(void *arg)
+{
+	struct hash_batch *batch = arg;
+	struct xbps_sha256_item *item;
+	EVP_MD_CTX *ctx;
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	char *buf;
+	int rv = 0;
 
-	(void)close(fd);
+	buf = malloc(HASH_BUFSIZE);
+	ctx = EVP_MD_CTX_new();
+	if (buf == NULL || ctx == NULL)
+		rv = ENOMEM;
 
-	if(len == -1)
-		return false;
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		if (batch->next == batch->nitems) {
+			pthread_mutex_unlock(&batch->lock);
+			break;
+		}
+		item = &batch->items[batch->next++];
+		pthread_mutex_unlock(&batch->lock);
 
-	SHA256_Final(dst, &sha256);
+		if (rv != 0) {
+			item->rv = rv;
+			continue;
+		}
+		item->cached = false;
+		item->rv = hash_file(ctx, buf, item->file, digest,
+		    item->cache ? &item->cached : NULL);
+		if (item->rv != 0)
+			continue;
+		memcpy(item->digest, digest, sizeof(digest));
+		if (item->sha256 != NULL &&
+		    !xbps_sha256_digest_compare(item->sha256,
+		    strlen(item->sha256), digest, sizeof(digest)))
+			item->rv = ERANGE;
+		else if (item->cache && !item->cached && item->sha256 != NULL)
+			(void)xbps_file_hash_cache_set(item->file, digest);
+	}
+	EVP_MD_CTX_free(ctx);
+	free(buf);
 
-	return true;
+	return NULL;
+}
+
+int
+xbps_file_sha256_batch(struct xbps_sha256_item *items, unsigned int nitems,
+		unsigned int nthreads)
+{
+	struct hash_batch batch;
+	pthread_t *thds;
+	unsigned int i, n = 0;
+
+	if (nitems == 0)
+		return 0;
+
+	if (nthreads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 0 ? (unsigned int)ncpus : 1;
+	}
+	if (nthreads > nitems)
+		nthreads = nitems;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.items = items;
+	batch.nitems = nitems;
+	pthread_mutex_init(&batch.lock, NULL);
+
+	if (nthreads > 1 && (thds = calloc(nthreads, sizeof(*thds))) != NULL) {
+		for (i = 0; i < nthreads - 1; i++) {
+			if (pthread_create(&thds[i], NULL,
+			    hash_batch_thread, &batch) != 0)
+				break;
+			n++;
+		}
+		/* this thread hashes the remaining files, if any */
+		hash_batch_thread(&batch);
+		for (i = 0; i < n; i++)
+			pthread_join(thds[i], NULL);
+		free(thds);
+	} else {
+		hash_batch_thread(&batch);
+	}
+	pthread_mutex_destroy(&batch.lock);
+
+	for (i = 0; i < nitems; i++) {
+		if (items[i].rv != 0)
+			return items[i].rv;
+	}
+	return 0;
 }
 
 bool
@@ -159,8 +531,8 @@ xbps_file_sha256(char *dst, size_t dstlen, const char *file)
 	return true;
 }
 
-static bool
-sha256_digest_compare(const char *sha256, size_t shalen,
+bool HIDDEN
+xbps_sha256_digest_compare(const char *sha256, size_t shalen,
 		const unsigned char *digest, size_t digestlen)
 {
 
@@ -204,73 +576,35 @@ xbps_file_sha256_check(const char *file, const char *sha256)
 	if (!xbps_file_sha256_raw(digest, sizeof digest, file))
 		return errno;
 
-	if (!sha256_digest_compare(sha256, strlen(sha256), digest, sizeof digest))
+	if (!xbps_sha256_digest_compare(sha256, strlen(sha256), digest, sizeof digest))
 		return ERANGE;
 
 	return 0;
 }
 
-static const char *
-file_hash_dictionary(xbps_dictionary_t d, const char *key, const char *file)
-{
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
-	const char *curfile = NULL, *sha256 = NULL;
-
-	assert(xbps_object_type(d) == XBPS_TYPE_DICTIONARY);
-	assert(key != NULL);
-	assert(file != NULL);
-
-	iter = xbps_array_iter_from_dict(d, key);
-	if (iter == NULL) {
-		errno = ENOENT;
-		return NULL;
-	}
-	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
-		xbps_dictionary_get_cstring_nocopy(obj,
-		    "file", &curfile);
-		if (strcmp(file, curfile) == 0) {
-			/* file matched */
-			xbps_dictionary_get_cstring_nocopy(obj,
-			    "sha256", &sha256);
-			break;
-		}
-	}
-	xbps_object_iterator_release(iter);
-	if (sha256 == NULL)
-		errno = ENOENT;
-
-	return sha256;
-}
-
 int HIDDEN
-xbps_file_hash_check_dictionary(struct xbps_handle *xhp,
-				xbps_dictionary_t d,
-				const char *key,
-				const char *file)
+xbps_file_hash_check(struct xbps_handle *xhp, const char *file,
+		const char *sha256)
 {
-	const char *sha256d = NULL;
-	char *buf;
+	struct xbps_sha256_item item;
+	char *buf = NULL;
 	int rv;
 
-	assert(xbps_object_type(d) == XBPS_TYPE_DICTIONARY);
-	assert(key != NULL);
 	assert(file != NULL);
+	assert(sha256 != NULL);
 
-	if ((sha256d = file_hash_dictionary(d, key, file)) == NULL) {
-		if (errno == ENOENT)
-			return 1; /* no match, file not found */
-
-		return -1; /* error */
-	}
-
+	memset(&item, 0, sizeof(item));
 	if (strcmp(xhp->rootdir, "/") == 0) {
-		rv = xbps_file_sha256_check(file, sha256d);
+		item.file = file;
 	} else {
 		buf = xbps_xasprintf("%s/%s", xhp->rootdir, file);
-		rv = xbps_file_sha256_check(buf, sha256d);
-		free(buf);
+		item.file = buf;
 	}
+	item.sha256 = sha256;
+	item.cache = (xhp->flags & XBPS_FLAG_HASH_CACHE);
+	rv = xbps_file_sha256_batch(&item, 1, 1);
+	free(buf);
+
 	if (rv == 0)
 		return 0; /* matched */
 	else if (rv == ERANGE || rv == ENOENT)
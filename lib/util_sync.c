@@ -0,0 +1,187 @@
+/*-
+ * Copyright (c) 2026 The XBPS Developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_SYNCFS
+# define _GNU_SOURCE	/* for syncfs(2) */
+#endif
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Durability modes, set by the XBPS_FLAG_DURABILITY_* flags:
+ *
+ * 	- none: nothing is synchronized to disk.
+ * 	- transaction: the rootdir filesystem is synchronized once before
+ * 	  the final pkgdb write, only pkgdb writes are synchronized.
+ * 	- strict: every extracted file and metadata plist is synchronized,
+ * 	  as well as its parent directory.
+ * 	- default: metadata plists are synchronized.
+ */
+bool HIDDEN
+xbps_durability_sync(struct xbps_handle *xhp, bool commit)
+{
+	if (xhp->flags & XBPS_FLAG_DURABILITY_NONE)
+		return false;
+	if (xhp->flags & XBPS_FLAG_DURABILITY_TRANSACTION)
+		return commit;
+	return true;
+}
+
+int HIDDEN
+xbps_fsync_dir(const char *path)
+{
+	char dir[PATH_MAX], *p;
+	int fd, rv = 0;
+
+	if (xbps_strlcpy(dir, path, sizeof dir) >= sizeof dir)
+		return ENAMETOOLONG;
+	if ((p = strrchr(dir, '/')) == NULL)
+		xbps_strlcpy(dir, ".", sizeof dir);
+	else if (p == dir)
+		dir[1] = '\0';
+	else
+		*p = '\0';
+
+	if ((fd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1)
+		return errno;
+	if (fsync(fd) == -1)
+		rv = errno;
+	(void)close(fd);
+
+	return rv;
+}
+
+int HIDDEN
+xbps_fsync_file(const char *path)
+{
+	int fd, rv = 0;
+
+	if ((fd = open(path, O_RDONLY|O_NOFOLLOW|O_CLOEXEC)) == -1)
+		return errno;
+#ifdef HAVE_FDATASYNC
+	if (fdatasync(fd) == -1)
+#else
+	if (fsync(fd) == -1)
+#endif
+		rv = errno;
+	(void)close(fd);
+
+	return rv;
+}
+
+int HIDDEN
+xbps_syncfs(struct xbps_handle *xhp)
+{
+	int rv = 0;
+#ifdef HAVE_SYNCFS
+	int fd;
+
+	if ((fd = open(xhp->rootdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1)
+		return errno;
+	if (syncfs(fd) == -1)
+		rv = errno;
+	(void)close(fd);
+#else
+	(void)xhp;
+	sync();
+#endif
+	return rv;
+}
+
+/*
+ * Externalizes dictionary \a d to \a file atomically, honoring the
+ * durability mode. \a commit must be set for pkgdb writes.
+ */
+bool HIDDEN
+xbps_dictionary_externalize_sync(struct xbps_handle *xhp,
+		xbps_dictionary_t d, const char *file, bool commit)
+{
+	char *xml, *tname;
+	size_t len;
+	mode_t myumask;
+	int fd = -1, rv = 0;
+
+	if ((xml = xbps_dictionary_externalize(d)) == NULL)
+		return false;
+	len = strlen(xml);
+
+	tname = xbps_xasprintf("%s.XXXXXXXXXX", file);
+	myumask = umask(S_IXUSR|S_IRWXG|S_IRWXO);
+	fd = mkstemp(tname);
+	umask(myumask);
+	if (fd == -1) {
+		rv = errno;
+		goto out;
+	}
+	if (write(fd, xml, len) != (ssize_t)len) {
+		rv = errno ? errno : EIO;
+		goto out;
+	}
+	if (xbps_durability_sync(xhp, commit)) {
+#ifdef HAVE_FDATASYNC
+		if (fdatasync(fd) == -1) {
+#else
+		if (fsync(fd) == -1) {
+#endif
+			rv = errno;
+			goto out;
+		}
+	}
+	if (fchmod(fd, 0666 & ~myumask) == -1) {
+		rv = errno;
+		goto out;
+	}
+	(void)close(fd);
+	fd = -1;
+	if (rename(tname, file) == -1) {
+		rv = errno;
+		(void)unlink(tname);
+		goto out;
+	}
+	if (xhp->flags & XBPS_FLAG_DURABILITY_STRICT)
+		rv = xbps_fsync_dir(file);
+out:
+	if (fd != -1) {
+		(void)close(fd);
+		(void)unlink(tname);
+	}
+	free(tname);
+	free(xml);
+	if (rv != 0) {
+		errno = rv;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Downloads a large file from a local HTTP server with the default
+# and zero-copy (splice) download loops, with and without computing
+# its SHA256 hash, and prints the elapsed time and throughput of each.
+#
+# Usage: fetch.sh [size in MB] [runs] [port]
+#
+# The xbps utilities are taken from PATH, python3 is required for
+# the HTTP server.
+
+SIZE=${1:-1024}
+RUNS=${2:-3}
+PORT=${3:-8788}
+
+die() {
+	echo "ERROR: $@" >&2
+	exit 1
+}
+
+now() {
+	date +%s.%N
+}
+
+command -v python3 >/dev/null || die "python3 is required"
+
+WRKDIR=$(mktemp -d) || die "failed to create temporary directory"
+trap 'kill $SRVPID 2>/dev/null; rm -rf $WRKDIR' EXIT INT TERM
+
+cd $WRKDIR || die "cannot chdir to $WRKDIR"
+mkdir -p srv dl default.d zerocopy.d
+echo "zerocopy=true" > zerocopy.d/bench.conf
+
+echo "Creating ${SIZE}MB file ..."
+head -c $((SIZE * 1024 * 1024)) /dev/urandom > srv/bench.bin ||
+	die "failed to create file"
+
+python3 -m http.server --bind 127.0.0.1 --directory srv $PORT \
+	>/dev/null 2>&1 &
+SRVPID=$!
+i=0
+until xbps-fetch -o dl/probe http://127.0.0.1:$PORT/ >/dev/null 2>&1; do
+	i=$((i + 1))
+	[ $i -lt 50 ] || die "HTTP server did not start"
+	sleep 0.1
+done
+
+for mode in default zerocopy; do
+	for sha in no yes; do
+		[ $sha = yes ] && shaopt=-s || shaopt=
+		run=1
+		while [ $run -le $RUNS ]; do
+			rm -f dl/bench.bin
+			start=$(now)
+			xbps-fetch -C $WRKDIR/$mode.d $shaopt -o dl/bench.bin \
+				http://127.0.0.1:$PORT/bench.bin >/dev/null ||
+				die "xbps-fetch failed"
+			end=$(now)
+			cmp -s srv/bench.bin dl/bench.bin ||
+				die "downloaded file differs"
+			echo "$mode $sha $run $start $end $SIZE" | \
+				awk '{ printf "%-8s sha256=%-3s run %d: %.3fs %7.1f MB/s\n",
+				    $1, $2, $3, $5 - $4, $6 / ($5 - $4) }'
+			run=$((run + 1))
+		done
+	done
+done
@@ -0,0 +1,115 @@
+#!/bin/sh
+#
+# Rewrites the repodata of a synthetic repository index with every
+# compression format, level and number of threads, and prints the
+# elapsed time and the size of the repodata archive of each.
+#
+# Usage: repodata.sh [packages] [threads]
+#
+# The xbps utilities are taken from PATH, python3 is required to
+# generate the index.
+
+NPKGS=${1:-20000}
+THREADS=${2:-4}
+
+die() {
+	echo "ERROR: $@" >&2
+	exit 1
+}
+
+now() {
+	date +%s.%N
+}
+
+command -v python3 >/dev/null || die "python3 is required"
+
+WRKDIR=$(mktemp -d) || die "failed to create temporary directory"
+trap 'rm -rf $WRKDIR' EXIT INT TERM
+
+cd $WRKDIR || die "cannot chdir to $WRKDIR"
+mkdir -p repo
+ARCH=$(xbps-uhelper arch) || die "cannot get native architecture"
+
+echo "Creating index with $NPKGS packages ..."
+python3 - $NPKGS repo/$ARCH-repodata <<'EOF' || die "failed to create index"
+import io, random, sys, tarfile
+
+npkgs, repodata = int(sys.argv[1]), sys.argv[2]
+rnd = random.Random(0)
+words = ["lib", "data", "devel", "doc", "python3", "perl", "gtk", "qt5",
+    "utils", "tools", "fonts", "server", "client", "plugins", "extra"]
+out = ['<?xml version="1.0" encoding="UTF-8"?>',
+    '<!DOCTYPE plist PUBLIC "-//Apple Computer//DTD PLIST 1.0//EN" '
+    '"http://www.apple.com/DTDs/PropertyList-1.0.dtd">',
+    '<plist version="1.0">', '<dict>']
+names = ["%s-%s%d" % (rnd.choice(words), rnd.choice(words), i)
+    for i in range(npkgs)]
+for i, name in enumerate(names):
+    pkgver = "%s-%d.%d.%d_%d" % (name, rnd.randint(0, 9),
+        rnd.randint(0, 30), rnd.randint(0, 99), rnd.randint(1, 5))
+    deps = rnd.sample(names[:i] or [name], min(i, rnd.randint(0, 6)))
+    out += ['\t<key>%s</key>' % name, '\t<dict>',
+        '\t\t<key>architecture</key>', '\t\t<string>x86_64</string>',
+        '\t\t<key>build-date</key>',
+        '\t\t<string>2020-%02d-%02d %02d:%02d UTC</string>' %
+        (rnd.randint(1, 12), rnd.randint(1, 28), rnd.randint(0, 23),
+        rnd.randint(0, 59)),
+        '\t\t<key>filename-sha256</key>',
+        '\t\t<string>%064x</string>' % rnd.getrandbits(256),
+        '\t\t<key>filename-size</key>',
+        '\t\t<integer>%d</integer>' % rnd.randint(1024, 1 << 26),
+        '\t\t<key>homepage</key>',
+        '\t\t<string>https://www.example.org/%s</string>' % name,
+        '\t\t<key>installed_size</key>',
+        '\t\t<integer>%d</integer>' % rnd.randint(1024, 1 << 28),
+        '\t\t<key>license</key>',
+        '\t\t<string>%s</string>' % rnd.choice(["GPL-2.0-or-later",
+            "MIT", "BSD-3-Clause", "Apache-2.0", "LGPL-2.1-or-later"]),
+        '\t\t<key>maintainer</key>',
+        '\t\t<string>Maintainer %d &lt;m%d@example.org&gt;</string>' %
+        (i % 97, i % 97),
+        '\t\t<key>pkgver</key>', '\t\t<string>%s</string>' % pkgver]
+    if deps:
+        out += ['\t\t<key>run_depends</key>', '\t\t<array>']
+        out += ['\t\t\t<string>%s&gt;=0</string>' % d for d in deps]
+        out += ['\t\t</array>']
+    out += ['\t\t<key>short_desc</key>',
+        '\t\t<string>The %s package</string>' % name.replace("-", " "),
+        '\t</dict>']
+out += ['</dict>', '</plist>', '']
+
+with tarfile.open(repodata, "w", format=tarfile.PAX_FORMAT) as tar:
+    for fname, buf in (("index.plist", "\n".join(out).encode()),
+            ("index-meta.plist", b"DEADBEEF")):
+        ti = tarfile.TarInfo(fname)
+        ti.size, ti.mode = len(buf), 0o644
+        tar.addfile(ti, io.BytesIO(buf))
+EOF
+
+run() {
+	comp=$1 level=$2 threads=$3
+	set -- --compression $comp
+	[ "$level" != - ] && set -- "$@" --compression-level $level
+	[ "$threads" != - ] && set -- "$@" --compression-threads $threads
+	start=$(now)
+	xbps-rindex "$@" --compact $WRKDIR/repo >/dev/null ||
+		die "xbps-rindex failed with $*"
+	end=$(now)
+	size=$(wc -c < repo/$ARCH-repodata)
+	echo "$comp $level $threads $start $end $size" | \
+		awk '{ printf "%-6s level %-3s threads %-2s %7.3fs %10d bytes\n",
+		    $1, $2, $3, $5 - $4, $6 }'
+}
+
+run none - -
+for level in 1 3 9 19; do
+	run zstd $level -
+	run zstd $level $THREADS
+done
+for level in 1 6 9; do
+	run gzip $level -
+	run bzip2 $level -
+	run lz4 $level -
+	run xz $level -
+	run xz $level $THREADS
+done
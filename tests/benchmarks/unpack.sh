@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# Unpacks a synthetic package with many small files with the default
+# and io_uring file writers, and prints the elapsed time of each.
+#
+# Usage: unpack.sh [nfiles] [runs]
+#
+# The xbps utilities are taken from PATH.
+
+NFILES=${1:-50000}
+RUNS=${2:-3}
+
+die() {
+	echo "ERROR: $@" >&2
+	exit 1
+}
+
+now() {
+	date +%s.%N
+}
+
+WRKDIR=$(mktemp -d) || die "failed to create temporary directory"
+trap 'rm -rf $WRKDIR' EXIT INT TERM
+
+cd $WRKDIR || die "cannot chdir to $WRKDIR"
+mkdir -p pkg_bench repo
+
+echo "Creating package with $NFILES files ..."
+i=0
+while [ $i -lt $NFILES ]; do
+	d=pkg_bench/usr/share/bench/$((i / 500))
+	[ -d $d ] || mkdir -p $d
+	echo "file $i" > $d/$i
+	i=$((i + 1))
+done
+(cd repo && xbps-create -A noarch -n bench-1.0_1 -s "bench pkg" \
+	../pkg_bench >/dev/null) || die "xbps-create failed"
+xbps-rindex -a $WRKDIR/repo/*.xbps >/dev/null || die "xbps-rindex failed"
+
+for writer in default iouring; do
+	run=1
+	while [ $run -le $RUNS ]; do
+		rm -rf root
+		mkdir -p root/xbps.d
+		if [ $writer = iouring ]; then
+			echo "iouring=true" > root/xbps.d/bench.conf
+		fi
+		start=$(now)
+		xbps-install -C xbps.d -r root --repository=$WRKDIR/repo \
+			-y bench >/dev/null || die "xbps-install failed"
+		end=$(now)
+		echo "$writer $run $start $end" | \
+			awk '{ printf "%-8s run %d: %.3fs\n", $1, $2, $4 - $3 }'
+		run=$((run + 1))
+	done
+done
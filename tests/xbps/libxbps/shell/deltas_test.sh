@@ -0,0 +1,89 @@
+#! /usr/bin/env atf-sh
+# Test that binary package deltas work as expected.
+
+# Deltas are only used with remote repositories: the repository url is
+# unreachable and its mirror is a local copy, signed as remote
+# repositories must be.
+REPO=http://127.0.0.1:9/repo
+
+create_pkg() {
+	echo $1 > pkg_A/usr/bin/foo
+	cd repo
+	xbps-create -A noarch -n foo-$1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d $2 -a $PWD/foo-$1.noarch.xbps 2>err
+	atf_check_equal $? 0
+	if grep -q "not supported" err; then
+		atf_skip "xbps built without libzstd"
+	fi
+	xbps-rindex -d --privkey ../key.pem -S $PWD/foo-$1.noarch.xbps
+	atf_check_equal $? 0
+	cd ..
+}
+
+create_repo() {
+	command -v openssl >/dev/null || atf_skip "openssl is required"
+	mkdir -p repo pkg_A/usr/bin pkg_A/usr/share/foo root/xbps.d
+	for f in 0 1 2 3; do
+		dd if=/dev/urandom of=pkg_A/usr/share/foo/file0$f bs=64k count=1 2>/dev/null
+	done
+	openssl genrsa -out key.pem 2048 2>/dev/null
+	atf_check_equal $? 0
+	create_pkg 1.0_1
+	xbps-rindex -d --privkey key.pem --signedby "test <test@example.org>" -s $PWD/repo
+	atf_check_equal $? 0
+	# the updated index must be newer in the next sync
+	touch -mt 197001010000.00 repo/*-repodata
+	printf "mirror=$REPO file://$PWD/repo\ndeltas=true\n" > root/xbps.d/deltas.conf
+	# the repository key is imported on the first sync
+	yes | xbps-install -C xbps.d -r root --repository=$REPO -Syd foo
+	atf_check_equal $? 0
+}
+
+atf_test_case update
+
+update_head() {
+	atf_set "descr" "Tests for deltas: update reconstructed from the cached package"
+}
+
+update_body() {
+	create_repo
+	create_pkg 1.1_1 "--deltas 1"
+	[ -f repo/foo-1.1_1.from-1.0_1.noarch.xbpsd ]
+	atf_check_equal $? 0
+	out=$(xbps-install -C xbps.d -r root --repository=$REPO -Syud 2>&1)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "\`foo-1.1_1' reconstructed from \`foo-1.0_1'"
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root/usr/bin/foo)" "1.1_1"
+	cmp -s repo/foo-1.1_1.noarch.xbps root/var/cache/xbps/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-pkgdb -C xbps.d -r root foo
+	atf_check_equal $? 0
+}
+
+atf_test_case update_corrupt
+
+update_corrupt_head() {
+	atf_set "descr" "Tests for deltas: a corrupt delta falls back to the package"
+}
+
+update_corrupt_body() {
+	create_repo
+	create_pkg 1.1_1 "--deltas 1"
+	echo garbage >> repo/foo-1.1_1.from-1.0_1.noarch.xbpsd
+	out=$(xbps-install -C xbps.d -r root --repository=$REPO -Syud 2>&1)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "foo-1.1_1.from-1.0_1.noarch.xbpsd': SHA256 mismatch"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "reconstructed from"
+	atf_check_equal $? 1
+	atf_check_equal "$(cat root/usr/bin/foo)" "1.1_1"
+	cmp -s repo/foo-1.1_1.noarch.xbps root/var/cache/xbps/foo-1.1_1.noarch.xbps
+	atf_check_equal $? 0
+}
+
+atf_init_test_cases() {
+	atf_add_test_case update
+	atf_add_test_case update_corrupt
+}
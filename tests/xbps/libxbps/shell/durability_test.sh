@@ -0,0 +1,68 @@
+#!/usr/bin/env atf-sh
+
+durability_install() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin pkg_A/etc
+	echo "foofoo" > pkg_A/usr/bin/foo
+	ln -s foo pkg_A/usr/bin/bar
+	echo "conf" > pkg_A/etc/foo.conf
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" --config-files "/etc/foo.conf" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "durability=$1" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/bin/foo)" "foofoo"
+	atf_check_equal "$(readlink root/usr/bin/bar)" "foo"
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+
+	xbps-remove -C xbps.d -r root -yd A
+	atf_check_equal $? 0
+	test -e root/usr/bin/foo
+	atf_check_equal $? 1
+}
+
+atf_test_case none
+
+none_head() {
+	atf_set "descr" "Tests for pkg install/remove with durability=none"
+}
+
+none_body() {
+	durability_install none
+}
+
+atf_test_case transaction
+
+transaction_head() {
+	atf_set "descr" "Tests for pkg install/remove with durability=transaction"
+}
+
+transaction_body() {
+	durability_install transaction
+}
+
+atf_test_case strict
+
+strict_head() {
+	atf_set "descr" "Tests for pkg install/remove with durability=strict"
+}
+
+strict_body() {
+	durability_install strict
+}
+
+atf_init_test_cases() {
+	atf_add_test_case none
+	atf_add_test_case transaction
+	atf_add_test_case strict
+}
@@ -0,0 +1,201 @@
+#! /usr/bin/env atf-sh
+# Test that interrupted parallel range downloads are resumed safely.
+
+# A HTTP server with support for byte ranges, that drops the reply to
+# the request number $FAIL_AT halfway.
+start_server() {
+	command -v python3 >/dev/null || atf_skip "python3 is required"
+	cat > server.py <<'EOF'
+import http.server, os, re, sys, threading
+
+root, portfile = sys.argv[1], sys.argv[2]
+fail_at = int(os.environ.get("FAIL_AT", "0"))
+count, lock = [0], threading.Lock()
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    def log_message(self, fmt, *args):
+        pass
+    def reply(self, head):
+        path = os.path.join(root, self.path.lstrip("/"))
+        if not os.path.isfile(path):
+            self.send_response(404)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        st = os.stat(path)
+        start, end = 0, st.st_size - 1
+        rng = re.match(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+        if rng:
+            start = int(rng.group(1))
+            if rng.group(2):
+                end = min(int(rng.group(2)), end)
+            if start > end:
+                self.send_response(416)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            self.send_response(206)
+            self.send_header("Content-Range",
+                "bytes %d-%d/%d" % (start, end, st.st_size))
+        else:
+            self.send_response(200)
+        self.send_header("Content-Length", str(end - start + 1))
+        self.send_header("Last-Modified",
+            self.date_time_string(int(st.st_mtime)))
+        self.end_headers()
+        if head:
+            return
+        with lock:
+            count[0] += 1
+            n = count[0]
+        with open(path, "rb") as f:
+            f.seek(start)
+            left = end - start + 1
+            while left > 0:
+                if n == fail_at and left < (end - start + 1) // 2:
+                    self.close_connection = True
+                    return
+                buf = f.read(min(65536, left))
+                self.wfile.write(buf)
+                left -= len(buf)
+    def do_HEAD(self):
+        self.reply(True)
+    def do_GET(self):
+        self.reply(False)
+
+srv = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+with open(portfile + ".tmp", "w") as f:
+    f.write(str(srv.server_address[1]))
+os.rename(portfile + ".tmp", portfile)
+srv.serve_forever()
+EOF
+	rm -f port
+	python3 server.py $PWD/srv $PWD/port &
+	SRVPID=$!
+	i=0
+	while [ ! -f port ]; do
+		i=$((i + 1))
+		[ $i -lt 50 ] || atf_fail "HTTP server did not start"
+		sleep 0.1
+	done
+	URL=http://127.0.0.1:$(cat port)/file
+}
+
+stop_server() {
+	kill $SRVPID
+	wait $SRVPID 2>/dev/null
+}
+
+create_file() {
+	mkdir -p srv serial.d parallel.d
+	# three ranges of XBPS_FETCH_PARALLEL_CHUNK (8MB)
+	head -c 20971520 /dev/urandom > srv/file
+	echo "parallelfetch=false" > serial.d/fetch.conf
+	echo "parallelfetch=true" > parallel.d/fetch.conf
+}
+
+atf_test_case resume_serial
+
+resume_serial_head() {
+	atf_set "descr" "Tests for parallel downloads: interrupted, resumed serially"
+}
+
+resume_serial_body() {
+	create_file
+	FAIL_AT=2 start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 1
+	stop_server
+	[ -f file.ranges.map ]
+	atf_check_equal $? 0
+	# the sparse file is not resumed as a serial download
+	[ -f file.part ]
+	atf_check_equal $? 1
+	start_server
+	xbps-fetch -C $PWD/serial.d -o file $URL
+	atf_check_equal $? 0
+	stop_server
+	cmp -s srv/file file
+	atf_check_equal $? 0
+	[ -f file.ranges -o -f file.ranges.map ]
+	atf_check_equal $? 1
+}
+
+atf_test_case resume_nomap
+
+resume_nomap_head() {
+	atf_set "descr" "Tests for parallel downloads: interrupted, resumed without its map file"
+}
+
+resume_nomap_body() {
+	create_file
+	FAIL_AT=2 start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 1
+	stop_server
+	rm -f file.ranges.map
+	start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 0
+	stop_server
+	cmp -s srv/file file
+	atf_check_equal $? 0
+}
+
+atf_test_case resume_parallel
+
+resume_parallel_head() {
+	atf_set "descr" "Tests for parallel downloads: interrupted serial download, resumed in parallel"
+}
+
+resume_parallel_body() {
+	create_file
+	FAIL_AT=1 start_server
+	xbps-fetch -C $PWD/serial.d -o file $URL
+	atf_check_equal $? 1
+	stop_server
+	[ -s file.part ]
+	atf_check_equal $? 0
+	start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 0
+	stop_server
+	cmp -s srv/file file
+	atf_check_equal $? 0
+	[ -f file.part -o -f file.ranges -o -f file.ranges.map ]
+	atf_check_equal $? 1
+}
+
+atf_test_case resume_stale_part
+
+resume_stale_part_head() {
+	atf_set "descr" "Tests for parallel downloads: interrupted, resumed with a stale partial file"
+}
+
+resume_stale_part_body() {
+	create_file
+	FAIL_AT=2 start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 1
+	stop_server
+	[ -f file.ranges -a -f file.ranges.map ]
+	atf_check_equal $? 0
+	# left by an earlier interrupted serial download
+	head -c 65536 /dev/urandom > file.part
+	start_server
+	xbps-fetch -C $PWD/parallel.d -o file $URL
+	atf_check_equal $? 0
+	stop_server
+	cmp -s srv/file file
+	atf_check_equal $? 0
+	[ -f file.part -o -f file.ranges -o -f file.ranges.map ]
+	atf_check_equal $? 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case resume_serial
+	atf_add_test_case resume_nomap
+	atf_add_test_case resume_parallel
+	atf_add_test_case resume_stale_part
+}
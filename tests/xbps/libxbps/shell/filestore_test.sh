@@ -0,0 +1,112 @@
+#!/usr/bin/env atf-sh
+
+filestore_pkgs() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/share/licenses/A pkg_A/etc
+	echo "license" > pkg_A/usr/share/licenses/A/LICENSE
+	echo "conf" > pkg_A/etc/foo.conf
+	mkdir -p pkg_B/usr/share/licenses/B pkg_B/etc
+	cp -p pkg_A/usr/share/licenses/A/LICENSE pkg_B/usr/share/licenses/B/LICENSE
+	cp -p pkg_A/etc/foo.conf pkg_B/etc/bar.conf
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" --config-files "/etc/foo.conf" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" --config-files "/etc/bar.conf" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "filestore=$1" > root/xbps.d/foo.conf
+	mkdir cache
+}
+
+atf_test_case hardlink
+
+hardlink_head() {
+	atf_set "descr" "Tests for pkg install/remove with filestore=hardlink"
+}
+
+hardlink_body() {
+	filestore_pkgs hardlink
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd B
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/share/licenses/B/LICENSE)" "license"
+	atf_check_equal "$(stat -c %i root/usr/share/licenses/A/LICENSE)" \
+		"$(stat -c %i root/usr/share/licenses/B/LICENSE)"
+	atf_check_equal "$(stat -c %h root/usr/share/licenses/B/LICENSE)" 3
+	# configuration files are never shared
+	atf_check_equal "$(stat -c %h root/etc/bar.conf)" 1
+
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+
+	xbps-remove -C xbps.d -r root -yd A
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root/usr/share/licenses/B/LICENSE)" "license"
+
+	xbps-remove -C xbps.d -c $PWD/cache -r root -O
+	atf_check_equal $? 0
+	atf_check_equal "$(stat -c %h root/usr/share/licenses/B/LICENSE)" 2
+
+	xbps-remove -C xbps.d -r root -yd B
+	atf_check_equal $? 0
+	xbps-remove -C xbps.d -c $PWD/cache -r root -O
+	atf_check_equal $? 0
+	atf_check_equal "$(find root/var/db/xbps/store -type f | wc -l)" 0
+}
+
+atf_test_case reflink
+
+reflink_head() {
+	atf_set "descr" "Tests for pkg install with filestore=reflink"
+}
+
+reflink_body() {
+	filestore_pkgs reflink
+
+	# falls back to extraction on filesystems without reflink support
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A B
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/share/licenses/A/LICENSE)" "license"
+	atf_check_equal "$(cat root/usr/share/licenses/B/LICENSE)" "license"
+	atf_check_equal "$(stat -c %h root/usr/share/licenses/B/LICENSE)" 1
+
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+}
+
+atf_test_case modified
+
+modified_head() {
+	atf_set "descr" "Tests for pkg install with a store file modified in place"
+}
+
+modified_body() {
+	filestore_pkgs hardlink
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+
+	# same size and metadata, different data
+	cp -p root/usr/share/licenses/A/LICENSE ref
+	printf "LICENSE\n" > root/usr/share/licenses/A/LICENSE
+	touch -r ref root/usr/share/licenses/A/LICENSE
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd B
+	atf_check_equal $? 0
+	atf_check_equal "$(cat root/usr/share/licenses/B/LICENSE)" "license"
+	atf_check_equal "$(stat -c %h root/usr/share/licenses/A/LICENSE)" 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case hardlink
+	atf_add_test_case reflink
+	atf_add_test_case modified
+}
@@ -0,0 +1,39 @@
+#! /usr/bin/env atf-sh
+# Test that only binary packages are hashed through mmap(2).
+
+atf_test_case installed_files
+
+installed_files_head() {
+	atf_set "descr" "Tests for mmap hashing: installed files are read, packages mapped"
+}
+
+installed_files_body() {
+	mkdir -p some_repo pkg_A/usr/share/A root/var/cache/xbps
+	# bigger than the mmap threshold (256 KiB), also once compressed
+	head -c 524288 /dev/urandom > pkg_A/usr/share/A/file
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+	out=$(xbps-pkgdb -r root -av)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "files (0 mmapped"
+	atf_check_equal $? 0
+	cp some_repo/A-1.0_1.noarch.xbps root/var/cache/xbps
+	mkdir -p root/xbps.d
+	echo "repository=$PWD/some_repo" > root/xbps.d/repo.conf
+	out=$(xbps-remove -C xbps.d -r root -Ov)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "Hashed 1 packages (1 mmapped"
+	atf_check_equal $? 0
+	[ -f root/var/cache/xbps/A-1.0_1.noarch.xbps ]
+	atf_check_equal $? 0
+}
+
+atf_init_test_cases() {
+	atf_add_test_case installed_files
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env atf-sh
+
+hashcache_install() {
+	mkdir -p some_repo pkg_A/usr/share/A root/xbps.d
+	echo "A" > pkg_A/usr/share/A/file
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	echo "hashcache=true" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+	out=$(xbps-pkgdb -C xbps.d -r root -av)
+	atf_check_equal $? 0
+	case "$out" in
+	*"1 cached"*) ;;
+	*) atf_skip "no support for user extended attributes";;
+	esac
+}
+
+atf_test_case unchanged
+
+unchanged_head() {
+	atf_set "descr" "Tests for the SHA256 hash cache: stat data did not change"
+}
+
+unchanged_body() {
+	hashcache_install
+	# same size and mtime, the cached hash is trusted
+	touch -r root/usr/share/A/file ref
+	echo "B" > root/usr/share/A/file
+	touch -r ref root/usr/share/A/file
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+	# not without the cache
+	rm root/xbps.d/foo.conf
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 1
+}
+
+atf_test_case changed
+
+changed_head() {
+	atf_set "descr" "Tests for the SHA256 hash cache: stat data changed"
+}
+
+changed_body() {
+	hashcache_install
+	echo "B" > root/usr/share/A/file
+	touch -d "2001-01-01" root/usr/share/A/file
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 1
+}
+
+atf_test_case obsolete
+
+obsolete_head() {
+	atf_set "descr" "Tests for the SHA256 hash cache: obsolete files"
+}
+
+obsolete_body() {
+	hashcache_install
+	# same size and mtime, the cached hash is trusted and the
+	# obsolete file is removed by the update
+	touch -r root/usr/share/A/file ref
+	echo "B" > root/usr/share/A/file
+	touch -r ref root/usr/share/A/file
+	rm pkg_A/usr/share/A/file
+	echo "A" > pkg_A/usr/share/A/file2
+	cd some_repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yud
+	atf_check_equal $? 0
+	[ -f root/usr/share/A/file ]
+	atf_check_equal $? 1
+}
+
+atf_init_test_cases() {
+	atf_add_test_case unchanged
+	atf_add_test_case changed
+	atf_add_test_case obsolete
+}
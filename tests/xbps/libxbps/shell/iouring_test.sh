@@ -0,0 +1,72 @@
+#!/usr/bin/env atf-sh
+
+atf_test_case install_update
+
+install_update_head() {
+	atf_set "descr" "Tests for pkg install/update with iouring=true"
+}
+
+install_update_body() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin pkg_A/usr/share/A pkg_A/etc
+	echo "foofoo" > pkg_A/usr/bin/foo
+	chmod 4755 pkg_A/usr/bin/foo
+	touch pkg_A/usr/share/A/empty
+	ln pkg_A/usr/bin/foo pkg_A/usr/bin/foo2
+	ln -s foo pkg_A/usr/bin/bar
+	dd if=/dev/urandom of=pkg_A/usr/share/A/blob bs=1024 count=2048 2>/dev/null
+	for f in $(seq 100); do
+		echo "$f" > pkg_A/usr/share/A/file$f
+	done
+	echo "conf" > pkg_A/etc/foo.conf
+	touch -d "2020-01-01 00:00:00" pkg_A/usr/share/A/file1
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" --config-files "/etc/foo.conf" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "iouring=true" > root/xbps.d/foo.conf
+
+	# the files are created with the unpack umask, not the caller's one
+	(umask 077; xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A)
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/bin/foo)" "foofoo"
+	atf_check_equal "$(stat -c %a root/usr/share/A/file100)" "644"
+	atf_check_equal "$(stat -c %a root/usr/bin/foo)" "4755"
+	atf_check_equal "$(stat -c %i root/usr/bin/foo)" "$(stat -c %i root/usr/bin/foo2)"
+	atf_check_equal "$(readlink root/usr/bin/bar)" "foo"
+	atf_check_equal "$(cat root/usr/share/A/file100)" "100"
+	atf_check_equal "$(stat -c %Y root/usr/share/A/file1)" "$(stat -c %Y pkg_A/usr/share/A/file1)"
+	cmp -s root/usr/share/A/blob pkg_A/usr/share/A/blob
+	atf_check_equal $? 0
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+
+	for f in $(seq 100); do
+		echo "new $f" > pkg_A/usr/share/A/file$f
+	done
+	cd some_repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" --config-files "/etc/foo.conf" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yud
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/share/A/file100)" "new 100"
+	atf_check_equal "$(cat root/etc/foo.conf)" "conf"
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+}
+
+atf_init_test_cases() {
+	atf_add_test_case install_update
+}
@@ -0,0 +1,147 @@
+#! /usr/bin/env atf-sh
+# Test that repository mirrors work as expected.
+
+# The repository url is unreachable, its mirrors are local copies.
+REPO=http://127.0.0.1:9/repo
+
+create_repo() {
+	mkdir -p repo pkg_A/usr/bin
+	echo "A" > pkg_A/usr/bin/A
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	cp -a repo mirror1
+	cp -a repo mirror2
+	mkdir -p root/xbps.d
+}
+
+atf_test_case conf
+
+conf_head() {
+	atf_set "descr" "Tests for mirrors: parsing of the mirror keyword"
+}
+
+conf_body() {
+	mkdir -p root/xbps.d
+	cat > root/xbps.d/mirrors.conf <<EOF
+mirror=$REPO file://$PWD/mirror1 https://mirror.example.org/repo
+mirror=$REPO file://$PWD/mirror1 $REPO
+mirror=$REPO $PWD/mirror2
+mirror=$PWD/repo file://$PWD/mirror2
+EOF
+	out=$(xbps-query -C xbps.d -r root -d --repository=$REPO -L 2>&1)
+	result=$(echo "$out" | grep -c "added mirror")
+	atf_check_equal "$result" 2
+	echo "$out" | grep -q "added mirror file://$PWD/mirror1 for $REPO"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "added mirror https://mirror.example.org/repo for $REPO"
+	atf_check_equal $? 0
+	result=$(echo "$out" | grep -c "ignoring invalid mirror option at line 4")
+	atf_check_equal "$result" 1
+}
+
+atf_test_case failover
+
+failover_head() {
+	atf_set "descr" "Tests for mirrors: sync from a mirror if the repository is down"
+}
+
+failover_body() {
+	create_repo
+	echo "mirror=$REPO file://$PWD/mirror1" > root/xbps.d/mirrors.conf
+	out=$(xbps-install -C xbps.d -r root -d --repository=$REPO -S 2>&1)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "\[mirror\] $REPO\[0\]: file://$PWD/mirror1 (healthy"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "\[mirror\] $REPO\[1\]: $REPO (failed"
+	atf_check_equal $? 0
+	result=$(xbps-query -C xbps.d -r root --repository=$REPO -Rs A)
+	atf_check_equal "$result" "[-] A-1.0_1 A pkg"
+	# the probes are kept in the package database directory
+	grep -q "<key>file://$PWD/mirror1</key>" root/var/db/xbps/mirrors.plist
+	atf_check_equal $? 0
+}
+
+atf_test_case ranking
+
+ranking_head() {
+	atf_set "descr" "Tests for mirrors: ranking by round trip time and throughput"
+}
+
+ranking_body() {
+	create_repo
+	echo "mirror=$REPO file://$PWD/mirror1 file://$PWD/mirror2" > root/xbps.d/mirrors.conf
+	now=$(date +%s)
+	# mirror1 answers faster but downloads slower than mirror2:
+	# 1ms + 1MB at 1MB/s vs 5ms + 1MB at 10MB/s.
+	mkdir -p root/var/db/xbps
+	cat > root/var/db/xbps/mirrors.plist <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE plist PUBLIC "-//Apple Computer//DTD PLIST 1.0//EN" "http://www.apple.com/DTDs/PropertyList-1.0.dtd">
+<plist version="1.0">
+<dict>
+	<key>$REPO</key>
+	<dict>
+		<key>healthy</key>
+		<false/>
+		<key>probed</key>
+		<integer>$now</integer>
+	</dict>
+	<key>file://$PWD/mirror1</key>
+	<dict>
+		<key>healthy</key>
+		<true/>
+		<key>probed</key>
+		<integer>$now</integer>
+		<key>rtt</key>
+		<integer>1000</integer>
+		<key>throughput</key>
+		<integer>1048576</integer>
+	</dict>
+	<key>file://$PWD/mirror2</key>
+	<dict>
+		<key>healthy</key>
+		<true/>
+		<key>probed</key>
+		<integer>$now</integer>
+		<key>rtt</key>
+		<integer>5000</integer>
+		<key>throughput</key>
+		<integer>10485760</integer>
+	</dict>
+</dict>
+</plist>
+EOF
+	out=$(xbps-install -C xbps.d -r root -d --repository=$REPO -S 2>&1)
+	atf_check_equal $? 0
+	# recent probes are not repeated
+	echo "$out" | grep -q "usecs$"
+	atf_check_equal $? 1
+	echo "$out" | grep -q "\[mirror\] $REPO\[0\]: file://$PWD/mirror2 (healthy"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "\[mirror\] $REPO\[1\]: file://$PWD/mirror1 (healthy"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "Updating repository \`file://$PWD/mirror2/"
+	atf_check_equal $? 0
+
+	# the best mirror fails: the next one is used and marked as failed
+	rm -f mirror2/*-repodata
+	rm -rf root/var/db/xbps/http*
+	out=$(xbps-install -C xbps.d -r root -d --repository=$REPO -S 2>&1)
+	atf_check_equal $? 0
+	echo "$out" | grep -q "\[mirror\] file://$PWD/mirror2: marked as failed"
+	atf_check_equal $? 0
+	echo "$out" | grep -q "Updating repository \`file://$PWD/mirror1/"
+	atf_check_equal $? 0
+	result=$(xbps-query -C xbps.d -r root --repository=$REPO -Rs A)
+	atf_check_equal "$result" "[-] A-1.0_1 A pkg"
+}
+
+atf_init_test_cases() {
+	atf_add_test_case conf
+	atf_add_test_case failover
+	atf_add_test_case ranking
+}
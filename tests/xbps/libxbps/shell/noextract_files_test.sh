@@ -169,10 +169,48 @@ tc5_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case tc6
+
+tc6_head() {
+	atf_set "descr" "Tests for pkg install with noextract: last literal, prefix or glob match wins"
+}
+
+tc6_body() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin pkg_A/usr/lib
+	touch pkg_A/usr/bin/blah pkg_A/usr/bin/foo pkg_A/usr/lib/foo pkg_A/usr/lib/fuu
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "noextract=/usr/*/f??" > root/xbps.d/foo.conf
+	echo "noextract=!/usr/lib/foo" >> root/xbps.d/foo.conf
+	echo "noextract=!/usr/bin/f*" >> root/xbps.d/foo.conf
+	echo "noextract=/usr/bin/blah" >> root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+
+	rv=0
+	[ -e root/usr/lib/foo ] || rv=1
+	[ -e root/usr/bin/foo ] || rv=2
+	[ -e root/usr/lib/fuu ] && rv=3
+	[ -e root/usr/bin/blah ] && rv=4
+	atf_check_equal $rv 0
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case tc1
 	atf_add_test_case tc2
 	atf_add_test_case tc3
 	atf_add_test_case tc4
 	atf_add_test_case tc5
+	atf_add_test_case tc6
 }
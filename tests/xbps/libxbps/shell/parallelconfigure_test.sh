@@ -0,0 +1,87 @@
+#!/usr/bin/env atf-sh
+
+parallelconfigure_pkgs() {
+	mkdir some_repo
+	for f in A B C D; do
+		mkdir -p pkg_$f/usr/share/$f
+		echo "$f-$1" > pkg_$f/usr/share/$f/file
+		cat > pkg_$f/INSTALL <<_EOF
+#!/bin/sh
+ACTION="\$1"
+case "\$ACTION" in
+post)
+	[ -f $f-fail ] && exit 1
+	touch $f-post-ran
+	;;
+esac
+_EOF
+		chmod +x pkg_$f/INSTALL
+	done
+	# C must be configured after its dependencies.
+	sed -i 's/^post)$/post)\n\t[ -f A-post-ran ] || exit 1\n\t[ -f B-post-ran ] || exit 1/' pkg_C/INSTALL
+
+	cd some_repo
+	xbps-create -A noarch -n A-$1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-$1_1 -s "B pkg" --provides "vB-1_1" -D "A>=0" ../pkg_B
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-$1_1 -s "C pkg" -D "vB>=0" ../pkg_C
+	atf_check_equal $? 0
+	xbps-create -A noarch -n D-$1_1 -s "D pkg" -D "C>=0" ../pkg_D
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	rm -rf pkg_A pkg_B pkg_C pkg_D
+}
+
+atf_test_case install
+
+install_head() {
+	atf_set "descr" "Tests for pkg install with parallelconfigure=true"
+}
+
+install_body() {
+	parallelconfigure_pkgs 1.0
+	mkdir -p root/xbps.d
+	echo "parallelconfigure=true" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd D
+	atf_check_equal $? 0
+
+	for f in A B C D; do
+		atf_check_equal "$(ls root/$f-post-ran)" "root/$f-post-ran"
+		atf_check_equal "$(xbps-query -C xbps.d -r root -p state $f)" installed
+	done
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+}
+
+atf_test_case failure
+
+failure_head() {
+	atf_set "descr" "Tests for pkg install with parallelconfigure=true and a failing post action"
+}
+
+failure_body() {
+	parallelconfigure_pkgs 1.0
+	mkdir -p root/xbps.d
+	echo "parallelconfigure=true" > root/xbps.d/foo.conf
+	touch root/B-fail
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd D
+	atf_check_equal $? 1
+
+	# the package database is not written on failure
+	atf_check_equal "$(ls root/A-post-ran)" "root/A-post-ran"
+	atf_check_equal "$(xbps-query -C xbps.d -r root -p state A)" unpacked
+	for f in B C D; do
+		atf_check_equal "$(xbps-query -C xbps.d -r root -p state $f)" unpacked
+		atf_check_equal "$(ls root/$f-post-ran 2>/dev/null)" ""
+	done
+}
+
+atf_init_test_cases() {
+	atf_add_test_case install
+	atf_add_test_case failure
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env atf-sh
+
+parallelunpack_pkgs() {
+	mkdir some_repo
+	for f in A B C D; do
+		mkdir -p pkg_$f/usr/share/$f
+		echo "$f-$1" > pkg_$f/usr/share/$f/file
+	done
+	# C's pre action must see its dependencies already unpacked.
+	cat > pkg_C/INSTALL <<_EOF
+#!/bin/sh
+ACTION="\$1"
+case "\$ACTION" in
+pre)
+	[ -f usr/share/A/file ] || exit 1
+	[ -f usr/share/B/file ] || exit 1
+	touch C-pre-ran
+	;;
+esac
+_EOF
+	chmod +x pkg_C/INSTALL
+
+	cd some_repo
+	xbps-create -A noarch -n A-$1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-$1_1 -s "B pkg" -D "A>=0" ../pkg_B
+	atf_check_equal $? 0
+	xbps-create -A noarch -n C-$1_1 -s "C pkg" -D "B>=0" ../pkg_C
+	atf_check_equal $? 0
+	xbps-create -A noarch -n D-$1_1 -s "D pkg" -D "C>=0" ../pkg_D
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	rm -rf pkg_A pkg_B pkg_C pkg_D
+}
+
+atf_test_case install
+
+install_head() {
+	atf_set "descr" "Tests for pkg install with parallelunpack=true"
+}
+
+install_body() {
+	parallelunpack_pkgs 1.0
+	mkdir -p root/xbps.d
+	printf "parallelunpack=true\niouring=true\n" > root/xbps.d/foo.conf
+
+	# the threads create files with the unpack umask, not the caller's one
+	(umask 077; xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd D)
+	atf_check_equal $? 0
+
+	for f in A B C D; do
+		atf_check_equal "$(cat root/usr/share/$f/file)" "$f-1.0"
+		atf_check_equal "$(stat -c %a root/usr/share/$f/file)" "644"
+	done
+	atf_check_equal "$(ls root/C-pre-ran)" "root/C-pre-ran"
+
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+	atf_check_equal "$(xbps-query -C xbps.d -r root -l | wc -l)" 4
+}
+
+atf_test_case update
+
+update_head() {
+	atf_set "descr" "Tests for pkg update with parallelunpack=true"
+}
+
+update_body() {
+	parallelunpack_pkgs 1.0
+	mkdir -p root/xbps.d
+	echo "parallelunpack=true" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd D
+	atf_check_equal $? 0
+
+	rm -rf some_repo root/C-pre-ran
+	parallelunpack_pkgs 1.1
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yud
+	atf_check_equal $? 0
+
+	for f in A B C D; do
+		atf_check_equal "$(cat root/usr/share/$f/file)" "$f-1.1"
+		atf_check_equal "$(xbps-query -C xbps.d -r root -p pkgver $f)" "$f-1.1_1"
+	done
+	atf_check_equal "$(ls root/C-pre-ran)" "root/C-pre-ran"
+
+	xbps-pkgdb -C xbps.d -r root -a
+	atf_check_equal $? 0
+}
+
+atf_init_test_cases() {
+	atf_add_test_case install
+	atf_add_test_case update
+}
@@ -84,7 +84,40 @@ script_arch_body() {
 	atf_check_equal $rval 0
 }
 
+atf_test_case script_large
+
+script_large_head() {
+	atf_set "descr" "Tests for package scripts: large scripts from a temporary file"
+}
+
+script_large_body() {
+	mkdir some_repo root
+	mkdir -p pkg_A/usr/bin
+	echo "A-1.0_1" > pkg_A/usr/bin/foo
+	create_script pkg_A/INSTALL
+	i=0
+	while [ $i -lt 1500 ]; do
+		echo "# padding line to make this script larger than 64KiB ........" >> pkg_A/INSTALL
+		i=$((i+1))
+	done
+
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -C empty.conf -r root --repository=$PWD/some_repo -y A
+	atf_check_equal $? 0
+
+	xbps-reconfigure -C empty.conf -r root -f A 2>out
+	atf_check_equal "$(cat out)" "post A 1.0_1 no no $(uname -m)"
+	# temporary scripts are removed
+	atf_check_equal "$(ls -a root | grep -c xbps-script)" 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case script_nargs
 	atf_add_test_case script_arch
+	atf_add_test_case script_large
 }
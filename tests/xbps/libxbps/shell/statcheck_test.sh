@@ -0,0 +1,99 @@
+#!/usr/bin/env atf-sh
+
+atf_test_case update_unchanged
+
+update_unchanged_head() {
+	atf_set "descr" "Tests for pkg update with statcheck: unchanged and changed files"
+}
+
+update_unchanged_body() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin
+	echo "foofoo" > pkg_A/usr/bin/foo
+	echo "barbar" > pkg_A/usr/bin/bar
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "statcheck=true" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+
+	grep -q "<key>ctime</key>" root/var/db/xbps/.A-files.plist
+	atf_check_equal $? 0
+
+	echo "barbarbar" > pkg_A/usr/bin/bar
+	cd some_repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	ino=$(stat -c %i root/usr/bin/foo)
+	mtime=$(stat -c %Y root/usr/bin/foo)
+	out=$(xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yud 2>&1)
+	atf_check_equal $? 0
+
+	# the unchanged file is matched by stat and not extracted again
+	echo "$out" | grep -q "A-1.1_1: 1 files matched by stat"
+	atf_check_equal $? 0
+	atf_check_equal "$(stat -c %i root/usr/bin/foo)" "$ino"
+	atf_check_equal "$(stat -c %Y root/usr/bin/foo)" "$mtime"
+	atf_check_equal "$(cat root/usr/bin/foo)" "foofoo"
+	atf_check_equal "$(cat root/usr/bin/bar)" "barbarbar"
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+}
+
+atf_test_case update_modified
+
+update_modified_head() {
+	atf_set "descr" "Tests for pkg update with statcheck: modified files are restored"
+}
+
+update_modified_body() {
+	mkdir some_repo
+	mkdir -p pkg_A/usr/bin
+	echo "foofoo" > pkg_A/usr/bin/foo
+	cd some_repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	mkdir -p root/xbps.d
+	echo "statcheck=true" > root/xbps.d/foo.conf
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yd A
+	atf_check_equal $? 0
+
+	echo "modified foofoo" > root/usr/bin/foo
+
+	cd some_repo
+	xbps-create -A noarch -n A-1.1_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+
+	xbps-install -C xbps.d -r root --repository=$PWD/some_repo -yud
+	atf_check_equal $? 0
+
+	atf_check_equal "$(cat root/usr/bin/foo)" "foofoo"
+
+	xbps-pkgdb -C xbps.d -r root A
+	atf_check_equal $? 0
+}
+
+atf_init_test_cases() {
+	atf_add_test_case update_unchanged
+	atf_add_test_case update_modified
+}
@@ -179,6 +179,56 @@ reject_fifo_file_body() {
 	atf_check_equal $? 1
 }
 
+atf_test_case frame_size
+
+frame_size_head() {
+	atf_set "descr" "xbps-create(1): split compressed data into frames"
+}
+
+frame_size_body() {
+	mkdir -p repo pkg_A/usr/share/foo
+	head -c 300000 /dev/urandom > pkg_A/usr/share/foo/data
+	cd repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" --frame-size 65536 ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" --compression xz --frame-size 65536 ../pkg_A
+	atf_check_equal $? 1
+	cd ..
+	xbps-rindex -d -a repo/*.xbps
+	atf_check_equal $? 0
+	xbps-install -r root --repository=repo -yd foo
+	atf_check_equal $? 0
+	cmp -s pkg_A/usr/share/foo/data root/usr/share/foo/data
+	atf_check_equal $? 0
+}
+
+atf_test_case seekable_layout
+
+seekable_layout_head() {
+	atf_set "descr" "xbps-create(1): metadata frame readable without the payload"
+}
+
+seekable_layout_body() {
+	mkdir -p repo pkg_A/usr/share/foo
+	head -c 300000 /dev/urandom > pkg_A/usr/share/foo/data
+	cd repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	atf_check_equal "$(xbps-query -R --repository=repo -f foo)" /usr/share/foo/data
+
+	# the trailer records the size of the metadata frame
+	size=$(stat -c %s repo/foo-1.0_1.noarch.xbps)
+	atf_check_equal "$(tail -c 24 repo/foo-1.0_1.noarch.xbps | head -c 8)" XBPSIDX1
+	metasize=$(od -An -t u8 -j $((size-16)) -N 8 repo/foo-1.0_1.noarch.xbps | tr -d ' ')
+	# corrupt the payload frame, metadata is still readable
+	printf 'XXXXXXXXXXXXXXXX' | dd of=repo/foo-1.0_1.noarch.xbps bs=1 \
+		seek=$metasize conv=notrunc
+	atf_check_equal "$(xbps-query -R --repository=repo -f foo)" /usr/share/foo/data
+}
+
 atf_init_test_cases() {
 	atf_add_test_case hardlinks_size
 	atf_add_test_case symlink_relative_target
@@ -187,4 +237,6 @@ atf_init_test_cases() {
 	atf_add_test_case restore_mtime
 	atf_add_test_case reproducible_pkg
 	atf_add_test_case reject_fifo_file
+	atf_add_test_case frame_size
+	atf_add_test_case seekable_layout
 }
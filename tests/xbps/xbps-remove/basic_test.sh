@@ -46,7 +46,39 @@ remove_orphans_body() {
 	atf_check_equal $? 2
 }
 
+atf_test_case clean_cache
+
+clean_cache_head() {
+	atf_set "descr" "xbps-remove(1): clean obsolete and corrupt packages from cachedir"
+}
+
+clean_cache_body() {
+	mkdir -p some_repo other_repo cache xbps.d pkg_A pkg_B pkg_C pkg_D
+	for f in A B C D; do
+		echo "$f" > pkg_$f/file
+	done
+	cd some_repo
+	for f in A B C; do
+		xbps-create -A noarch -n $f-1.0_1 -s "$f pkg" ../pkg_$f
+		atf_check_equal $? 0
+	done
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ../other_repo
+	xbps-create -A noarch -n D-1.0_1 -s "D pkg" ../pkg_D
+	atf_check_equal $? 0
+	cd ..
+	cp some_repo/*.xbps other_repo/*.xbps cache
+	echo "garbage" >> cache/B-1.0_1.noarch.xbps
+	echo "repository=$PWD/some_repo" > xbps.d/repo.conf
+
+	xbps-remove -r root -C $PWD/xbps.d -c $PWD/cache -O
+	atf_check_equal $? 0
+	atf_check_equal "$(cd cache && echo *.xbps)" "A-1.0_1.noarch.xbps C-1.0_1.noarch.xbps"
+}
+
 atf_init_test_cases() {
 	atf_add_test_case remove_directory
 	atf_add_test_case remove_orphans
+	atf_add_test_case clean_cache
 }
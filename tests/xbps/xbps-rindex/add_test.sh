@@ -167,9 +167,140 @@ stage_resolve_bug_body() {
 	atf_check_equal $? 1
 }
 
+atf_test_case deltas
+
+deltas_head() {
+	atf_set "descr" "xbps-rindex(1) -a: binary package deltas test"
+}
+
+deltas_body() {
+	mkdir -p some_repo pkg_A/usr/bin pkg_A/usr/share/foo
+	for f in 0 1 2 3 4 5 6 7; do
+		dd if=/dev/urandom of=pkg_A/usr/share/foo/file0$f bs=64k count=1 2>/dev/null
+	done
+	echo 1.0 > pkg_A/usr/bin/foo
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/foo-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	echo 1.1 > ../pkg_A/usr/bin/foo
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d --deltas 2 -a $PWD/foo-1.1_1.noarch.xbps 2>err
+	atf_check_equal $? 0
+	if grep -q "not supported" err; then
+		atf_skip "xbps built without libzstd"
+	fi
+	[ -f foo-1.1_1.from-1.0_1.noarch.xbpsd ]
+	atf_check_equal $? 0
+	# the delta is still referenced by the index
+	xbps-rindex -d -r $PWD
+	atf_check_equal $? 0
+	[ -f foo-1.1_1.from-1.0_1.noarch.xbpsd ]
+	atf_check_equal $? 0
+	# but not after the next update without deltas
+	echo 1.2 > ../pkg_A/usr/bin/foo
+	xbps-create -A noarch -n foo-1.2_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/foo-1.2_1.noarch.xbps
+	atf_check_equal $? 0
+	xbps-rindex -d -r $PWD
+	atf_check_equal $? 0
+	[ -f foo-1.1_1.from-1.0_1.noarch.xbpsd ]
+	atf_check_equal $? 1
+}
+
+atf_test_case append
+
+append_head() {
+	atf_set "descr" "xbps-rindex(1) -a: append index segments and compact"
+}
+
+append_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n baz-1.0_1 -s "baz pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d --append -a $PWD/foo-1.1_1.noarch.xbps $PWD/baz-1.0_1.noarch.xbps
+	atf_check_equal $? 0
+	rm bar-1.0_1.noarch.xbps
+	xbps-rindex -d --append -c $PWD
+	atf_check_equal $? 0
+	cd ..
+	result="$(xbps-query -r root -C empty.conf --repository=some_repo -s '')"
+	expected="[-] baz-1.0_1 baz pkg
+[-] foo-1.1_1 foo pkg"
+	rv=0
+	if [ "$result" != "$expected" ]; then
+		echo "result: $result"
+		echo "expected: $expected"
+		rv=1
+	fi
+	atf_check_equal $rv 0
+	size=$(wc -c < some_repo/*-repodata)
+	xbps-rindex -d --compact $PWD/some_repo
+	atf_check_equal $? 0
+	[ $(wc -c < some_repo/*-repodata) -lt $size ]
+	atf_check_equal $? 0
+	result="$(xbps-query -r root -C empty.conf --repository=some_repo -s '')"
+	if [ "$result" != "$expected" ]; then
+		echo "result: $result"
+		echo "expected: $expected"
+		rv=1
+	fi
+	atf_check_equal $rv 0
+}
+
+atf_test_case compression_level
+
+compression_level_head() {
+	atf_set "descr" "xbps-rindex(1) -a: compression level and threads"
+}
+
+compression_level_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d --compression-level 30 -a $PWD/*.xbps
+	atf_check_equal $? 1
+	xbps-rindex -d --compression gzip --compression-level 10 -a $PWD/*.xbps
+	atf_check_equal $? 1
+	xbps-rindex -d --compression-threads -1 -a $PWD/*.xbps
+	atf_check_equal $? 1
+	xbps-rindex -d --compression-level 19 --compression-threads 2 -a $PWD/*.xbps
+	atf_check_equal $? 0
+	xbps-rindex -d --compression xz --compression-level 1 --compression-threads 0 --compact $PWD
+	atf_check_equal $? 0
+	cd ..
+	result="$(xbps-query -r root -C empty.conf --repository=some_repo -s '')"
+	expected="[-] foo-1.0_1 foo pkg"
+	rv=0
+	if [ "$result" != "$expected" ]; then
+		echo "result: $result"
+		echo "expected: $expected"
+		rv=1
+	fi
+	atf_check_equal $rv 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case update
 	atf_add_test_case revert
 	atf_add_test_case stage
 	atf_add_test_case stage_resolve_bug
+	atf_add_test_case deltas
+	atf_add_test_case append
+	atf_add_test_case compression_level
 }
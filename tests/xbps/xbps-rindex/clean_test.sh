@@ -79,8 +79,47 @@ remove_from_stage_body() {
 	atf_check_equal $? 1
 }
 
+atf_test_case hashcheck_statcache
+
+hashcheck_statcache_head() {
+	atf_set "descr" "xbps-rindex(1) -C -c: only hash changed packages"
+}
+
+hashcheck_statcache_body() {
+	mkdir -p some_repo pkg_A
+	touch pkg_A/file00
+	cd some_repo
+	xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	touch -d "1 minute ago" *.xbps
+	xbps-rindex -d -C -c $PWD
+	atf_check_equal $? 0
+	[ -f *-repodata.statcache ]
+	atf_check_equal $? 0
+	result=$(xbps-rindex -d -C -c $PWD 2>&1 | grep -c "unchanged since last check")
+	atf_check_equal "$result" 2
+	echo garbage >> foo-1.0_1.noarch.xbps
+	xbps-rindex -d -C -c $PWD
+	atf_check_equal $? 0
+	cd ..
+	result="$(xbps-query -r root -C empty.conf --repository=some_repo -s '')"
+	expected="[-] bar-1.0_1 bar pkg"
+	rv=0
+	if [ "$result" != "$expected" ]; then
+		echo "result: $result"
+		echo "expected: $expected"
+		rv=1
+	fi
+	atf_check_equal $rv 0
+}
+
 atf_init_test_cases() {
 	atf_add_test_case noremove
 	atf_add_test_case issue19
 	atf_add_test_case remove_from_stage
+	atf_add_test_case hashcheck_statcache
 }